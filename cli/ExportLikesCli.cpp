@@ -0,0 +1,682 @@
+// Headless ExportLikes: same pipelines as the GUI, driven by options.
+//
+//   ExportLikesCli [--import <file>|-] [--remove <number>]
+//                  [--client-id <id>] [--redirect-uri <uri>]
+//                  [--concurrency 16] [--threads 0] [--relike] [--restart]
+//                  [--metrics <file>] [--trace <file>] [--verbose]
+//                  [--job <kind>:<arg>[,weight=<w>][,interactive][,account=<name>]]...
+//                  [--max-jobs 4]
+//
+// Authorization URL is printed; the code comes to the local
+// AuthorizationServer at the redirect URI. Progress and stats are written
+// to stdout as JSON lines, logs go to stderr. --metrics keeps a
+// Prometheus text (or .json) dump of request stage latencies up to date,
+// --trace writes a Chrome trace of the run. Ctrl+C stops the running
+// pipeline; an import resumes from its journal on the next run.
+// --job runs imports/removals of several accounts at once through
+// JobQueue, sharing connections and the rate budget by weight.
+// --import - reads NDJSON tracks from stdin while they are written:
+//
+//   export_yandex_music_likes.py --stream | ExportLikesCli --import -
+
+#include "SpotifyClient.hpp"
+#include "AuthorizationServer.hpp"
+#include "JobQueue.hpp"
+#include "SpotifyIoService.hpp"
+#include "Trace.hpp"
+#include "TrackStream.hpp"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QStandardPaths>
+#include <QString>
+#include <QUrl>
+#include <QtGlobal>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <csignal>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/signal_set.hpp>
+
+namespace {
+// One --job: import or removal on an account
+struct JobOption{
+    JobQueue::Kind kind = JobQueue::Kind::Import;
+    std::string input;
+    std::size_t count = 0;
+    double weight = 1.0;
+    bool interactive = false;
+    std::string account = "default";
+};
+
+struct Options{
+    std::string importPath;
+    std::size_t remove = 0;
+    std::string clientId = "3b19f004deee439b89f3245afb8b84ed";
+    std::string redirectUri = "http://127.0.0.1:8888/callback";
+    std::size_t concurrency = 16;
+    std::size_t threads = 0;
+    // Metrics dump, empty = none
+    std::string metricsPath;
+    // Chrome trace, empty = none
+    std::string tracePath;
+    bool verbose = false;
+    // Like again tracks that are already in the library
+    bool relike = false;
+    // Ignore the journal of an interrupted import
+    bool restart = false;
+    // Jobs run at once through JobQueue, empty = --import/--remove
+    std::vector<JobOption> jobs;
+    std::size_t maxJobs = 4;
+};
+
+bool verboseLog = false;
+
+// qDebug noise only with --verbose, everything on stderr
+void logHandler(QtMsgType type, const QMessageLogContext&, const QString& msg){
+    if(type == QtDebugMsg && !verboseLog){
+        return;
+    }
+    std::fprintf(stderr, "%s\n", msg.toLocal8Bit().constData());
+}
+
+std::string jsonEscape(const std::string& s){
+    std::string out;
+    out.reserve(s.size() + 2);
+    for(unsigned char c : s){
+        switch(c){
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if(c < 0x20){
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            }
+            else{
+                out += char(c);
+            }
+        }
+    }
+    return out;
+}
+
+// One JSON object per line on stdout
+class EventWriter{
+public:
+    void write(const std::string& fields){
+        std::lock_guard lock(mutex_);
+        std::cout << "{" << fields << "}" << std::endl;
+    }
+private:
+    std::mutex mutex_;
+};
+
+// Web API requests of the current phase, counted on io threads
+struct RequestStats{
+    std::atomic<std::size_t> requests{0};
+    std::atomic<std::size_t> rateLimited{0};
+    std::atomic<std::size_t> failed{0};
+
+    void reset(){
+        requests = 0;
+        rateLimited = 0;
+        failed = 0;
+    }
+};
+
+// Rewrites the metrics file every 5 s while alive and once more on stop
+class MetricsDumper{
+public:
+    MetricsDumper(const Metrics& metrics, std::string path) :
+        metrics_(metrics)
+        , path_(std::move(path))
+    {
+        if(!path_.empty()){
+            thread_ = std::thread([this]{ run(); });
+        }
+    }
+
+    ~MetricsDumper(){
+        if(!thread_.joinable()){
+            return;
+        }
+        {
+            std::lock_guard lock(mutex_);
+            stopped_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+        dump();
+    }
+private:
+    void run(){
+        std::unique_lock lock(mutex_);
+        while(!wake_.wait_for(lock, std::chrono::seconds(5), [this]{ return stopped_; })){
+            dump();
+        }
+    }
+
+    void dump(){
+        if(!metrics_.writeFile(path_)){
+            qWarning() << "Cannot write metrics to" << QString::fromStdString(path_);
+        }
+    }
+
+    const Metrics& metrics_;
+    std::string path_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopped_ = false;
+    std::thread thread_;
+};
+
+// Prints a progress event every 250 ms while alive and once more on stop
+class ProgressPrinter{
+public:
+    ProgressPrinter(EventWriter& events, const ProgressTracker& tracker, const char* phase) :
+        events_(events)
+        , sampler_(tracker)
+        , phase_(phase)
+        , thread_([this]{ run(); })
+    {}
+
+    ~ProgressPrinter(){
+        {
+            std::lock_guard lock(mutex_);
+            stopped_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+        print();
+    }
+private:
+    void run(){
+        std::unique_lock lock(mutex_);
+        while(!wake_.wait_for(lock, std::chrono::milliseconds(250), [this]{ return stopped_; })){
+            print();
+        }
+    }
+
+    void print(){
+        auto snapshot = sampler_.sample();
+        events_.write(std::string("\"event\":\"progress\",\"phase\":\"") + phase_
+                      + "\",\"current\":" + std::to_string(snapshot.done)
+                      + ",\"total\":" + std::to_string(snapshot.total)
+                      + ",\"rate\":" + std::to_string(snapshot.rate)
+                      + (snapshot.eta ? ",\"eta_sec\":" + std::to_string(snapshot.eta->count()) : ""));
+    }
+
+    EventWriter& events_;
+    ProgressSampler sampler_;
+    const char* phase_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopped_ = false;
+    std::thread thread_;
+};
+
+// Feed stdin to the stream on a thread of its own until EOF.
+// Plain read(): stdio would wait for a full buffer before the first line
+void pipeStdin(std::shared_ptr<TrackStream> stream){
+    std::thread([stream]{
+        char buf[64 * 1024];
+        while(true){
+#ifdef _WIN32
+            int n = _read(_fileno(stdin), buf, sizeof(buf));
+#else
+            auto n = read(STDIN_FILENO, buf, sizeof(buf));
+#endif
+            if(n <= 0){
+                stream->close(n == 0);
+                return;
+            }
+            stream->append(std::string_view(buf, std::size_t(n)));
+        }
+    }).detach();
+}
+
+// Run coroutine on the client strand and wait for it.
+// False if it threw or returned false
+template <typename Make>
+bool runSync(const SpotifyClient& client, Make make){
+    std::promise<bool> done;
+    boost::asio::co_spawn(
+        client.executor(),
+        [&]() -> boost::asio::awaitable<void>{
+            bool ok = false;
+            try{
+                if constexpr(std::is_same_v<decltype(make()), boost::asio::awaitable<bool>>){
+                    ok = co_await make();
+                }
+                else{
+                    co_await make();
+                    ok = true;
+                }
+            }
+            catch(std::exception& e){
+                qWarning() << "Error:" << e.what();
+            }
+            done.set_value(ok);
+        },
+        boost::asio::detached);
+    return done.get_future().get();
+}
+
+void reportDone(EventWriter& events, const char* phase, std::size_t items,
+                std::chrono::duration<double> elapsed, const RequestStats& stats){
+    events.write(std::string("\"event\":\"done\",\"phase\":\"") + phase
+                 + "\",\"items\":" + std::to_string(items)
+                 + ",\"seconds\":" + std::to_string(elapsed.count())
+                 + ",\"items_per_sec\":" + std::to_string(elapsed.count() > 0
+                                                          ? double(items) / elapsed.count() : 0.0)
+                 + ",\"requests\":" + std::to_string(stats.requests)
+                 + ",\"rate_limited\":" + std::to_string(stats.rateLimited)
+                 + ",\"failed\":" + std::to_string(stats.failed));
+}
+
+void configureClient(SpotifyClient& client, const Options& options){
+    client.setClientId(options.clientId);
+    client.setRedirectUri(options.redirectUri);
+    client.setSearchConcurrency(options.concurrency);
+    client.setSkipLiked(!options.relike);
+    client.setResumeImports(!options.restart);
+
+    // Same cache as the GUI, opened once for all accounts of the transport
+    QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+    QDir().mkpath(dataDir);
+    client.setSearchCachePath((dataDir + "/search_cache.bin").toStdString());
+}
+
+// Authorization: URL is opened by the user on any machine,
+// the redirect has to reach this host
+bool authorizeClient(SpotifyClient& client, const Options& options, EventWriter& events,
+                     const std::string& account){
+    auto port = QUrl(QString::fromStdString(options.redirectUri)).port(8888);
+    try{
+        AuthorizationServer authSrv(static_cast<unsigned short>(port));
+        events.write("\"event\":\"authorize\","
+                     + (account.empty() ? std::string() : "\"account\":\"" + jsonEscape(account) + "\",")
+                     + "\"url\":\"" + jsonEscape(client.authorize()) + "\"");
+        runSync(client, [&]() -> boost::asio::awaitable<void>{
+            auto code = co_await authSrv.asyncGetAuthorizationCode();
+            if(!code.empty()){
+                client.setAuthorizationCode(code);
+                co_await client.fetchTokens(code);
+            }
+        });
+        authSrv.shoutdown();
+    }
+    catch(std::exception& e){
+        qWarning() << "Authorization server failed:" << e.what();
+    }
+    return client.hasValidAccessToken();
+}
+
+// --job: every account is authorized in turn, then all jobs run
+// through one JobQueue on one transport
+int runJobs(const Options& options, EventWriter& events){
+    auto transport = std::make_shared<SpotifyTransport>();
+
+    // Jobs of one account share its client and run one after another
+    std::map<std::string, std::shared_ptr<SpotifyClient>> accounts;
+    for(auto& job : options.jobs){
+        auto& client = accounts[job.account];
+        if(!client){
+            client = std::make_shared<SpotifyClient>(transport);
+            configureClient(*client, options);
+        }
+    }
+    int exitCode = 0;
+    for(auto it = accounts.begin(); it != accounts.end();){
+        if(authorizeClient(*it->second, options, events, it->first)){
+            ++it;
+            continue;
+        }
+        events.write("\"event\":\"error\",\"account\":\"" + jsonEscape(it->first)
+                     + "\",\"message\":\"authorization failed\"");
+        exitCode = 1;
+        it = accounts.erase(it);
+    }
+
+    // Two names logged into one Spotify user would share its import journals
+    std::map<std::string, std::string> users;
+    for(auto it = accounts.begin(); it != accounts.end();){
+        auto& client = *it->second;
+        std::optional<std::string> user;
+        runSync(client, [&]() -> boost::asio::awaitable<void>{
+            user = co_await client.fetchUserId();
+        });
+        auto known = user ? users.find(*user) : users.end();
+        if(known == users.end()){
+            if(user){
+                users.emplace(*user, it->first);
+            }
+            ++it;
+            continue;
+        }
+        events.write("\"event\":\"error\",\"account\":\"" + jsonEscape(it->first)
+                     + "\",\"message\":\"same Spotify account as "
+                     + jsonEscape(known->second) + "\"");
+        exitCode = 1;
+        it = accounts.erase(it);
+    }
+
+    MetricsDumper dumper(transport->metrics(), options.metricsPath);
+    std::vector<std::unique_ptr<ProgressPrinter>> printers;
+    for(auto& [account, client] : accounts){
+        printers.push_back(std::make_unique<ProgressPrinter>(events, client->progress(), account.c_str()));
+    }
+
+    std::mutex mutex;
+    std::map<JobQueue::JobId, const JobOption*> submitted;
+    bool interrupted = false;
+    bool failed = false;
+    {
+        JobQueue queue(options.maxJobs);
+        queue.setDoneHandler([&](JobQueue::JobId id, JobQueue::State state){
+            std::lock_guard lock(mutex);
+            failed = failed || state == JobQueue::State::Failed;
+            auto& job = *submitted.at(id);
+            auto& client = accounts.at(job.account);
+            events.write("\"event\":\"job\",\"id\":" + std::to_string(id)
+                         + ",\"account\":\"" + jsonEscape(job.account)
+                         + "\",\"kind\":\"" + (job.kind == JobQueue::Kind::Import ? "import" : "remove")
+                         + "\",\"state\":\"" + JobQueue::name(state)
+                         + "\",\"items\":" + std::to_string(client->progress().done()));
+        });
+
+        {
+            std::lock_guard lock(mutex);
+            for(auto& job : options.jobs){
+                auto account = accounts.find(job.account);
+                if(account == accounts.end()){
+                    continue;
+                }
+                auto id = queue.submit({job.kind, account->second, job.input, job.count, job.weight,
+                                        job.interactive ? RequestScheduler::Priority::Interactive
+                                                        : RequestScheduler::Priority::Bulk});
+                submitted.emplace(id, &job);
+            }
+        }
+
+        // Ctrl+C stops every job, imports resume from their journals
+        boost::asio::signal_set interrupt(GlobalIoService::instance(), SIGINT, SIGTERM);
+        interrupt.async_wait([&](const boost::system::error_code& ec, int){
+            if(ec){
+                return;
+            }
+            std::lock_guard lock(mutex);
+            interrupted = true;
+            for(auto& [id, job] : submitted){
+                queue.cancel(id);
+            }
+        });
+
+        std::promise<void> idle;
+        boost::asio::co_spawn(GlobalIoService::instance(),
+            [&]() -> boost::asio::awaitable<void>{
+                co_await queue.waitIdle();
+                idle.set_value();
+            },
+            boost::asio::detached);
+        idle.get_future().wait();
+        interrupt.cancel();
+    }
+    printers.clear();
+
+    std::lock_guard lock(mutex);
+    if(interrupted){
+        events.write("\"event\":\"stopped\"");
+        exitCode = 130;
+    }
+    else if(failed){
+        exitCode = 1;
+    }
+    return exitCode;
+}
+
+void usage(){
+    std::cerr << "Usage: ExportLikesCli [--import <file>|-] [--remove <number>]\n"
+                 "                      [--client-id <id>] [--redirect-uri <uri>]\n"
+                 "                      [--concurrency 16] [--threads 0] [--relike] [--restart]\n"
+                 "                      [--metrics <file>] [--trace <file>] [--verbose]\n"
+                 "                      [--job import:<file>|remove:<n>[,weight=<w>][,interactive]"
+                 "[,account=<name>]]... [--max-jobs 4]\n";
+}
+
+// import:<file>[,weight=<w>][,interactive][,account=<name>] or remove:<n>[,...]
+JobOption parseJob(const std::string& spec){
+    JobOption job;
+    std::size_t pos = spec.find(',');
+    std::string head = spec.substr(0, pos);
+    auto colon = head.find(':');
+    if(colon == std::string::npos){
+        throw std::invalid_argument("job needs <kind>:<arg>");
+    }
+    auto kind = head.substr(0, colon);
+    auto arg = head.substr(colon + 1);
+    if(kind == "import"){
+        job.input = arg;
+    }
+    else if(kind == "remove"){
+        job.kind = JobQueue::Kind::Remove;
+        job.count = std::stoul(arg);
+    }
+    else{
+        throw std::invalid_argument("unknown job kind " + kind);
+    }
+
+    while(pos != std::string::npos){
+        auto next = spec.find(',', pos + 1);
+        auto item = spec.substr(pos + 1, next == std::string::npos ? std::string::npos : next - pos - 1);
+        pos = next;
+        if(item == "interactive"){
+            job.interactive = true;
+        }
+        else if(item.rfind("weight=", 0) == 0){
+            job.weight = std::stod(item.substr(7));
+        }
+        else if(item.rfind("account=", 0) == 0){
+            job.account = item.substr(8);
+        }
+        else{
+            throw std::invalid_argument("unknown job option " + item);
+        }
+    }
+    return job;
+}
+
+Options parseArgs(int argc, char* argv[]){
+    Options options;
+    if(auto* id = std::getenv("SPOTIFY_CLIENT_ID")){
+        options.clientId = id;
+    }
+    if(auto* uri = std::getenv("SPOTIFY_REDIRECT_URI")){
+        options.redirectUri = uri;
+    }
+
+    for(int i = 1; i < argc; ++i){
+        std::string key = argv[i];
+        if(key == "--verbose"){
+            options.verbose = true;
+            continue;
+        }
+        if(key == "--relike"){
+            options.relike = true;
+            continue;
+        }
+        if(key == "--restart"){
+            options.restart = true;
+            continue;
+        }
+        if(key == "--help" || i + 1 >= argc){
+            usage();
+            std::exit(key == "--help" ? 0 : 2);
+        }
+        std::string value = argv[++i];
+        if(key == "--import") options.importPath = value;
+        else if(key == "--remove") options.remove = std::stoul(value);
+        else if(key == "--client-id") options.clientId = value;
+        else if(key == "--redirect-uri") options.redirectUri = value;
+        else if(key == "--concurrency") options.concurrency = std::stoul(value);
+        else if(key == "--threads") options.threads = std::stoul(value);
+        else if(key == "--metrics") options.metricsPath = value;
+        else if(key == "--trace") options.tracePath = value;
+        else if(key == "--max-jobs") options.maxJobs = std::stoul(value);
+        else if(key == "--job"){
+            try{
+                options.jobs.push_back(parseJob(value));
+            }
+            catch(std::exception& e){
+                std::cerr << "Bad --job " << value << ": " << e.what() << "\n";
+                std::exit(2);
+            }
+        }
+        else{
+            std::cerr << "Unknown option " << key << "\n";
+            usage();
+            std::exit(2);
+        }
+    }
+    if(options.importPath.empty() && options.remove == 0 && options.jobs.empty()){
+        usage();
+        std::exit(2);
+    }
+    return options;
+}
+}
+
+int main(int argc, char* argv[]){
+    QCoreApplication::setApplicationName("ExportLikes");
+    qInstallMessageHandler(logHandler);
+
+    auto options = parseArgs(argc, argv);
+    verboseLog = options.verbose;
+    GlobalIoService::setThreadCount(options.threads);
+    if(!options.tracePath.empty()){
+        Tracer::start(options.tracePath);
+    }
+
+    EventWriter events;
+    RequestStats stats;
+    int exitCode = 0;
+    if(!options.jobs.empty()){
+        exitCode = runJobs(options, events);
+    }
+    else{
+        SpotifyClient client;
+        configureClient(client, options);
+        client.setRequestObserver([&stats](auto, auto, unsigned status){
+            ++stats.requests;
+            if(status == 429){
+                ++stats.rateLimited;
+            }
+            else if(status >= 400){
+                ++stats.failed;
+            }
+        });
+        authorizeClient(client, options, events, {});
+
+        if(!client.hasValidAccessToken()){
+            events.write("\"event\":\"error\",\"message\":\"authorization failed\"");
+            exitCode = 1;
+        }
+        else{
+            MetricsDumper dumper(client.metrics(), options.metricsPath);
+
+            // Tracks piped in: searches start before the producer is done
+            std::shared_ptr<TrackStream> input;
+            if(options.importPath == "-"){
+                input = std::make_shared<TrackStream>(client.executor());
+            }
+
+            // Ctrl+C stops the running pipeline: requests in flight finish,
+            // the import journal keeps what was liked
+            boost::asio::signal_set interrupt(GlobalIoService::instance(), SIGINT, SIGTERM);
+            interrupt.async_wait([&client, input](const boost::system::error_code& ec, int){
+                if(!ec){
+                    client.cancel();
+                    // Import may wait for a line that never comes
+                    if(input){
+                        input->close(false);
+                    }
+                }
+            });
+
+            if(!options.importPath.empty()){
+                stats.reset();
+                auto start = std::chrono::steady_clock::now();
+                bool imported;
+                {
+                    ProgressPrinter printer(events, client.progress(), "import");
+                    if(input){
+                        pipeStdin(input);
+                        imported = runSync(client, [&]{ return client.likeTracksFromStream(input); });
+                    }
+                    else{
+                        imported = runSync(client, [&]{ return client.likeTracksFromJson(options.importPath); });
+                    }
+                }
+                reportDone(events, "import", client.progress().done(),
+                           std::chrono::steady_clock::now() - start, stats);
+                if(!imported && !client.cancelled()){
+                    events.write("\"event\":\"error\",\"phase\":\"import\",\"message\":\"import is incomplete\"");
+                    exitCode = 1;
+                }
+            }
+
+            if(client.cancelled()){
+                events.write("\"event\":\"stopped\"");
+                exitCode = 130;
+            }
+            else if(options.remove > 0){
+                stats.reset();
+                auto start = std::chrono::steady_clock::now();
+                bool removed;
+                {
+                    ProgressPrinter printer(events, client.progress(), "remove");
+                    removed = runSync(client, [&]{ return client.removeLastN(options.remove); });
+                }
+                reportDone(events, "remove", client.progress().done(),
+                           std::chrono::steady_clock::now() - start, stats);
+                if(client.cancelled()){
+                    events.write("\"event\":\"stopped\"");
+                    exitCode = 130;
+                }
+                else if(!removed){
+                    events.write("\"event\":\"error\",\"phase\":\"remove\",\"message\":\"removal is incomplete\"");
+                    exitCode = 1;
+                }
+            }
+        }
+    }
+
+    Tracer::stop();
+    GlobalIoService::stop();
+    return exitCode;
+}
@@ -0,0 +1,193 @@
+// Converts track lists between JSON and the binary format (TrackList).
+//
+//   ExportLikesConvert <input> <output> [--no-keys] [--ids] [--search-cache <file>]
+//
+// JSON input (array or NDJSON) is written as a binary track list with
+// precomputed search keys (--no-keys leaves them out). --ids stores the
+// Spotify ids already found for the tracks in the search cache of the app,
+// or in the cache given with --search-cache; the import then skips their
+// searches. Binary input is written back as a JSON array, with "id" members
+// for the tracks whose id is stored.
+
+#include "TrackList.hpp"
+#include "TrackReader.hpp"
+#include "SearchCache.hpp"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QStandardPaths>
+#include <QString>
+#include <QtGlobal>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace {
+struct Options{
+    std::string input;
+    std::string output;
+    bool keys = true;
+    bool ids = false;
+    // Empty: the app's cache
+    std::string searchCachePath;
+};
+
+// Warnings only, on stderr
+void logHandler(QtMsgType type, const QMessageLogContext&, const QString& msg){
+    if(type == QtDebugMsg){
+        return;
+    }
+    std::fprintf(stderr, "%s\n", msg.toLocal8Bit().constData());
+}
+
+void usage(){
+    std::cerr << "Usage: ExportLikesConvert <input> <output> [--no-keys] [--ids]"
+                 " [--search-cache <file>]\n";
+}
+
+Options parseArgs(int argc, char* argv[]){
+    Options options;
+    for(int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        if(arg == "--no-keys"){
+            options.keys = false;
+        }
+        else if(arg == "--ids"){
+            options.ids = true;
+        }
+        else if(arg == "--search-cache" && i + 1 < argc){
+            options.ids = true;
+            options.searchCachePath = argv[++i];
+        }
+        else if(arg.rfind("--", 0) == 0){
+            std::cerr << "Unknown option " << arg << "\n";
+            usage();
+            std::exit(2);
+        }
+        else if(options.input.empty()){
+            options.input = arg;
+        }
+        else if(options.output.empty()){
+            options.output = arg;
+        }
+        else{
+            usage();
+            std::exit(2);
+        }
+    }
+    if(options.input.empty() || options.output.empty()){
+        usage();
+        std::exit(2);
+    }
+    return options;
+}
+
+void appendJsonString(std::string& out, std::string_view s){
+    out += '"';
+    for(unsigned char c : s){
+        switch(c){
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if(c < 0x20){
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            }
+            else{
+                out += char(c);
+            }
+        }
+    }
+    out += '"';
+}
+
+// Binary -> JSON array, one object per line
+std::size_t toJson(const Options& options){
+    TrackList list(options.input);
+    std::ofstream out(options.output, std::ios::binary | std::ios::trunc);
+    if(!out){
+        throw std::runtime_error("Unable to create " + options.output);
+    }
+    out << "[\n";
+    std::string line;
+    for(std::size_t i = 0; i < list.size(); ++i){
+        line = "  {\"artist\": ";
+        appendJsonString(line, list.artist(i));
+        line += ", \"title\": ";
+        appendJsonString(line, list.title(i));
+        auto id = list.id(i);
+        if(!id.empty()){
+            line += ", \"id\": ";
+            appendJsonString(line, id);
+        }
+        line += i + 1 < list.size() ? "},\n" : "}\n";
+        out << line;
+    }
+    out << "]\n";
+    if(!out.flush()){
+        throw std::runtime_error("Unable to write " + options.output);
+    }
+    return list.size();
+}
+
+// JSON -> binary, ids from the input or the search cache
+std::size_t toBinary(const Options& options){
+    std::unique_ptr<SearchCache> cache;
+    if(options.ids){
+        auto path = options.searchCachePath;
+        if(path.empty()){
+            QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+            path = (dataDir + "/search_cache.bin").toStdString();
+        }
+        cache = std::make_unique<SearchCache>(path);
+    }
+
+    TrackReader reader(options.input);
+    TrackListWriter writer;
+    TrackRecord rec;
+    while(reader.next(rec)){
+        if(cache && !isSpotifyId(rec.id)){
+            if(auto id = cache->find(trackKey(rec.artist, rec.title))){
+                rec.id = std::move(*id);
+            }
+        }
+        writer.add(rec.artist, rec.title, rec.id);
+    }
+    writer.write(options.output, options.keys);
+    std::cerr << writer.size() << " tracks, " << writer.artistCount() << " artists, "
+              << writer.idCount() << " known ids\n";
+    return writer.size();
+}
+}
+
+int main(int argc, char* argv[]){
+    QCoreApplication::setApplicationName("ExportLikes");
+    qInstallMessageHandler(logHandler);
+    auto options = parseArgs(argc, argv);
+
+    try{
+        auto start = std::chrono::steady_clock::now();
+        bool binary = TrackList::detect(options.input);
+        auto records = binary ? toJson(options) : toBinary(options);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cerr << (binary ? "Binary -> JSON: " : "JSON -> binary: ") << records << " tracks, "
+                  << std::filesystem::file_size(options.input) << " -> "
+                  << std::filesystem::file_size(options.output) << " bytes in "
+                  << elapsed.count() << " s\n";
+    }
+    catch(std::exception& e){
+        std::cerr << "Conversion failed: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <optional>
+#include <boost/asio.hpp>
+#include <boost/asio/awaitable.hpp>
+
+// Queue of suspended coroutines.
+// Each waiter sleeps on its own timer, notify cancels the timer
+class AsyncWaitQueue{
+public:
+    // Suspend until notifyOne/notifyAll
+    boost::asio::awaitable<void> wait();
+
+    // Same with a deadline. False if the deadline came first
+    boost::asio::awaitable<bool> waitUntil(std::chrono::steady_clock::time_point deadline);
+
+    // Wake the oldest waiter
+    void notifyOne();
+
+    // Wake every waiter
+    void notifyAll();
+
+    bool empty() const { return waiters_.empty(); }
+private:
+    struct Waiter{
+        boost::asio::steady_timer timer;
+        bool woken = false;
+    };
+    std::list<Waiter*> waiters_;
+};
+
+// Counting semaphore for coroutines
+class AsyncSemaphore{
+public:
+    explicit AsyncSemaphore(std::size_t permits);
+
+    // Take one permit, suspend while none are free
+    boost::asio::awaitable<void> acquire();
+
+    // Return one permit
+    void release();
+
+    std::size_t available() const { return permits_; }
+private:
+    std::size_t permits_;
+    AsyncWaitQueue waiters_;
+};
+
+// Counter of running child coroutines, wait() resumes when it drops to zero
+class AsyncWaitGroup{
+public:
+    void add(std::size_t n = 1) { count_ += n; }
+
+    void done();
+
+    boost::asio::awaitable<void> wait();
+
+    std::size_t count() const { return count_; }
+private:
+    std::size_t count_ = 0;
+    AsyncWaitQueue waiters_;
+};
+
+// Bounded FIFO between coroutines.
+// send() suspends while the channel is full (backpressure),
+// receive() suspends while it is empty
+template <typename T>
+class AsyncChannel{
+public:
+    explicit AsyncChannel(std::size_t capacity) : capacity_(capacity ? capacity : 1) {}
+
+    // False if the channel is closed, value is dropped then
+    boost::asio::awaitable<bool> send(T value){
+        while(items_.size() >= capacity_ && !closed_){
+            co_await senders_.wait();
+        }
+        if(closed_){
+            co_return false;
+        }
+        items_.push_back(std::move(value));
+        receivers_.notifyOne();
+        co_return true;
+    }
+
+    // std::nullopt when closed and drained
+    boost::asio::awaitable<std::optional<T>> receive(){
+        co_return co_await receiveUntil(std::chrono::steady_clock::time_point::max());
+    }
+
+    // std::nullopt when closed and drained or at deadline
+    boost::asio::awaitable<std::optional<T>> receiveUntil(
+        std::chrono::steady_clock::time_point deadline){
+        while(items_.empty()){
+            if(closed_){
+                co_return std::nullopt;
+            }
+            if(!co_await receivers_.waitUntil(deadline)){
+                co_return std::nullopt;
+            }
+        }
+        std::optional<T> value{std::move(items_.front())};
+        items_.pop_front();
+        senders_.notifyOne();
+        co_return value;
+    }
+
+    // No more sends; receivers get what is left, then std::nullopt
+    void close(){
+        closed_ = true;
+        senders_.notifyAll();
+        receivers_.notifyAll();
+    }
+
+    bool closed() const { return closed_; }
+    std::size_t size() const { return items_.size(); }
+private:
+    std::size_t capacity_;
+    bool closed_ = false;
+    std::deque<T> items_;
+    AsyncWaitQueue senders_;
+    AsyncWaitQueue receivers_;
+};
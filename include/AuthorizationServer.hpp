@@ -11,6 +11,10 @@ public:
 
     void shoutdown();
 
+    // Give up waiting for the redirect: asyncGetAuthorizationCode returns "".
+    // Call on the executor that runs asyncGetAuthorizationCode
+    void cancel();
+
     boost::asio::awaitable<std::string> asyncGetAuthorizationCode();
 private:
     unsigned short port_;
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// 64-bit FNV-1a: search cache keys, library snapshot, journal fingerprint.
+// Pass the result as hash to continue over more data
+constexpr std::uint64_t kFnv1aOffset = 14695981039346656037ull;
+
+inline std::uint64_t fnv1a(std::string_view data, std::uint64_t hash = kFnv1aOffset){
+    for(unsigned char c : data){
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
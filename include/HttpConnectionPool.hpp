@@ -0,0 +1,195 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/http.hpp>
+#include "AsyncPrimitives.hpp"
+
+// One keep-alive HTTP(S) connection to a single host
+struct HttpConnection{
+    // ssl_ctx == nullptr makes a plain TCP connection (local test servers)
+    HttpConnection(boost::asio::io_context& io_ctx,
+                   boost::asio::ssl::context* ssl_ctx,
+                   std::string host, std::string port);
+
+    // TCP layer of either stream
+    boost::beast::tcp_stream& socket(){
+        return tls ? boost::beast::get_lowest_layer(*tls) : *plain;
+    }
+
+    template <typename Request>
+    boost::asio::awaitable<void> write(Request& req){
+        using namespace boost::beast;
+        if(tls){
+            co_await http::async_write(*tls, req, boost::asio::use_awaitable);
+        }
+        else{
+            co_await http::async_write(*plain, req, boost::asio::use_awaitable);
+        }
+    }
+
+    // Response headers only, body follows with readBody
+    template <typename Parser>
+    boost::asio::awaitable<void> readHeader(Parser& parser){
+        using namespace boost::beast;
+        if(tls){
+            co_await http::async_read_header(*tls, buffer, parser, boost::asio::use_awaitable);
+        }
+        else{
+            co_await http::async_read_header(*plain, buffer, parser, boost::asio::use_awaitable);
+        }
+    }
+
+    template <typename Parser>
+    boost::asio::awaitable<void> readBody(Parser& parser){
+        using namespace boost::beast;
+        if(tls){
+            co_await http::async_read(*tls, buffer, parser, boost::asio::use_awaitable);
+        }
+        else{
+            co_await http::async_read(*plain, buffer, parser, boost::asio::use_awaitable);
+        }
+    }
+
+    // Exactly one of them is set
+    std::optional<boost::beast::ssl_stream<boost::beast::tcp_stream>> tls;
+    std::optional<boost::beast::tcp_stream> plain;
+    // Read buffer lives with the stream:
+    // bytes after one response belong to the next one
+    boost::beast::flat_buffer buffer;
+    std::string host;
+    std::string port;
+    bool useTls;
+    std::chrono::steady_clock::time_point lastUsed;
+    // Number of requests served over this connection
+    std::size_t requests = 0;
+
+    // Set by connect, taken by the first request for its metrics
+    struct SetupTimes{
+        std::chrono::steady_clock::duration dns{};
+        std::chrono::steady_clock::duration connect{};
+        std::chrono::steady_clock::duration tls{};
+    };
+    std::optional<SetupTimes> setupTimes;
+};
+
+class HttpConnectionPool{
+public:
+    struct Options{
+        // Connections (busy + idle) allowed per host
+        std::size_t maxPerHost = 16;
+        // Idle connections kept per host
+        std::size_t maxIdlePerHost = 16;
+        // Idle connections older than this are closed
+        std::chrono::seconds idleTimeout{30};
+        // Reconnect after this many requests on one connection
+        std::size_t maxRequestsPerConnection = 1000;
+        // How long resolved endpoints are reused
+        std::chrono::seconds dnsTtl{300};
+    };
+
+    // Borrowed connection. Returned to the pool by release(),
+    // closed if the lease dies without release()
+    class Lease{
+    public:
+        Lease() = default;
+        Lease(HttpConnectionPool* pool, std::unique_ptr<HttpConnection> conn);
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease();
+
+        HttpConnection& operator*() const { return *conn_; }
+        HttpConnection* operator->() const { return conn_.get(); }
+        explicit operator bool() const { return conn_ != nullptr; }
+
+        // Give connection back; keepAlive = false closes it
+        void release(bool keepAlive);
+    private:
+        HttpConnectionPool* pool_ = nullptr;
+        std::unique_ptr<HttpConnection> conn_;
+    };
+
+    explicit HttpConnectionPool(boost::asio::ssl::context& ssl_ctx);
+    HttpConnectionPool(boost::asio::ssl::context& ssl_ctx, Options options);
+    ~HttpConnectionPool();
+
+    // Get an idle live connection to host or open a new one.
+    // Waits while the host is at maxPerHost.
+    // Safe to call from any thread: bookkeeping runs on the pool strand,
+    // connect and handshake on the caller's executor
+    boost::asio::awaitable<Lease> acquire(const std::string& host, const std::string& port,
+                                          bool useTls = true);
+
+    // Close every idle connection
+    void closeIdle();
+
+    const Options& options() const { return options_; }
+
+    // Strand of the pool bookkeeping
+    boost::asio::any_io_executor executor() const { return strand_; }
+private:
+    // Result of the strand part of acquire
+    struct Reservation{
+        // Idle connection, or nullptr if a new one has to be opened
+        std::unique_ptr<HttpConnection> conn;
+        // Cached endpoints, empty if they have to be resolved
+        boost::asio::ip::tcp::resolver::results_type endpoints;
+    };
+
+    struct HostState{
+        // LIFO: the most recently used connection is the most likely alive
+        std::vector<std::unique_ptr<HttpConnection>> idle;
+        // Connections handed out or being opened
+        std::size_t busy = 0;
+        // Coroutines waiting for a free slot
+        AsyncWaitQueue waiters;
+
+        boost::asio::ip::tcp::resolver::results_type endpoints;
+        std::chrono::steady_clock::time_point resolvedAt;
+    };
+
+    // On strand: take an idle connection or a free slot for a new one
+    boost::asio::awaitable<Reservation> reserve(std::string key);
+
+    // On strand: slot reserved by reserve() was not used
+    void cancelReservation(const std::string& key);
+
+    // Resolve, connect and handshake
+    boost::asio::awaitable<std::unique_ptr<HttpConnection>> connect(
+        std::string key, boost::asio::ip::tcp::resolver::results_type endpoints,
+        const std::string& host, const std::string& port, bool useTls);
+
+    static std::string hostKey(const std::string& host, const std::string& port, bool useTls);
+
+    // Called by Lease from any thread
+    void giveBack(std::unique_ptr<HttpConnection> conn, bool keepAlive);
+
+    // On strand
+    void putBack(std::unique_ptr<HttpConnection> conn, bool keepAlive);
+
+    // Drop idle connections past idleTimeout
+    void evictIdle(HostState& state);
+
+    // Check that the server has not closed an idle connection
+    static bool isAlive(HttpConnection& conn);
+
+    static void close(HttpConnection& conn);
+
+    boost::asio::ssl::context& ssl_ctx_;
+    Options options_;
+    // Guards hosts_
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+    std::map<std::string, HostState> hosts_;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Append-only log of an import next to its input file, one per account:
+// progress of one account is never resumed by another.
+// Records search results by input position and how far likes are committed,
+// so an interrupted import resumes without repeating searches and PUTs.
+// Appends are buffered and synced at most once a second: a crash loses
+// only the last second of work, which is redone (likes are idempotent)
+class ImportJournal{
+public:
+    // account - Spotify user id of the import.
+    // resume = false starts a new journal over an old one
+    ImportJournal(const std::string& inputPath, const std::string& account, bool resume);
+    ~ImportJournal();
+
+    ImportJournal(const ImportJournal&) = delete;
+    ImportJournal& operator=(const ImportJournal&) = delete;
+
+    // <input>.<account hash>.journal: the user id may not be a valid file name
+    static std::string pathFor(const std::string& inputPath, const std::string& account);
+
+    // Input records before this position are liked or skipped
+    std::uint64_t committed() const { return committed_; }
+
+    // Search result of an earlier run: id, "" - not found, std::nullopt - unknown
+    std::optional<std::string> resolved(std::uint64_t position) const;
+
+    void recordResolved(std::uint64_t position, const std::string& id);
+
+    // Every input record before position is done
+    void recordCommitted(std::uint64_t position);
+
+    // Write buffered records, sync = also wait for the disk
+    void flush(bool sync);
+
+    // Import completed: journal is removed
+    void finish();
+
+    std::size_t resumedResults() const { return resolved_.size(); }
+private:
+    // On-disk record, native byte order
+    struct Record{
+        std::uint64_t position;
+        std::uint32_t kind;
+        std::uint32_t reserved;
+        // Spotify id (22 chars), zero padded; empty - not found
+        char id[24];
+    };
+
+    enum Kind : std::uint32_t{ Resolved = 1, Committed = 2 };
+
+    // Size and mtime of the input and the account:
+    // journal of another file or account is ignored
+    static std::uint64_t fingerprint(const std::string& inputPath, const std::string& account);
+
+    // False if there is no usable journal
+    bool load();
+
+    void append(const Record& rec);
+
+    std::string path_;
+    std::uint64_t fingerprint_ = 0;
+    std::FILE* file_ = nullptr;
+    std::uint64_t committed_ = 0;
+    std::unordered_map<std::uint64_t, std::string> resolved_;
+    std::vector<Record> pending_;
+    std::chrono::steady_clock::time_point lastSync_;
+};
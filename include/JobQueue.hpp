@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <boost/asio.hpp>
+#include <boost/asio/awaitable.hpp>
+#include "AsyncPrimitives.hpp"
+#include "RequestScheduler.hpp"
+
+class SpotifyClient;
+
+// Import and removal jobs of several accounts at once.
+// Every job brings its own authorized client; clients share one
+// SpotifyTransport, so jobs share its connections and rate budget by
+// their weights. Jobs of one client run one after another, jobs of
+// different clients side by side, at most maxRunning bulk jobs.
+// Interactive jobs start at once, past the limit and the queue, and
+// their requests go before those of bulk jobs.
+// Safe to use from any thread, state lives on its own strand
+class JobQueue{
+public:
+    enum class Kind{ Import, Remove };
+    // Failed: the import or removal is incomplete (see SpotifyClient)
+    enum class State{ Done, Failed, Cancelled };
+    using JobId = std::uint64_t;
+
+    struct Job{
+        Kind kind = Kind::Import;
+        std::shared_ptr<SpotifyClient> client;
+        // Input file of an import
+        std::string input;
+        // Tracks to remove
+        std::size_t count = 0;
+        double weight = 1.0;
+        RequestScheduler::Priority priority = RequestScheduler::Priority::Bulk;
+    };
+
+    // Called on the queue strand when a job ends or is dropped from the queue
+    using DoneHandler = std::function<void(JobId id, State state)>;
+
+    explicit JobQueue(std::size_t maxRunning = 4);
+    // Cancels every job and waits for the running ones.
+    // Never destroyed on an io thread
+    ~JobQueue();
+
+    void setDoneHandler(DoneHandler handler) { doneHandler_ = std::move(handler); }
+
+    // "done", "failed", "cancelled"
+    static const char* name(State state);
+
+    // Queue a job, it starts as soon as its client and a slot are free
+    JobId submit(Job job);
+
+    // Drop a queued job or stop a running one
+    void cancel(JobId id);
+
+    // Resume when nothing is queued or running
+    boost::asio::awaitable<void> waitIdle();
+private:
+    struct Entry{
+        JobId id;
+        Job job;
+    };
+
+    // On strand: start queued jobs that may run now
+    void startJobs();
+
+    // On strand
+    void start(Entry entry);
+
+    void finished(JobId id, State state);
+
+    std::size_t maxRunning_;
+    DoneHandler doneHandler_;
+    std::atomic<JobId> nextId_{1};
+
+    // Touched on strand_
+    std::deque<Entry> queued_;
+    // Running jobs by id
+    std::unordered_map<JobId, std::shared_ptr<SpotifyClient>> running_;
+    std::size_t runningBulk_ = 0;
+    AsyncWaitQueue idle_;
+
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+// Minimal JSON scanning over a raw byte range, without building a DOM.
+// Every function takes [p, end) and returns the position after
+// what it consumed, or nullptr on malformed input
+
+// Skip spaces, tabs and line breaks
+const char* jsonSkipWhitespace(const char* p, const char* end);
+
+// p points to the opening quote. Decodes escapes into out (UTF-8)
+const char* jsonParseString(const char* p, const char* end, std::string& out);
+
+// Skip a string without decoding it. p points to the opening quote
+const char* jsonSkipString(const char* p, const char* end);
+
+// Skip any value: string, number, literal, object or array
+const char* jsonSkipValue(const char* p, const char* end);
+
+// Parse an integer number (fraction and exponent are not accepted)
+const char* jsonParseInteger(const char* p, const char* end, long long& out);
+
+// On-demand lookup: p points to '{'. Returns the position of the value
+// of member key (whitespace skipped), nullptr if absent or malformed.
+// Other members are skipped without decoding
+const char* jsonFindMember(const char* p, const char* end, std::string_view key);
+
+// Same along a path of nested objects: {"a":{"b":...}} with {"a", "b"}
+const char* jsonFindPath(const char* p, const char* end,
+                         std::initializer_list<std::string_view> path);
+
+// Call f(value) for each element of the array at p ('[').
+// f returns the position after the value it was given (jsonSkipValue
+// if it does not consume it) or nullptr to stop.
+// Returns the position after ']', nullptr on malformed input or stop
+template <typename F>
+const char* jsonForEachElement(const char* p, const char* end, F&& f){
+    if(p >= end || *p != '['){
+        return nullptr;
+    }
+    p = jsonSkipWhitespace(p + 1, end);
+    if(p < end && *p == ']'){
+        return p + 1;
+    }
+    while(p && p < end){
+        p = f(p);
+        if(!p){
+            return nullptr;
+        }
+        p = jsonSkipWhitespace(p, end);
+        if(p == end){
+            return nullptr;
+        }
+        if(*p == ']'){
+            return p + 1;
+        }
+        if(*p != ','){
+            return nullptr;
+        }
+        p = jsonSkipWhitespace(p + 1, end);
+    }
+    return nullptr;
+}
+
+// String member of the object at p into out. False if absent or not a string
+bool jsonGetString(const char* p, const char* end, std::string_view key, std::string& out);
+
+// Integer member of the object at p. False if absent or not an integer
+bool jsonGetInteger(const char* p, const char* end, std::string_view key, long long& out);
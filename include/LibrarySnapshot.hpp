@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Set of track ids already in "Like library".
+// Ids are kept as sorted 64-bit hashes: 8 bytes per track,
+// a collision only skips one like
+class LibrarySnapshot{
+public:
+    void reserve(std::size_t n) { hashes_.reserve(n); }
+
+    void insert(const std::string& id);
+
+    // Sort after the last insert, before contains
+    void seal();
+
+    bool contains(const std::string& id) const;
+
+    std::size_t size() const { return hashes_.size(); }
+    bool empty() const { return hashes_.empty(); }
+private:
+    static std::uint64_t hash(const std::string& id);
+
+    std::vector<std::uint64_t> hashes_;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QFile>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+#include <vector>
+
+// Log lines for a QListView: the newest `capacity` lines in a ring buffer.
+// append() only queues the line, rows are inserted in one batch per frame.
+// Every line can also be spilled to a file, evicted ones included
+class LogModel : public QAbstractListModel{
+    Q_OBJECT
+public:
+    enum class Level{ Info, Error };
+
+    explicit LogModel(std::size_t capacity = 10000, QObject* parent = nullptr);
+    ~LogModel() override;
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+    // Text may hold several lines (process output chunks)
+    void append(const QString& text, Level level = Level::Info);
+
+    // Append every line to path, empty path stops spilling.
+    // A log already at path is moved to path + ".1" (one session back)
+    bool setSpillFile(const QString& path);
+
+    // Insert queued lines now
+    void flush();
+private:
+    struct Entry{
+        QString text;
+        Level level = Level::Info;
+    };
+
+    const Entry& at(int row) const;
+
+    // Append pending lines to the spill file
+    void writeSpill();
+
+    std::size_t capacity_;
+    // Ring buffer: row 0 is ring_[head_]
+    std::vector<Entry> ring_;
+    std::size_t head_ = 0;
+    std::size_t size_ = 0;
+
+    // Lines waiting for the next frame
+    QVector<Entry> pending_;
+    QTimer flushTimer_;
+
+    QFile spill_;
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <boost/beast/http/verb.hpp>
+
+// Latency histogram with HDR-style log-linear buckets: 16 sub-buckets per
+// power of two (about 6% precision) over microseconds.
+// record() is lock-free and wait-free, readers see a consistent-enough
+// snapshot while writers keep going
+class LatencyHistogram{
+public:
+    void record(std::chrono::steady_clock::duration elapsed);
+
+    std::uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    std::chrono::microseconds sum() const;
+    std::chrono::microseconds max() const;
+
+    // Upper bound of the bucket holding quantile q (0..1)
+    std::chrono::microseconds percentile(double q) const;
+private:
+    static constexpr std::size_t kSubBuckets = 16;
+    // Values up to 2^40 us (12 days)
+    static constexpr std::size_t kMaxBit = 40;
+    static constexpr std::size_t kBuckets = kSubBuckets * (kMaxBit - 2);
+
+    static std::size_t bucketOf(std::uint64_t micros);
+    static std::uint64_t bucketUpper(std::size_t bucket);
+
+    std::array<std::atomic<std::uint64_t>, kBuckets> buckets_{};
+    std::atomic<std::uint64_t> count_{0};
+    std::atomic<std::uint64_t> sumMicros_{0};
+    std::atomic<std::uint64_t> maxMicros_{0};
+};
+
+// Counters and stage histograms of every Spotify request, per endpoint.
+// Written from any io thread, dumped at any time
+class Metrics{
+public:
+    enum class Endpoint{ Search, SavedTracksGet, SavedTracksPut, SavedTracksDelete, Token, Other, Count };
+
+    enum class Stage{
+        // Waiting for the request scheduler
+        Queue,
+        // New connections only
+        Dns, Connect, Tls,
+        // Request written until response headers arrive
+        Ttfb,
+        // Headers until the whole body
+        Body,
+        // Field extraction from the body
+        Parse,
+        // sendRequest from start to response, retries included
+        Total,
+        Count
+    };
+
+    enum class Counter{
+        Requests,
+        // Responses with 429
+        RateLimited,
+        // Responses with 5xx
+        ServerErrors,
+        // Requests repeated after 429, a stale connection or a transient fault
+        Retries,
+        // Transient faults not repeated: attempts or retry budget ran out
+        RetriesDenied,
+        // Requests failed without a response
+        Failures,
+        ConnectionsOpened,
+        ConnectionsReused,
+        Count
+    };
+
+    // Endpoint of a method and target (query ignored)
+    static Endpoint classify(boost::beast::http::verb method, std::string_view target);
+
+    void record(Endpoint endpoint, Stage stage, std::chrono::steady_clock::duration elapsed){
+        slot(endpoint, stage).record(elapsed);
+    }
+
+    void add(Endpoint endpoint, Counter counter, std::uint64_t n = 1){
+        counters_[index(endpoint)][std::size_t(counter)].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::uint64_t value(Endpoint endpoint, Counter counter) const{
+        return counters_[index(endpoint)][std::size_t(counter)].load(std::memory_order_relaxed);
+    }
+
+    const LatencyHistogram& histogram(Endpoint endpoint, Stage stage) const{
+        return histograms_[index(endpoint)][std::size_t(stage)];
+    }
+
+    // Prometheus text exposition format: summaries and counters
+    std::string toPrometheus() const;
+
+    // Same data as one JSON object
+    std::string toJson() const;
+
+    // Write toJson() (.json) or toPrometheus() (anything else) atomically
+    bool writeFile(const std::string& path) const;
+
+    static const char* name(Endpoint endpoint);
+    static const char* name(Stage stage);
+    static const char* name(Counter counter);
+private:
+    static constexpr std::size_t kEndpoints = std::size_t(Endpoint::Count);
+    static constexpr std::size_t kStages = std::size_t(Stage::Count);
+    static constexpr std::size_t kCounters = std::size_t(Counter::Count);
+
+    static std::size_t index(Endpoint endpoint) { return std::size_t(endpoint); }
+
+    LatencyHistogram& slot(Endpoint endpoint, Stage stage){
+        return histograms_[index(endpoint)][std::size_t(stage)];
+    }
+
+    std::array<std::array<LatencyHistogram, kStages>, kEndpoints> histograms_;
+    std::array<std::array<std::atomic<std::uint64_t>, kCounters>, kEndpoints> counters_{};
+};
+
+// Records the time from construction to destruction as one stage
+class StageTimer{
+public:
+    StageTimer(Metrics& metrics, Metrics::Endpoint endpoint, Metrics::Stage stage) :
+        metrics_(metrics)
+        , endpoint_(endpoint)
+        , stage_(stage)
+        , start_(std::chrono::steady_clock::now())
+    {}
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    ~StageTimer(){
+        metrics_.record(endpoint_, stage_, std::chrono::steady_clock::now() - start_);
+    }
+private:
+    Metrics& metrics_;
+    Metrics::Endpoint endpoint_;
+    Metrics::Stage stage_;
+    std::chrono::steady_clock::time_point start_;
+};
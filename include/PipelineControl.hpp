@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <boost/asio/awaitable.hpp>
+
+// Stop and pause switches of a running pipeline, flipped from any thread
+// (GUI) and checked by the pipeline at each of its await points.
+// Cooperative: requests already on the wire finish (bounded by the
+// request timeout), nothing new starts after cancel()
+class PipelineControl{
+public:
+    void cancel() { state_.store(Cancelled, std::memory_order_release); }
+
+    // No effect on a cancelled pipeline
+    void pause(){
+        int expected = Running;
+        state_.compare_exchange_strong(expected, Paused, std::memory_order_acq_rel);
+    }
+
+    void resume(){
+        int expected = Paused;
+        state_.compare_exchange_strong(expected, Running, std::memory_order_acq_rel);
+    }
+
+    // New run: neither paused nor cancelled
+    void reset() { state_.store(Running, std::memory_order_release); }
+
+    bool cancelled() const { return state_.load(std::memory_order_acquire) == Cancelled; }
+    bool paused() const { return state_.load(std::memory_order_acquire) == Paused; }
+
+    // Suspend while paused. False once cancelled, true to go on
+    boost::asio::awaitable<bool> proceed() const;
+private:
+    enum{ Running, Paused, Cancelled };
+    std::atomic<int> state_{Running};
+};
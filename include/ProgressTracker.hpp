@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+// Progress of the running pipeline. Workers only bump a relaxed counter,
+// readers sample it at their own pace (GUI frame timer, CLI printer)
+class ProgressTracker{
+public:
+    // New run with total items, resets the counter
+    void start(std::uint64_t total);
+
+    // Total found out later (e.g. after listing)
+    void setTotal(std::uint64_t total) { total_.store(total, std::memory_order_relaxed); }
+
+    void advance(std::uint64_t n = 1) { done_.fetch_add(n, std::memory_order_relaxed); }
+
+    void finish() { running_.store(false, std::memory_order_release); }
+
+    std::uint64_t done() const { return done_.load(std::memory_order_relaxed); }
+    std::uint64_t total() const { return total_.load(std::memory_order_relaxed); }
+    bool running() const { return running_.load(std::memory_order_acquire); }
+
+    // Incremented by start(): samplers see a new run
+    std::uint32_t run() const { return run_.load(std::memory_order_acquire); }
+
+    std::chrono::steady_clock::time_point startedAt() const{
+        return std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(startedAt_.load(std::memory_order_relaxed)));
+    }
+private:
+    std::atomic<std::uint64_t> done_{0};
+    std::atomic<std::uint64_t> total_{0};
+    std::atomic<std::int64_t> startedAt_{0};
+    std::atomic<std::uint32_t> run_{0};
+    std::atomic<bool> running_{false};
+};
+
+struct ProgressSnapshot{
+    std::uint64_t done = 0;
+    std::uint64_t total = 0;
+    // Items per second, smoothed
+    double rate = 0.0;
+    // Time left at the current rate, std::nullopt until it is known
+    std::optional<std::chrono::seconds> eta;
+    std::chrono::duration<double> elapsed{0};
+    bool running = false;
+};
+
+// Reads a tracker from one thread; rate is an exponential moving average
+// over the sampling intervals (5 s time constant)
+class ProgressSampler{
+public:
+    explicit ProgressSampler(const ProgressTracker& tracker) : tracker_(tracker) {}
+
+    ProgressSnapshot sample();
+private:
+    const ProgressTracker& tracker_;
+    std::uint32_t run_ = 0;
+    std::uint64_t lastDone_ = 0;
+    std::chrono::steady_clock::time_point lastAt_;
+    double rate_ = 0.0;
+};
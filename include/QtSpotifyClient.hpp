@@ -5,10 +5,14 @@
 #include <boost/asio/awaitable.hpp>
 #include <boost/asio.hpp>
 #include <QPointer>
+#include <atomic>
+#include <memory>
 
 
 class SpotifyClient;
 class AuthorizationServer;
+class ProgressTracker;
+class TrackStream;
 
 class QtSpotifyClient : public QObject{
     Q_OBJECT
@@ -17,17 +21,28 @@ public:
     ~QtSpotifyClient() override;
     QString getClientId() const {return clientId_; }
     QString getRedirectUri() const {return redirectUri_; }
+    // Progress of the running pipeline, sampled from the GUI thread
+    const ProgressTracker& progress() const;
+    // Stream to be fed by the exporter process and passed to addTracksFromStream
+    std::shared_ptr<TrackStream> createTrackStream() const;
 public slots:
     void authorization();
     void setClientId(const QString& id);
     void setRedirectUri(const QString& uri);
     void loadLocalJson(const QString& path);
     void addTracks();
+    // Import records while they arrive, finishedAdding is emitted
+    // after the stream is closed and drained
+    void addTracksFromStream(std::shared_ptr<TrackStream> stream);
     void removeLastNTracks(const std::size_t n);
+    // Stop the running pipeline (or the wait for authorization),
+    // finished* is emitted with false once it has wound down
+    void stop();
+    void pause();
+    void resume();
 signals:
     void reauthorization();
     void logMessage(const QString& msg);
-    void progress(int current, int total);
     void finishedAdding(bool success);
     void finishedRemoving(bool success);
     void finishedAuthorization(bool success);
@@ -40,12 +55,22 @@ private:
         }
     }
 
-    boost::asio::awaitable<void> runAsyncAddingPipeline();
+    // Refresh an expired token before a pipeline. False if there is no
+    // valid token: the pipeline must not run, browser authorization
+    // is started when the refresh failed
+    boost::asio::awaitable<bool> renewAccessToken();
+
+    // Start the import of the stream, or of jsonPath_ without one
+    void startAdding(std::shared_ptr<TrackStream> stream);
+
+    boost::asio::awaitable<void> runAsyncAddingPipeline(std::shared_ptr<TrackStream> stream);
     boost::asio::awaitable<void> runAsyncRemovingPipeline(const std::size_t n);
 
     QString clientId_ = QString("3b19f004deee439b89f3245afb8b84ed");
     QString redirectUri_ = "http://127.0.0.1:8888/callback";
     QString jsonPath_;
+    // Stop came before the pipeline started, set from the GUI thread
+    std::atomic<bool> stopRequested_{false};
     //QString authorizationCode_;
 
     std::unique_ptr<SpotifyClient> sp_client_;
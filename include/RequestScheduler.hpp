@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <boost/asio.hpp>
+#include <boost/asio/awaitable.hpp>
+#include "AsyncPrimitives.hpp"
+#include "PipelineControl.hpp"
+
+// Shared gate for every request to the Web API.
+// Pauses all lanes after 429 for Retry-After seconds and
+// adapts the number of requests in flight: +1 after a window of
+// successes, halved on rate limit (AIMD).
+// Free slots are shared between flows (one per job): interactive flows
+// first, flows of a class in proportion to their weights (start-time
+// fair queueing). A request holds its connection only while it holds
+// its slot, so connections are shared the same way.
+// Safe to use from any thread, state lives on its own strand
+class RequestScheduler{
+public:
+    // Interactive flows (a small removal the user waits for) get every
+    // free slot before any bulk flow
+    enum class Priority{ Bulk, Interactive };
+
+    using FlowId = std::uint64_t;
+    // Flow of requests that name none
+    static constexpr FlowId kDefaultFlow = 0;
+
+    struct Options{
+        std::size_t minConcurrency = 1;
+        std::size_t maxConcurrency = 16;
+        std::size_t initialConcurrency = 8;
+        // Pause used when 429 comes without Retry-After
+        std::chrono::seconds defaultRetryAfter{1};
+        // Attempts of one request rejected with 429
+        int maxAttempts = 8;
+    };
+
+    // Permission to send one request, returns the slot on destruction
+    class Ticket{
+    public:
+        Ticket() = default;
+        explicit Ticket(RequestScheduler* owner) : owner_(owner) {}
+        // Empty ticket: the flow was stopped while it waited
+        explicit operator bool() const { return owner_ != nullptr; }
+        Ticket(Ticket&& other) noexcept : owner_(std::exchange(other.owner_, nullptr)) {}
+        Ticket& operator=(Ticket&& other) noexcept;
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+        ~Ticket();
+    private:
+        RequestScheduler* owner_ = nullptr;
+    };
+
+    RequestScheduler();
+    explicit RequestScheduler(Options options);
+    RequestScheduler(boost::asio::io_context& io, Options options);
+
+    // New flow, usable at once. Requests of a flow whose control is
+    // cancelled leave the queue with an empty ticket
+    FlowId addFlow(double weight = 1.0, Priority priority = Priority::Bulk,
+                   const PipelineControl* control = nullptr);
+
+    // Change the share of a flow, applies to its next requests
+    void setFlowShare(FlowId flow, double weight, Priority priority);
+
+    // Forget a flow that has nothing waiting
+    void removeFlow(FlowId flow);
+
+    // Wake the waiting requests of a flow, also during a Retry-After
+    // pause, to look at its control again (after a stop)
+    void interrupt(FlowId flow);
+
+    // Wait until no pause is active and a slot is free for the flow.
+    // Empty ticket if the control of the flow is cancelled
+    boost::asio::awaitable<Ticket> acquire(FlowId flow = kDefaultFlow);
+
+    // Request finished without 429
+    void onSuccess();
+
+    // Request rejected with 429, retryAfter from the response
+    void onRateLimited(std::chrono::seconds retryAfter);
+
+    std::size_t limit() const { return limit_; }
+    std::size_t inFlight() const { return inFlight_; }
+    const Options& options() const { return options_; }
+
+    // Strand of the scheduler state
+    boost::asio::any_io_executor executor() const { return strand_; }
+private:
+    struct Flow{
+        double weight = 1.0;
+        Priority priority = Priority::Bulk;
+        // Virtual start time of its next request
+        double tag = 0.0;
+        std::size_t waiting = 0;
+        // Waiting for a slot
+        AsyncWaitQueue waiters;
+        // Sleeping out a Retry-After pause
+        AsyncWaitQueue paused;
+        // Stop switch of the pipeline sending on the flow, may be null
+        const PipelineControl* control = nullptr;
+    };
+
+    // On strand
+    boost::asio::awaitable<Ticket> waitSlot(FlowId id);
+
+    // On strand: waiting flow the next free slot belongs to, nullptr if none
+    Flow* nextFlow();
+
+    // On strand: wake a waiter of nextFlow()
+    void wakeNext();
+
+    void release();
+
+    Options options_;
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+    // Written on strand, readable anywhere
+    std::atomic<std::size_t> limit_;
+    std::atomic<std::size_t> inFlight_ = 0;
+    // Successes since the last increase
+    std::size_t successes_ = 0;
+    std::chrono::steady_clock::time_point pausedUntil_{};
+    // Flows by id, node-based: references stay valid
+    std::unordered_map<FlowId, Flow> flows_;
+    // Tag of the last granted request
+    double virtualTime_ = 0.0;
+    std::atomic<FlowId> nextFlowId_{kDefaultFlow + 1};
+};
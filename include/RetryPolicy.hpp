@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <boost/beast/http/verb.hpp>
+#include <boost/system/error_code.hpp>
+
+// When a failed Web API request is sent again.
+// Only idempotent requests are repeated (GET search, PUT/DELETE of ids):
+// a lost response of a POST may hide a request that was processed.
+// Transient faults (reset or refused connection, timeout, 5xx) are
+// retried after capped exponential backoff with full jitter, so lanes
+// that failed together do not come back together.
+// Retries draw from a budget refilled by a fraction of the requests:
+// under a real outage requests fail fast instead of multiplying the load.
+// 429 and 401 are not handled here (RequestScheduler, token refresh).
+// Safe to use from any thread
+class RetryPolicy{
+public:
+    struct Options{
+        // Attempts of one request, the first one included
+        int maxAttempts = 5;
+        std::chrono::milliseconds baseDelay{200};
+        std::chrono::milliseconds maxDelay{10000};
+        // Retries allowed per request sent
+        double budgetRatio = 0.1;
+        // Retries available before any request was sent, and the budget cap
+        double budgetMin = 10.0;
+        double budgetMax = 100.0;
+    };
+
+    // Requests with no side effects beyond their first success
+    enum class Idempotency{ Idempotent, NotIdempotent };
+
+    RetryPolicy();
+    explicit RetryPolicy(Options options);
+
+    static Idempotency classify(boost::beast::http::verb method);
+
+    // Connection level faults worth another attempt
+    static bool transient(const boost::system::error_code& ec);
+
+    // Responses worth another attempt: 500, 502, 503, 504
+    static bool transient(unsigned status);
+
+    // Count a request sent: refills the budget
+    void onRequest();
+
+    // Whether attempt (1 = first) of an idempotent request may be
+    // followed by another. Takes one retry from the budget
+    bool allowRetry(int attempt);
+
+    // Pause before attempt + 1: uniform in [0, min(maxDelay, baseDelay * 2^(attempt - 1))]
+    std::chrono::milliseconds backoff(int attempt) const;
+
+    const Options& options() const { return options_; }
+private:
+    Options options_;
+    // Budget in thousandths of a retry
+    std::atomic<std::int64_t> budget_;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Normalize artist or title for matching:
+// case folding, NFKC, punctuation and extra spaces removed
+std::string normalizeTrackText(const std::string& text);
+
+// 64-bit key of normalized (artist, title)
+std::uint64_t trackKey(const std::string& artist, const std::string& title);
+
+// trackKey in two steps, the artist part is shared by all its titles:
+// trackKey(a, t) == trackKeyOfTitle(artistKeyPrefix(a), t)
+std::uint64_t artistKeyPrefix(const std::string& artist);
+std::uint64_t trackKeyOfTitle(std::uint64_t artistPrefix, const std::string& title);
+
+// Bumped when normalization or hashing changes: stored keys become stale
+constexpr std::uint32_t kTrackKeyVersion = 1;
+
+// Persistent map (artist, title) -> spotify id.
+// File is an append-only log of fixed-size records, memory-mapped on load.
+// "Not found" answers are stored too and expire after negativeTtl.
+// Keys of another kTrackKeyVersion are dropped on load.
+// A file that is not a search cache is never written to.
+// Safe to use from several threads: clients of a transport share one
+class SearchCache{
+public:
+    explicit SearchCache(std::string path,
+                         std::chrono::seconds negativeTtl = std::chrono::hours(24 * 7));
+    ~SearchCache();
+
+    SearchCache(const SearchCache&) = delete;
+    SearchCache& operator=(const SearchCache&) = delete;
+
+    // std::nullopt - unknown, "" - known to be absent on Spotify
+    std::optional<std::string> find(std::uint64_t key) const;
+
+    // Remember search result, "" for "not found"
+    void store(std::uint64_t key, const std::string& id);
+
+    // Append pending records to the file
+    void flush();
+
+    std::size_t size() const;
+    const std::string& path() const { return path_; }
+private:
+    // On-disk record, native byte order
+    struct Record{
+        std::uint64_t key;
+        // Seconds since epoch
+        std::int64_t storedAt;
+        // Spotify id (22 chars), zero padded; empty - not found
+        char id[24];
+    };
+
+    struct Entry{
+        std::string id;
+        std::int64_t storedAt;
+    };
+
+    void load();
+
+    // flush with mutex_ held
+    void appendPending();
+
+    // Rewrite file with live records only, false if it was not replaced
+    bool compact();
+
+    mutable std::mutex mutex_;
+    std::string path_;
+    std::chrono::seconds negativeTtl_;
+    std::unordered_map<std::uint64_t, Entry> entries_;
+    std::vector<Record> pending_;
+    // Records in file, including overwritten ones
+    std::size_t recordsOnDisk_ = 0;
+    // Path holds something else or could not be read: keep it as it is
+    bool readOnly_ = false;
+    // File is of an old format or key version: next flush replaces it
+    bool rewrite_ = false;
+};
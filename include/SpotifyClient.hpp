@@ -3,43 +3,163 @@
 #include <string>
 #include <chrono>
 #include <vector>
+#include <algorithm>
+#include <memory>
+#include <optional>
 #include <functional>
+#include <mutex>
+#include <unordered_map>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/asio/awaitable.hpp>
+#include <boost/beast/http.hpp>
 #include "SpotifyIoService.hpp"
+#include "SpotifyTransport.hpp"
+#include "AsyncPrimitives.hpp"
+#include "SearchCache.hpp"
+#include "LibrarySnapshot.hpp"
+#include "ImportJournal.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+#include "ProgressTracker.hpp"
+#include "PipelineControl.hpp"
 
+struct TrackRecord;
+class TrackStream;
+
+// Where SpotifyClient sends requests.
+// Defaults are the real Spotify services
+struct SpotifyEndpoints{
+    std::string apiHost = "api.spotify.com";
+    std::string apiPort = "443";
+    std::string accountsHost = "accounts.spotify.com";
+    std::string accountsPort = "443";
+    // Plain HTTP is only meant for local stand-ins
+    bool useTls = true;
+};
 
 class SpotifyClient{
 public:
+    // Called after every Web API request with its status and duration.
+    // Runs on io threads, possibly several at once
+    using RequestObserver = std::function<void(boost::beast::http::verb method,
+                                               std::chrono::steady_clock::duration elapsed,
+                                               unsigned status)>;
+
     // Constuctor
     explicit SpotifyClient();
+    // Client of one account on a transport shared with other clients
+    explicit SpotifyClient(std::shared_ptr<SpotifyTransport> transport);
     ~SpotifyClient();
     // Authorize - generate Authorize url
     std::string authorize();
 
+    // Strand that owns import/remove state (search cache, results, batches).
+    // Coroutines below are to be spawned on it; searches and TLS
+    // still run on every io thread
+    boost::asio::any_io_executor executor() const { return strand_; }
+
     // Generate token
     boost::asio::awaitable<void> fetchTokens(std::string code);
 
-    // Read json, use searchTrack to get tracks' ids
-    // Then send ids to addTracksToLibrary in batches
-    boost::asio::awaitable<void> likeTracksFromJson(const std::string& jsonPath,
-                                                    std::function<void(int, int)> progressCb);
+    // Spotify id of the logged in user, GET /v1/me once per login.
+    // std::nullopt if the request failed
+    boost::asio::awaitable<std::optional<std::string>> fetchUserId();
+
+    // New access token from the refresh token, without the browser.
+    // False if there is no refresh token or Spotify rejected it.
+    // Concurrent calls share one request
+    boost::asio::awaitable<bool> refreshAccessToken();
+
+    // Read json (or a binary track list, see TrackList), use searchTrack
+    // to get tracks' ids. Ids stored in the input skip the search.
+    // Then send ids to addTracksToLibrary in batches.
+    // Processed input records are counted in progress().
+    // False if the import was stopped or is incomplete (see importTracks)
+    boost::asio::awaitable<bool> likeTracksFromJson(const std::string& jsonPath);
+
+    // Same pipeline over records that are still arriving (exporter pipe):
+    // searches start while the producer runs. Stream is read on executor().
+    // There is no journal, the search cache keeps a rerun cheap.
+    // False as above, or if the stream was closed before its end
+    boost::asio::awaitable<bool> likeTracksFromStream(std::shared_ptr<TrackStream> stream);
 
     // Remove last N tracks from "Like library"
-    // Get last N track from library and send them to sendRemoveReq
-    boost::asio::awaitable<void> removeLastN(std::size_t n,
-                                             std::function<void(int, int)> progressCb);
+    // List last N tracks with parallel paged GETs, then remove them
+    // with parallel DELETEs of 50 (searchConcurrency_ requests in flight).
+    // Removed tracks are counted in progress().
+    // False if it was stopped, listing failed or some DELETE failed
+    boost::asio::awaitable<bool> removeLastN(std::size_t n);
+
+    // Progress of the running import or removal, to be sampled by the caller
+    const ProgressTracker& progress() const { return progress_; }
+
+    // Stop the running import or removal: nothing new is sent, lanes end
+    // at their next request or Retry-After pause, the journal keeps what
+    // was liked and idle connections are closed. Stays in force until
+    // reset(). Safe to call from any thread
+    void cancel(){
+        control_.cancel();
+        scheduler_.interrupt(flow_);
+    }
+
+    // Clear the stop or pause of an earlier pipeline. Called by the owner
+    // before it starts the next one, not by the pipeline: a stop that
+    // comes in between still ends it. Safe to call from any thread
+    void reset() { control_.reset(); }
+
+    // Hold the running pipeline before its next request / go on.
+    // Safe to call from any thread
+    void pause() { control_.pause(); }
+    void resume() { control_.resume(); }
+    bool paused() const { return control_.paused(); }
+    bool cancelled() const { return control_.cancelled(); }
 
     // Check the validity of access token
     bool hasValidAccessToken() const;
 
+    // Session can be renewed with refreshAccessToken()
+    bool hasRefreshToken() const;
+
     // Setter clientId_
     void setClientId(std::string id){ clientId_ = id; }
 
     // Setter redirectUri
     void setRedirectUri(std::string uri) { redirectUri_ = uri; }
 
+    // Point the client to other hosts (mock server, proxy)
+    void setEndpoints(SpotifyEndpoints endpoints) { endpoints_ = std::move(endpoints); }
+
+    // Setter for request observer (benchmarks)
+    void setRequestObserver(RequestObserver observer) { requestObserver_ = std::move(observer); }
+
+    // Per-endpoint stage latencies and counters of every request so far,
+    // of all clients on the transport
+    const Metrics& metrics() const { return metrics_; }
+
+    // Share of the transport rate budget: weight against other clients,
+    // interactive clients are served first
+    void setSchedulingShare(double weight,
+                            RequestScheduler::Priority priority = RequestScheduler::Priority::Bulk){
+        scheduler_.setFlowShare(flow_, weight, priority);
+    }
+
+    // Setter for number of searches in flight during import
+    void setSearchConcurrency(std::size_t n) { searchConcurrency_ = std::max<std::size_t>(n, 1); }
+
+    // Setter for the longest time a partial batch of likes waits for more ids
+    void setLikeBatchWindow(std::chrono::milliseconds window) { likeBatchWindow_ = window; }
+
+    // Continue an interrupted import from its journal (<input>.journal)
+    // instead of starting over
+    void setResumeImports(bool resume) { resumeImports_ = resume; }
+
+    // Fetch the library before import and skip tracks already in it
+    void setSkipLiked(bool skip) { skipLiked_ = skip; }
+
+    // Search cache of the transport at path, empty path turns it off
+    void setSearchCachePath(const std::string& path);
+
     // Setter authorizeCode
     void setAuthorizationCode(std::string code) { authorizationCode_ = code; }
 
@@ -47,25 +167,121 @@ public:
     std::string getAuthorizationCode() { return authorizationCode_; }
 
     // Getter access token
-    std::string getAccessToken() { return accessToken_; }
+    std::string getAccessToken() const;
 private:
+    using Request = boost::beast::http::request<boost::beast::http::string_body>;
+    using Response = boost::beast::http::response<boost::beast::http::string_body>;
+
+    enum class Service{ Api, Accounts };
+
+    // Send one request over a pooled keep-alive connection.
+    // Requests to the Web API carry the access token and go through
+    // the scheduler: 429 is retried after Retry-After
+    boost::asio::awaitable<Response> sendRequest(Service service,
+                                                 boost::beast::http::verb method,
+                                                 const std::string& target,
+                                                 std::string body = {},
+                                                 const char* contentType = nullptr);
+
+    // POST form body to /api/token and store the tokens, false on failure.
+    // A rejected refresh token is forgotten
+    boost::asio::awaitable<bool> requestTokens(std::string body, bool refresh);
+
+    // On strand_: refresh unless the token of generation was replaced already.
+    // Callers during a refresh wait for it
+    boost::asio::awaitable<bool> refreshOnStrand(std::uint64_t generation);
+
+    // On strand_: refresh shortly before the token expires, until destruction
+    boost::asio::awaitable<void> tokenRefreshLoop();
+
+    // On strand_: start tokenRefreshLoop or let it see the new expiry
+    void startTokenRefresh();
+
+    // Write request and read response on a pooled connection.
+    // Spans are nested under traceLane
+    boost::asio::awaitable<Response> roundTrip(const std::string& host, const std::string& port,
+                                               const Request& req, Metrics::Endpoint endpoint,
+                                               std::uint64_t traceLane);
+
     // Send DELETE-request to spotify
-    // to remove tracks "Like library" by their ids
-    boost::asio::awaitable<void> sendRemoveReq(const std::vector<std::string>& ids);
+    // to remove tracks "Like library" by their ids, false if they were not removed
+    boost::asio::awaitable<bool> sendRemoveReq(const std::vector<std::string>& ids);
+
+    // One page of "Like library", newest first
+    struct SavedPage{
+        std::vector<std::string> ids;
+        // Size of the whole library
+        std::size_t total = 0;
+    };
+
+    // GET /v1/me/tracks page, std::nullopt if the request failed
+    boost::asio::awaitable<std::optional<SavedPage>> fetchSavedPage(std::size_t offset,
+                                                                    std::size_t limit);
+
+    // Ids of the newest n liked tracks in pages of 50, pages fetched in parallel.
+    // std::nullopt if any page failed
+    boost::asio::awaitable<std::optional<std::vector<std::vector<std::string>>>>
+    listSavedPages(std::size_t n);
+
+    // Every liked track, std::nullopt if listing failed
+    boost::asio::awaitable<std::optional<LibrarySnapshot>> fetchLibrarySnapshot();
 
-    // "Like" batch of tracks by their ids
-    boost::asio::awaitable<void> addTracksToLibrary(const std::vector<std::string>& trackIds);
+    // Found id on its way to the like stage
+    struct QueuedLike{
+        // Input records before this are done once the id is saved:
+        // past its record, never past a failed search
+        std::uint64_t commitTo;
+        std::string id;
+    };
+
+    // Next input record into the argument, false at the end of input
+    using RecordSource = std::function<boost::asio::awaitable<bool>(TrackRecord&)>;
+
+    // Search and like stages of an import. journal may be null.
+    // False if it was stopped, the input is malformed or a batch failed;
+    // lanes and the like stage have finished either way
+    boost::asio::awaitable<bool> importTracks(RecordSource next,
+                                              std::shared_ptr<ImportJournal> journal);
+
+    // Like stage of import: collect ids from the channel into batches of 50,
+    // batch is sent when full or when likeBatchWindow_ expires.
+    // Committed batches are recorded in the journal. False if a batch failed
+    boost::asio::awaitable<bool> likeBatches(AsyncChannel<QueuedLike>& ids,
+                                             ImportJournal* journal);
+
+    // "Like" batch of tracks by their ids, false if Spotify did not save them
+    boost::asio::awaitable<bool> addTracksToLibrary(const std::vector<std::string>& trackIds);
 
     // Search one track by artist and title
-    // Return its spotify-id
-    boost::asio::awaitable<std::string> searchTrack(
+    // Return its spotify-id, "" if Spotify has no such track,
+    // std::nullopt if the search failed
+    boost::asio::awaitable<std::optional<std::string>> searchTrack(
         const std::string& artist, const std::string& title);
 
+    // Search on a lane of its own, done(id) is called on strand_.
+    // Identical searches in flight share one request. Call on strand_
+    void searchShared(std::string artist, std::string title, std::uint64_t key,
+                      std::function<void(std::optional<std::string>)> done);
+
+    // Close idle connections after a stop, unless other clients use them
+    void releaseConnections();
+
     // Encode string to URL-safety string
     std::string encodeURL(const std::string& val);
 
-    boost::asio::ip::tcp::resolver resolver_;
-    boost::asio::ssl::context ssl_ctx_;
+    SpotifyEndpoints endpoints_;
+    RequestObserver requestObserver_;
+    ProgressTracker progress_;
+    // Stop/pause of likeTracksFromJson and removeLastN, see reset()
+    PipelineControl control_;
+
+    std::shared_ptr<SpotifyTransport> transport_;
+    HttpConnectionPool& pool_;
+    RequestScheduler& scheduler_;
+    RetryPolicy& retry_;
+    Metrics& metrics_;
+    // Requests of this client in scheduler_
+    RequestScheduler::FlowId flow_;
 
     std::string codeVerifier_;
     std::string clientId_;
@@ -73,7 +289,39 @@ private:
 
     std::string authorizationCode_;
 
+    // Token is read by search lanes on any io thread
+    mutable std::mutex tokenMutex_;
     std::string accessToken_;
+    // "Bearer <token>", built when the token changes
+    std::string authorizationHeader_;
     std::string refreshToken_;
     std::chrono::steady_clock::time_point tokenExpiry_;
+    // When the background loop refreshes the token
+    std::chrono::steady_clock::time_point tokenRefreshDue_;
+    // Incremented with every new access token
+    std::uint64_t tokenGeneration_ = 0;
+    // Spotify id of the logged in user, cleared by a new login
+    std::string userId_;
+
+    // Token refresh state, touched on strand_
+    bool refreshing_ = false;
+    AsyncWaitQueue refreshDone_;
+    // Wakes tokenRefreshLoop early: new token or shutdown
+    AsyncWaitQueue refreshWake_;
+    bool refreshLoopRunning_ = false;
+    bool stopping_ = false;
+    // Pipelines, lanes and the refresh loop that use this client,
+    // touched on strand_. The destructor waits for it to drop to zero
+    AsyncWaitGroup running_;
+
+    std::size_t searchConcurrency_ = 16;
+    std::chrono::milliseconds likeBatchWindow_{2000};
+    bool skipLiked_ = true;
+    bool resumeImports_ = true;
+    std::shared_ptr<SearchCache> searchCache_;
+    // Waiters of searches in flight by track key, touched on strand_
+    std::unordered_map<std::uint64_t,
+                       std::vector<std::function<void(std::optional<std::string>)>>> searchFlights_;
+
+    boost::asio::strand<boost::asio::io_context::executor_type> strand_;
 };
@@ -1,18 +1,27 @@
 #pragma once
 
 #include <boost/asio.hpp>
+#include <cstddef>
 #include <memory>
 
+// io_context shared by every client, run by a pool of threads.
+// Objects used from several coroutines are guarded by strands
 class GlobalIoService {
 public:
     static boost::asio::io_context& instance();
     static void start();
     static void stop();
 
+    // Number of io threads, takes effect on the next start.
+    // 0 means hardware concurrency (at most 4)
+    static void setThreadCount(std::size_t n);
+    static std::size_t threadCount();
+
 private:
     GlobalIoService() = delete;
     ~GlobalIoService() = delete;
 
     struct Impl;
     static std::unique_ptr<Impl> impl_;
+    static std::size_t threadCount_;
 };
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <boost/asio/ssl.hpp>
+#include "HttpConnectionPool.hpp"
+#include "RequestScheduler.hpp"
+#include "RetryPolicy.hpp"
+#include "Metrics.hpp"
+#include "SearchCache.hpp"
+
+// TLS context, keep-alive connections, the Web API rate budget, the
+// retry budget, request metrics and the search cache.
+// Clients of several accounts (jobs) running at once share one transport:
+// each client is a flow of the scheduler with its own weight
+class SpotifyTransport{
+public:
+    SpotifyTransport();
+    SpotifyTransport(const SpotifyTransport&) = delete;
+    SpotifyTransport& operator=(const SpotifyTransport&) = delete;
+
+    HttpConnectionPool& pool() { return pool_; }
+    RequestScheduler& scheduler() { return scheduler_; }
+    RetryPolicy& retry() { return retry_; }
+    Metrics& metrics() { return metrics_; }
+
+    // Search cache at path, opened once for all clients of the transport:
+    // several caches on one file would overwrite each other's records
+    std::shared_ptr<SearchCache> searchCache(const std::string& path);
+private:
+    Metrics metrics_;
+    boost::asio::ssl::context ssl_ctx_;
+    HttpConnectionPool pool_;
+    RequestScheduler scheduler_;
+    RetryPolicy retry_;
+
+    std::mutex cacheMutex_;
+    std::shared_ptr<SearchCache> searchCache_;
+};
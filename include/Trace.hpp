@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Span tracing of coroutine pipelines in Chrome trace-event format
+// (open the file in Perfetto or chrome://tracing).
+// Spans are async events: spans of one lane nest on one track, no matter
+// which io thread resumes the coroutine. Off by default, a disabled span
+// costs one branch
+class Tracer{
+public:
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // Start recording, events are kept in memory until stop()
+    static void start(std::string path);
+
+    // Stop recording and write the trace file. False if it was not written
+    static bool stop();
+
+    // Id of a new lane (track in the viewer)
+    static std::uint64_t newLane();
+
+    static void begin(const char* name, std::uint64_t lane, std::string_view detail);
+    static void end(const char* name, std::uint64_t lane);
+private:
+    inline static std::atomic<bool> enabled_{false};
+};
+
+// Span from construction to destruction.
+// lane 0 opens a new lane; pass lane() of an enclosing span to nest under it
+class TraceSpan{
+public:
+    explicit TraceSpan(const char* name, std::uint64_t lane = 0, std::string_view detail = {}) :
+        name_(name)
+    {
+        if(Tracer::enabled()){
+            lane_ = lane ? lane : Tracer::newLane();
+            Tracer::begin(name_, lane_, detail);
+        }
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    ~TraceSpan(){
+        if(lane_){
+            Tracer::end(name_, lane_);
+        }
+    }
+
+    // 0 when tracing is off
+    std::uint64_t lane() const { return lane_; }
+private:
+    const char* name_;
+    std::uint64_t lane_ = 0;
+};
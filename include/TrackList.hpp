@@ -0,0 +1,93 @@
+#pragma once
+
+#include "TrackReader.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+// Columnar binary track list (.tracks), native byte order.
+// Artists are interned: each name is stored once and records keep its index.
+// Titles are one byte block with offsets. Optional columns hold
+// precomputed trackKey()s and, sparsely, Spotify ids found earlier.
+// The file is memory-mapped and read in place, nothing is parsed on load
+//
+//   header | artist offsets (u32, artists + 1) | artist bytes
+//          | record artists (u32, records) | title offsets (u32, records + 1)
+//          | title bytes | keys (u64, records)
+//          | id records (u32 ascending, ids) | ids (22 bytes, ids)
+//
+// Sections start at 8-byte boundaries
+class TrackList{
+public:
+    // Throws std::exception if the file cannot be mapped or is malformed
+    explicit TrackList(const std::string& path);
+
+    TrackList(const TrackList&) = delete;
+    TrackList& operator=(const TrackList&) = delete;
+
+    // File starts with the track list magic
+    static bool detect(const std::string& path);
+
+    std::size_t size() const { return records_; }
+    std::size_t artistCount() const { return artists_; }
+
+    std::string_view artist(std::size_t i) const;
+    std::string_view title(std::size_t i) const;
+
+    // Keys of the current kTrackKeyVersion are stored
+    bool hasKeys() const { return keys_ != nullptr; }
+    std::uint64_t key(std::size_t i) const;
+
+    // Known Spotify id of record i, empty if unknown
+    std::string_view id(std::size_t i) const;
+    std::size_t idCount() const { return ids_; }
+
+    // Record i with key and id when they are stored
+    void read(std::size_t i, TrackRecord& rec) const;
+private:
+    boost::interprocess::file_mapping file_;
+    boost::interprocess::mapped_region region_;
+
+    std::size_t records_ = 0;
+    std::size_t artists_ = 0;
+    const std::uint32_t* artistOffsets_ = nullptr;
+    const char* artistBytes_ = nullptr;
+    const std::uint32_t* recordArtists_ = nullptr;
+    const std::uint32_t* titleOffsets_ = nullptr;
+    const char* titleBytes_ = nullptr;
+    const std::uint64_t* keys_ = nullptr;
+    std::size_t ids_ = 0;
+    const std::uint32_t* idRecords_ = nullptr;
+    const char* idBytes_ = nullptr;
+};
+
+// Builds a track list in memory and writes it out
+class TrackListWriter{
+public:
+    // Invalid ids are dropped
+    void add(std::string_view artist, std::string_view title, std::string_view id = {});
+
+    std::size_t size() const { return recordArtists_.size(); }
+    std::size_t artistCount() const { return artistOffsets_.size() - 1; }
+    std::size_t idCount() const { return idRecords_.size(); }
+
+    // withKeys: store trackKey() of every record.
+    // Throws std::exception on write errors or columns over 4 GiB
+    void write(const std::string& path, bool withKeys) const;
+private:
+    std::vector<std::uint32_t> artistOffsets_{0};
+    std::string artistBytes_;
+    std::unordered_map<std::string, std::uint32_t> artistIndex_;
+    std::vector<std::uint32_t> recordArtists_;
+    std::vector<std::uint32_t> titleOffsets_{0};
+    std::string titleBytes_;
+    // Records with a known id and the ids, 22 bytes each
+    std::vector<std::uint32_t> idRecords_;
+    std::string idBytes_;
+};
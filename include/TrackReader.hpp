@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+// One track from the input file
+struct TrackRecord{
+    std::string artist;
+    std::string title;
+    // Spotify id found earlier, empty if unknown
+    std::string id;
+    // trackKey(artist, title) computed by the producer
+    std::optional<std::uint64_t> key;
+};
+
+// 22 base-62 characters
+bool isSpotifyId(std::string_view id);
+
+// Streaming reader of tracks over a memory-mapped file.
+// Accepts a JSON array [{"artist":..., "title":...}, ...]
+// or NDJSON (one object per line). An optional "id" member is a known
+// Spotify id of the track.
+// Records are decoded one at a time, no DOM is built
+class TrackReader{
+public:
+    // Throws std::exception if the file cannot be mapped
+    explicit TrackReader(const std::string& path);
+
+    // Reader over bytes already in memory (a line of a stream),
+    // data must outlive the reader
+    TrackReader(const char* data, std::size_t size);
+
+    // Decode next record into rec, false at end of input.
+    // Non-object array elements are skipped.
+    // Throws std::runtime_error on malformed input
+    bool next(TrackRecord& rec);
+
+    bool isNdjson() const { return ndjson_; }
+
+    // Bytes already parsed
+    std::size_t offset() const { return std::size_t(pos_ - begin_); }
+    std::size_t size() const { return std::size_t(end_ - begin_); }
+private:
+    // Skip BOM, detect array or NDJSON at begin_
+    void start();
+
+    // Parse object at pos_, keep only "artist", "title" and "id"
+    void parseObject(TrackRecord& rec);
+
+    [[noreturn]] void fail(const char* what) const;
+
+    boost::interprocess::file_mapping file_;
+    boost::interprocess::mapped_region region_;
+
+    const char* begin_ = nullptr;
+    const char* pos_ = nullptr;
+    const char* end_ = nullptr;
+
+    bool ndjson_ = false;
+    bool finished_ = false;
+};
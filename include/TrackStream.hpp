@@ -0,0 +1,68 @@
+#pragma once
+
+#include "AsyncPrimitives.hpp"
+#include "TrackReader.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/awaitable.hpp>
+
+// Tracks arriving as NDJSON while the producer is still running
+// (exporter process pipe, stdin): one {"artist":..., "title":...} per line,
+// optionally preceded by a {"total": N} header.
+// append()/close() are called from any thread, next() is awaited by one
+// coroutine on the executor given to the constructor (a strand)
+class TrackStream : public std::enable_shared_from_this<TrackStream>{
+public:
+    explicit TrackStream(boost::asio::any_io_executor executor);
+
+    TrackStream(const TrackStream&) = delete;
+    TrackStream& operator=(const TrackStream&) = delete;
+
+    // Bytes as they were read, lines may be split anywhere
+    void append(std::string_view bytes);
+
+    // No more bytes. complete = false: the producer failed,
+    // records that arrived are still read
+    void close(bool complete = true);
+
+    // Next record, suspends until a whole line arrives.
+    // False once the stream is closed and every line is read.
+    // Malformed lines are skipped with a warning
+    boost::asio::awaitable<bool> next(TrackRecord& rec);
+
+    // Records announced by the header, 0 if there was none yet
+    std::size_t totalHint() const { return total_.load(std::memory_order_relaxed); }
+
+    // Records returned by next()
+    std::size_t received() const { return received_; }
+
+    // Closed without a producer failure
+    bool complete() const;
+private:
+    // Wake next() on the executor
+    void notify();
+
+    // Parse one line into rec. False for a header, a blank or a malformed line
+    bool parseLine(std::string_view line, TrackRecord& rec);
+
+    boost::asio::any_io_executor executor_;
+
+    mutable std::mutex mutex_;
+    std::string buffer_;
+    // Start of the unread part of buffer_
+    std::size_t head_ = 0;
+    bool closed_ = false;
+    bool complete_ = false;
+
+    std::atomic<std::size_t> total_{0};
+    // Touched on executor_ only
+    std::size_t received_ = 0;
+    std::string line_;
+    AsyncWaitQueue arrived_;
+};
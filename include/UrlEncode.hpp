@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Percent-encode text (RFC 3986 unreserved characters stay) and append it to out.
+// Table-driven: runs of safe bytes are copied at once, no temporaries
+void appendUrlEncoded(std::string& out, std::string_view text);
+
+// Length of text after appendUrlEncoded, to reserve once
+std::size_t urlEncodedSize(std::string_view text);
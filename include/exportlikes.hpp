@@ -5,7 +5,12 @@
 #include <QPushButton>
 #include <QVBoxLayout>
 #include <QLabel>
+#include <QTimer>
+#include <QPointer>
+#include <QProcess>
 #include "QtSpotifyClient.hpp"
+#include "ProgressTracker.hpp"
+#include "LogModel.hpp"
 #include "ui_exportlikes.h"
 
 QT_BEGIN_NAMESPACE
@@ -24,8 +29,10 @@ public:
 private slots:
     void onAddTracksClicked();
     void onRemoveTracksClicked();
+    void onStopClicked();
+    void onPauseClicked();
     void onLogMessage(const QString& msg);
-    void onProgress(int current, int total);
+    void onProgressTick();
     void onFinishedAdding(bool success);
     void onFinishedRemoving(bool success);
     void onReauthorization();
@@ -36,9 +43,30 @@ private slots:
 
 private:
     void loadEnvFile();
+    void appendLog(const QString& text, LogModel::Level level = LogModel::Level::Info);
+    // Sample progress at a fixed rate while a pipeline runs
+    void startProgress();
+    void stopProgress();
+    // Stop/Pause are enabled only while a pipeline runs
+    void setPipelineRunning(bool running);
     bool saveEnvFile(const QString& token);
 
     std::unique_ptr<Ui::ExportLikes> ui;
 
     QtSpotifyClient* spotifyClient_;
+
+    LogModel* logModel_;
+    // View was scrolled to the end before new rows came
+    bool followLog_ = true;
+
+    // Stop was pressed: the pipeline end is not an error
+    bool stopRequested_ = false;
+
+    // Exporter feeding a running import, killed by Stop
+    QPointer<QProcess> streamExporter_;
+    // Running import reads the exporter, not a file
+    bool streamImport_ = false;
+
+    QTimer progressTimer_;
+    std::unique_ptr<ProgressSampler> progressSampler_;
 };
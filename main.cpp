@@ -1,12 +1,23 @@
 #include "exportlikes.hpp"
+#include "Trace.hpp"
 #include <QApplication>
 
 int main(int argc, char* argv[]) {
     QCoreApplication::setApplicationName("ExportLikes");
-    QApplication a(argc, argv);
-    ExportLikes w;
-    w.show();
-    return a.exec();
+    // EXPORTLIKES_TRACE=<file> records a Chrome trace of the session
+    QByteArray tracePath = qgetenv("EXPORTLIKES_TRACE");
+    if (!tracePath.isEmpty()) {
+        Tracer::start(tracePath.toStdString());
+    }
+    int code = 0;
+    {
+        QApplication a(argc, argv);
+        ExportLikes w;
+        w.show();
+        code = a.exec();
+    }
+    Tracer::stop();
+    return code;
 }
 
 
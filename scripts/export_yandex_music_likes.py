@@ -1,3 +1,4 @@
+import argparse
 import json
 import os
 import asyncio
@@ -5,8 +6,6 @@ import sys
 from dotenv import load_dotenv
 from yandex_music import ClientAsync
 from pathlib import Path
-import tkinter as tk
-from tkinter import filedialog
 
 def get_env_path():
     if sys.platform.startswith("win"):
@@ -20,6 +19,10 @@ def get_env_path():
     return base / "ExportLikes" / ".env"
 
 def save_tracks_to_json(tracks):
+    # Tk is only needed for the dialog, stream mode runs without it
+    import tkinter as tk
+    from tkinter import filedialog
+
     # Спрячем главное окно Tk
     root = tk.Tk()
     root.withdraw()
@@ -50,29 +53,46 @@ def save_tracks_to_json(tracks):
 def chunker(seq, n):
     for i in range(0, len(seq), n):
         yield seq[i: i + n]
-async def main():
+
+# Stream mode: stdout carries only NDJSON records, logs go to stderr
+def log(*args, stream_mode=False):
+    print(*args, file=sys.stderr if stream_mode else sys.stdout, flush=stream_mode)
+
+
+def write_record(record):
+    sys.stdout.write(json.dumps(record, ensure_ascii=False) + "\n")
+
+
+async def main(stream_mode=False):
     # Load environment variables (.env must contain YANDEX_TOKEN)
     env_path = get_env_path()
     load_dotenv(dotenv_path=env_path)
     token = os.getenv("YANDEX_TOKEN")
     if not token:
-        print("Error: YANDEX_TOKEN not set")
-        print("ENV path: " + str(env_path))
-        return
+        log("Error: YANDEX_TOKEN not set", stream_mode=stream_mode)
+        log("ENV path: " + str(env_path), stream_mode=stream_mode)
+        return 1
 
     # Initialize client and fetch account status internally
     client = await ClientAsync(token).init()
 
     # Get liked track (in short objects)
     likes = await client.users_likes_tracks()
-    print(f"Total liked tracks: {len(likes)}")
+    log(f"Total liked tracks: {len(likes)}", stream_mode=stream_mode)
+
+    if stream_mode:
+        # Oldest like first, as in the saved file: no need to buffer
+        # the whole list to reverse it
+        likes = list(reversed(likes))
+        write_record({"total": len(likes)})
+        sys.stdout.flush()
 
     # Split into chunks
     # For each chunk fetch full Track object and get artist and title
     data = []
     chunk_size = 50
     for idx, chunk in enumerate(chunker(likes, chunk_size), start=1):
-        print(f"Fetching {idx} chunk...")
+        log(f"Fetching {idx} chunk...", stream_mode=stream_mode)
 
         # Schedule fetches in current chunk
         task = [short.fetch_track_async() for short in chunk]
@@ -80,11 +100,25 @@ async def main():
 
         # Add tracks in chunk to data
         for tr in tracks_in_chunk:
-            print(f"Work with track {tr.title}")
-            data.append({
+            record = {
                 "artist": tr.artists[0].name if tr.artists else "",
                 "title": tr.title
-            })
+            }
+            if stream_mode:
+                write_record(record)
+            else:
+                print(f"Work with track {tr.title}")
+                data.append(record)
+
+        # Importer starts searching this chunk while the next one is fetched
+        if stream_mode:
+            sys.stdout.flush()
+
+    if stream_mode:
+        log(f"Parsing likes from Yandex Music has been completed, "
+            f"streamed {len(likes)} tracks", stream_mode=stream_mode)
+        return 0
+
     data.reverse()
     # Save to json file
     out_path = "yandex_likes.json"
@@ -92,6 +126,15 @@ async def main():
 
     print(f"Parsing likes from Yandex Music has been completed"
           f"Saved {len(data)} track into {out_path}")
+    return 0
 
 if __name__ == "__main__":
-    asyncio.run(main())
+    parser = argparse.ArgumentParser(description="Export liked tracks from Yandex Music")
+    parser.add_argument("--stream", action="store_true",
+                        help="write tracks to stdout as NDJSON while they are fetched "
+                             "instead of saving a JSON file")
+    args = parser.parse_args()
+    if args.stream:
+        # Pipe may be read by a program that expects UTF-8
+        sys.stdout.reconfigure(encoding="utf-8")
+    sys.exit(asyncio.run(main(stream_mode=args.stream)))
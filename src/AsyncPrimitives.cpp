@@ -0,0 +1,72 @@
+#include "AsyncPrimitives.hpp"
+
+
+boost::asio::awaitable<void> AsyncWaitQueue::wait(){
+    // Timer never expires on its own: any completion is a wake up or a cancel
+    co_await waitUntil(std::chrono::steady_clock::time_point::max());
+    co_return;
+}
+
+boost::asio::awaitable<bool> AsyncWaitQueue::waitUntil(
+    std::chrono::steady_clock::time_point deadline){
+    using namespace boost::asio;
+
+    auto ex = co_await this_coro::executor;
+    Waiter waiter{steady_timer{ex, deadline}};
+    auto it = waiters_.insert(waiters_.end(), &waiter);
+
+    boost::system::error_code ec;
+    co_await waiter.timer.async_wait(redirect_error(use_awaitable, ec));
+    if(!waiter.woken){
+        waiters_.erase(it);
+    }
+    co_return waiter.woken;
+}
+
+void AsyncWaitQueue::notifyOne(){
+    if(waiters_.empty()){
+        return;
+    }
+    auto* waiter = waiters_.front();
+    waiters_.pop_front();
+    waiter->woken = true;
+    waiter->timer.cancel();
+}
+
+void AsyncWaitQueue::notifyAll(){
+    while(!waiters_.empty()){
+        notifyOne();
+    }
+}
+
+
+AsyncSemaphore::AsyncSemaphore(std::size_t permits) :
+    permits_(permits)
+{}
+
+boost::asio::awaitable<void> AsyncSemaphore::acquire(){
+    while(permits_ == 0){
+        co_await waiters_.wait();
+    }
+    --permits_;
+    co_return;
+}
+
+void AsyncSemaphore::release(){
+    ++permits_;
+    waiters_.notifyOne();
+}
+
+
+void AsyncWaitGroup::done(){
+    if(count_ > 0 && --count_ == 0){
+        waiters_.notifyAll();
+    }
+}
+
+boost::asio::awaitable<void> AsyncWaitGroup::wait(){
+    while(count_ > 0){
+        co_await waiters_.wait();
+    }
+    co_return;
+}
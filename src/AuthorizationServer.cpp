@@ -45,6 +45,11 @@ void AuthorizationServer::shoutdown() {
     }
 }
 
+void AuthorizationServer::cancel(){
+    boost::system::error_code ec;
+    acceptor_.cancel(ec);
+}
+
 awaitable<std::string> AuthorizationServer::asyncGetAuthorizationCode(){
     try{
         qDebug() << "[AuthSrv] Enter asyncGetAuthorizationCode";
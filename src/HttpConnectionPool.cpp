@@ -0,0 +1,302 @@
+#include "HttpConnectionPool.hpp"
+#include "SpotifyIoService.hpp"
+#include <QDebug>
+#include <QString>
+
+
+HttpConnection::HttpConnection(boost::asio::io_context& io_ctx,
+                               boost::asio::ssl::context* ssl_ctx,
+                               std::string host, std::string port) :
+    host(std::move(host))
+    , port(std::move(port))
+    , useTls(ssl_ctx != nullptr)
+    , lastUsed(std::chrono::steady_clock::now())
+{
+    if(ssl_ctx){
+        tls.emplace(io_ctx, *ssl_ctx);
+    }
+    else{
+        plain.emplace(io_ctx);
+    }
+}
+
+
+HttpConnectionPool::Lease::Lease(HttpConnectionPool* pool, std::unique_ptr<HttpConnection> conn) :
+    pool_(pool)
+    , conn_(std::move(conn))
+{}
+
+HttpConnectionPool::Lease::Lease(Lease&& other) noexcept :
+    pool_(std::exchange(other.pool_, nullptr))
+    , conn_(std::move(other.conn_))
+{}
+
+HttpConnectionPool::Lease& HttpConnectionPool::Lease::operator=(Lease&& other) noexcept{
+    if(this != &other){
+        if(conn_){
+            release(false);
+        }
+        pool_ = std::exchange(other.pool_, nullptr);
+        conn_ = std::move(other.conn_);
+    }
+    return *this;
+}
+
+HttpConnectionPool::Lease::~Lease(){
+    // Connection state is unknown (exception in the middle of request)
+    if(conn_){
+        release(false);
+    }
+}
+
+void HttpConnectionPool::Lease::release(bool keepAlive){
+    if(!conn_ || !pool_){
+        return;
+    }
+    ++conn_->requests;
+    pool_->giveBack(std::move(conn_), keepAlive);
+    pool_ = nullptr;
+}
+
+
+HttpConnectionPool::HttpConnectionPool(boost::asio::ssl::context& ssl_ctx) :
+    HttpConnectionPool(ssl_ctx, Options{})
+{}
+
+HttpConnectionPool::HttpConnectionPool(boost::asio::ssl::context& ssl_ctx, Options options) :
+    ssl_ctx_(ssl_ctx)
+    , options_(options)
+    , strand_(boost::asio::make_strand(GlobalIoService::instance()))
+{}
+
+HttpConnectionPool::~HttpConnectionPool(){
+    // No lanes are left at this point
+    for(auto& [key, state] : hosts_){
+        for(auto& conn : state.idle){
+            close(*conn);
+        }
+    }
+}
+
+static void configure_stream(boost::beast::ssl_stream<boost::beast::tcp_stream>& stream, char const* host)
+{
+    stream.set_verify_mode(boost::asio::ssl::verify_peer);
+
+#ifdef DEBUG
+    // только для отладки:
+    stream.set_verify_callback(
+        [](bool pre, boost::asio::ssl::verify_context& ctx) {
+            X509_STORE_CTX* c = ctx.native_handle();
+            int depth = X509_STORE_CTX_get_error_depth(c);
+            int err   = X509_STORE_CTX_get_error(c);
+            qDebug() << "SSL verify: depth=" << depth
+                     << "err=" << err
+                     << "(" << X509_verify_cert_error_string(err) << ")"
+                     << "pre=" << pre;
+            return pre;
+        }
+        );
+#endif
+
+    // SNI
+    if (!SSL_set_tlsext_host_name(stream.native_handle(), host)) {
+        throw boost::system::system_error{boost::asio::error::invalid_argument};
+    }
+}
+
+std::string HttpConnectionPool::hostKey(const std::string& host, const std::string& port,
+                                        bool useTls){
+    return (useTls ? "https://" : "http://") + host + ":" + port;
+}
+
+boost::asio::awaitable<HttpConnectionPool::Lease> HttpConnectionPool::acquire(
+    const std::string& host, const std::string& port, bool useTls){
+    using namespace boost::asio;
+
+    auto key = hostKey(host, port, useTls);
+    auto reservation = co_await co_spawn(strand_, reserve(key), use_awaitable);
+    if(reservation.conn){
+        co_return Lease{this, std::move(reservation.conn)};
+    }
+
+    // Handshake runs here, not on the pool strand
+    std::unique_ptr<HttpConnection> conn;
+    try{
+        conn = co_await connect(key, std::move(reservation.endpoints), host, port, useTls);
+    }
+    catch(...){
+        post(strand_, [this, key]{ cancelReservation(key); });
+        throw;
+    }
+    co_return Lease{this, std::move(conn)};
+}
+
+boost::asio::awaitable<HttpConnectionPool::Reservation> HttpConnectionPool::reserve(std::string key){
+    // std::map keeps references valid across inserts
+    auto& state = hosts_[key];
+
+    while(true){
+        evictIdle(state);
+
+        // Reuse the freshest idle connection
+        while(!state.idle.empty()){
+            auto conn = std::move(state.idle.back());
+            state.idle.pop_back();
+            if(isAlive(*conn)){
+                ++state.busy;
+                co_return Reservation{std::move(conn), {}};
+            }
+            qDebug() << "Dropping connection closed by server:" << QString::fromStdString(key);
+            close(*conn);
+        }
+
+        if(state.busy < options_.maxPerHost){
+            break;
+        }
+
+        // Host is at its limit: wait for giveBack
+        co_await state.waiters.wait();
+    }
+
+    // Reserve the slot before the caller suspends on connect
+    ++state.busy;
+    Reservation reservation;
+    if(std::chrono::steady_clock::now() - state.resolvedAt <= options_.dnsTtl){
+        reservation.endpoints = state.endpoints;
+    }
+    co_return reservation;
+}
+
+void HttpConnectionPool::cancelReservation(const std::string& key){
+    auto& state = hosts_[key];
+    --state.busy;
+    state.waiters.notifyOne();
+}
+
+boost::asio::awaitable<std::unique_ptr<HttpConnection>> HttpConnectionPool::connect(
+    std::string key, boost::asio::ip::tcp::resolver::results_type endpoints,
+    const std::string& host, const std::string& port, bool useTls){
+    using namespace boost::asio;
+    using namespace boost::beast;
+
+    HttpConnection::SetupTimes times;
+    auto stageStart = std::chrono::steady_clock::now();
+
+    // Resolving (cached on the strand for dnsTtl)
+    if(endpoints.empty()){
+        ip::tcp::resolver resolver{GlobalIoService::instance()};
+        endpoints = co_await resolver.async_resolve(host, port, use_awaitable);
+        post(strand_, [this, key, endpoints]{
+            auto& state = hosts_[key];
+            state.endpoints = endpoints;
+            state.resolvedAt = std::chrono::steady_clock::now();
+        });
+        times.dns = std::chrono::steady_clock::now() - stageStart;
+    }
+
+    // SSL-stream
+    auto conn = std::make_unique<HttpConnection>(GlobalIoService::instance(),
+                                                 useTls ? &ssl_ctx_ : nullptr, host, port);
+    if(conn->tls){
+        configure_stream(*conn->tls, host.c_str());
+    }
+
+    // TCP connection
+    conn->socket().expires_after(std::chrono::seconds(30));
+    stageStart = std::chrono::steady_clock::now();
+    co_await conn->socket().async_connect(endpoints, use_awaitable);
+    times.connect = std::chrono::steady_clock::now() - stageStart;
+
+    // Handshake
+    if(conn->tls){
+        stageStart = std::chrono::steady_clock::now();
+        co_await conn->tls->async_handshake(ssl::stream_base::client, use_awaitable);
+        times.tls = std::chrono::steady_clock::now() - stageStart;
+    }
+    conn->socket().expires_never();
+    conn->setupTimes = times;
+
+    conn->lastUsed = std::chrono::steady_clock::now();
+    co_return conn;
+}
+
+void HttpConnectionPool::giveBack(std::unique_ptr<HttpConnection> conn, bool keepAlive){
+    boost::asio::post(strand_, [this, conn = std::move(conn), keepAlive]() mutable{
+        putBack(std::move(conn), keepAlive);
+    });
+}
+
+void HttpConnectionPool::putBack(std::unique_ptr<HttpConnection> conn, bool keepAlive){
+    auto it = hosts_.find(hostKey(conn->host, conn->port, conn->useTls));
+    if(it == hosts_.end()){
+        close(*conn);
+        return;
+    }
+    auto& state = it->second;
+    --state.busy;
+
+    conn->lastUsed = std::chrono::steady_clock::now();
+    if(keepAlive
+        && conn->requests < options_.maxRequestsPerConnection
+        && state.idle.size() < options_.maxIdlePerHost){
+        state.idle.push_back(std::move(conn));
+    }
+    else{
+        close(*conn);
+    }
+
+    state.waiters.notifyOne();
+}
+
+void HttpConnectionPool::evictIdle(HostState& state){
+    auto deadline = std::chrono::steady_clock::now() - options_.idleTimeout;
+    std::erase_if(state.idle, [deadline](const std::unique_ptr<HttpConnection>& conn){
+        if(conn->lastUsed < deadline){
+            close(*conn);
+            return true;
+        }
+        return false;
+    });
+}
+
+void HttpConnectionPool::closeIdle(){
+    boost::asio::post(strand_, [this]{
+        for(auto& [key, state] : hosts_){
+            for(auto& conn : state.idle){
+                close(*conn);
+            }
+            state.idle.clear();
+        }
+    });
+}
+
+bool HttpConnectionPool::isAlive(HttpConnection& conn){
+    auto& socket = conn.socket().socket();
+    if(!socket.is_open()){
+        return false;
+    }
+    // Unread bytes on an idle connection: close_notify or desync
+    if(conn.buffer.size() != 0){
+        return false;
+    }
+
+    // Peek without blocking: would_block means nothing was sent
+    // to us, eof or data means the server is done with the connection
+    boost::system::error_code ec;
+    char byte;
+    socket.non_blocking(true, ec);
+    socket.receive(boost::asio::buffer(&byte, 1),
+                   boost::asio::socket_base::message_peek, ec);
+    bool alive = ec == boost::asio::error::would_block;
+    boost::system::error_code ignored;
+    socket.non_blocking(false, ignored);
+    return alive;
+}
+
+void HttpConnectionPool::close(HttpConnection& conn){
+    // No TLS close_notify: nothing useful to wait for on a client side
+    boost::system::error_code ec;
+    auto& socket = conn.socket().socket();
+    socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+    socket.close(ec);
+}
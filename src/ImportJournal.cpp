@@ -0,0 +1,207 @@
+#include "ImportJournal.hpp"
+#include "Fnv1a.hpp"
+#include <cinttypes>
+#include <cstring>
+#include <filesystem>
+#include <QDebug>
+#include <QString>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+// File header: magic + version, then input fingerprint
+constexpr char kMagic[8] = {'E', 'L', 'J', 'R', 'N', 'L', '0', '1'};
+constexpr std::size_t kHeaderSize = sizeof(kMagic) + sizeof(std::uint64_t);
+
+// Write buffered records after this many, or after kSyncInterval
+constexpr std::size_t kFlushEvery = 256;
+constexpr auto kSyncInterval = std::chrono::seconds(1);
+
+bool syncFile(std::FILE* file){
+    if(std::fflush(file) != 0){
+        return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+}
+
+
+ImportJournal::ImportJournal(const std::string& inputPath, const std::string& account,
+                             bool resume) :
+    path_(pathFor(inputPath, account))
+    , fingerprint_(fingerprint(inputPath, account))
+    , lastSync_(std::chrono::steady_clock::now())
+{
+    bool loaded = false;
+    if(resume){
+        try{
+            loaded = load();
+        }
+        catch(std::exception& e){
+            qWarning() << "Import journal is not loaded:" << e.what();
+            committed_ = 0;
+            resolved_.clear();
+        }
+    }
+
+    file_ = std::fopen(path_.c_str(), loaded ? "ab" : "wb");
+    if(!file_){
+        qWarning() << "Unable to open import journal:" << QString::fromStdString(path_);
+        return;
+    }
+    if(!loaded){
+        std::fwrite(kMagic, 1, sizeof(kMagic), file_);
+        std::fwrite(&fingerprint_, 1, sizeof(fingerprint_), file_);
+    }
+}
+
+ImportJournal::~ImportJournal(){
+    if(file_){
+        flush(true);
+        std::fclose(file_);
+    }
+}
+
+std::optional<std::string> ImportJournal::resolved(std::uint64_t position) const{
+    auto it = resolved_.find(position);
+    if(it == resolved_.end()){
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+void ImportJournal::recordResolved(std::uint64_t position, const std::string& id){
+    Record rec{};
+    rec.position = position;
+    rec.kind = Resolved;
+    std::memcpy(rec.id, id.data(), std::min(id.size(), sizeof(rec.id)));
+    append(rec);
+}
+
+void ImportJournal::recordCommitted(std::uint64_t position){
+    if(position <= committed_){
+        return;
+    }
+    committed_ = position;
+    Record rec{};
+    rec.position = position;
+    rec.kind = Committed;
+    append(rec);
+}
+
+void ImportJournal::append(const Record& rec){
+    pending_.push_back(rec);
+    // Off the hot path: one write and one sync for many records
+    if(pending_.size() >= kFlushEvery
+        || std::chrono::steady_clock::now() - lastSync_ >= kSyncInterval){
+        flush(true);
+    }
+}
+
+void ImportJournal::flush(bool sync){
+    if(!file_){
+        pending_.clear();
+        return;
+    }
+    if(!pending_.empty()){
+        std::fwrite(pending_.data(), sizeof(Record), pending_.size(), file_);
+        pending_.clear();
+    }
+    if(sync){
+        if(!syncFile(file_)){
+            qWarning() << "Unable to sync import journal";
+        }
+        lastSync_ = std::chrono::steady_clock::now();
+    }
+}
+
+void ImportJournal::finish(){
+    pending_.clear();
+    if(file_){
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+    std::error_code ec;
+    std::filesystem::remove(path_, ec);
+}
+
+std::string ImportJournal::pathFor(const std::string& inputPath, const std::string& account){
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016" PRIx64, fnv1a(account));
+    return inputPath + "." + hash + ".journal";
+}
+
+std::uint64_t ImportJournal::fingerprint(const std::string& inputPath,
+                                         const std::string& account){
+    std::error_code ec;
+    auto size = std::filesystem::file_size(inputPath, ec);
+    auto mtime = std::filesystem::last_write_time(inputPath, ec).time_since_epoch().count();
+
+    // FNV-1a over the account, then size and mtime, little-endian
+    std::uint64_t hash = fnv1a(account);
+    for(std::uint64_t value : {std::uint64_t(size), std::uint64_t(mtime)}){
+        char bytes[8];
+        for(int i = 0; i < 8; ++i){
+            bytes[i] = char((value >> (8 * i)) & 0xff);
+        }
+        hash = fnv1a(std::string_view(bytes, sizeof(bytes)), hash);
+    }
+    return hash;
+}
+
+bool ImportJournal::load(){
+    namespace bip = boost::interprocess;
+
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path_, ec);
+    if(ec || size < kHeaderSize){
+        return false;
+    }
+
+    std::size_t count = (size - kHeaderSize) / sizeof(Record);
+    {
+        bip::file_mapping file(path_.c_str(), bip::read_only);
+        bip::mapped_region region(file, bip::read_only);
+        auto* data = static_cast<const char*>(region.get_address());
+        std::uint64_t stored = 0;
+        std::memcpy(&stored, data + sizeof(kMagic), sizeof(stored));
+        if(std::memcmp(data, kMagic, sizeof(kMagic)) != 0 || stored != fingerprint_){
+            qDebug() << "Import journal belongs to another input, starting over";
+            return false;
+        }
+
+        for(std::size_t i = 0; i < count; ++i){
+            Record rec;
+            std::memcpy(&rec, data + kHeaderSize + i * sizeof(Record), sizeof(Record));
+            if(rec.kind == Committed){
+                committed_ = std::max(committed_, rec.position);
+            }
+            else if(rec.kind == Resolved){
+                resolved_[rec.position] = std::string(rec.id, strnlen(rec.id, sizeof(rec.id)));
+            }
+        }
+    }
+
+    // Results before the watermark are not needed any more
+    for(auto it = resolved_.begin(); it != resolved_.end();){
+        it = it->first < committed_ ? resolved_.erase(it) : std::next(it);
+    }
+
+    // Torn tail after a crash: cut it so appends stay aligned
+    auto aligned = kHeaderSize + count * sizeof(Record);
+    if(aligned != size){
+        std::filesystem::resize_file(path_, aligned);
+    }
+    qDebug() << "Import journal loaded: committed" << committed_
+             << "records," << resolved_.size() << "results";
+    return true;
+}
@@ -0,0 +1,165 @@
+#include "JobQueue.hpp"
+#include "SpotifyClient.hpp"
+#include "SpotifyIoService.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <exception>
+#include <future>
+#include <QDebug>
+
+
+JobQueue::JobQueue(std::size_t maxRunning) :
+    maxRunning_(std::max<std::size_t>(maxRunning, 1))
+    , strand_(boost::asio::make_strand(GlobalIoService::instance()))
+{}
+
+JobQueue::~JobQueue(){
+    using namespace boost::asio;
+
+    std::promise<void> stopped;
+    co_spawn(strand_,
+        [this, &stopped]() -> awaitable<void>{
+            for(auto& entry : queued_){
+                finished(entry.id, State::Cancelled);
+            }
+            queued_.clear();
+            for(auto& [id, client] : running_){
+                client->cancel();
+            }
+            // Stopped pipelines end within the request timeout
+            while(!running_.empty()){
+                co_await idle_.wait();
+            }
+            stopped.set_value();
+        },
+        detached);
+    stopped.get_future().wait();
+}
+
+JobQueue::JobId JobQueue::submit(Job job){
+    auto id = nextId_++;
+    boost::asio::post(strand_, [this, id, job = std::move(job)]() mutable{
+        queued_.push_back({id, std::move(job)});
+        startJobs();
+    });
+    return id;
+}
+
+void JobQueue::cancel(JobId id){
+    boost::asio::post(strand_, [this, id]{
+        auto it = std::find_if(queued_.begin(), queued_.end(),
+                               [id](const Entry& entry){ return entry.id == id; });
+        if(it != queued_.end()){
+            queued_.erase(it);
+            finished(id, State::Cancelled);
+            return;
+        }
+        if(auto running = running_.find(id); running != running_.end()){
+            running->second->cancel();
+        }
+    });
+}
+
+boost::asio::awaitable<void> JobQueue::waitIdle(){
+    using namespace boost::asio;
+    co_await co_spawn(strand_,
+        [this]() -> awaitable<void>{
+            while(!queued_.empty() || !running_.empty()){
+                co_await idle_.wait();
+            }
+        },
+        use_awaitable);
+}
+
+void JobQueue::startJobs(){
+    auto busy = [this](const Entry& entry){
+        for(auto& [id, client] : running_){
+            if(client == entry.job.client){
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Interactive jobs first, whatever runs already
+    for(auto it = queued_.begin(); it != queued_.end();){
+        if(it->job.priority == RequestScheduler::Priority::Interactive && !busy(*it)){
+            auto entry = std::move(*it);
+            it = queued_.erase(it);
+            start(std::move(entry));
+        }
+        else{
+            ++it;
+        }
+    }
+
+    // Bulk jobs in submit order up to the limit
+    for(auto it = queued_.begin(); it != queued_.end() && runningBulk_ < maxRunning_;){
+        if(it->job.priority == RequestScheduler::Priority::Bulk && !busy(*it)){
+            auto entry = std::move(*it);
+            it = queued_.erase(it);
+            start(std::move(entry));
+        }
+        else{
+            ++it;
+        }
+    }
+}
+
+void JobQueue::start(Entry entry){
+    using namespace boost::asio;
+
+    auto client = entry.job.client;
+    auto bulk = entry.job.priority == RequestScheduler::Priority::Bulk;
+    running_.emplace(entry.id, client);
+    if(bulk){
+        ++runningBulk_;
+    }
+    // Stop of an earlier job of the client does not carry over
+    client->reset();
+    client->setSchedulingShare(entry.job.weight, entry.job.priority);
+    qDebug() << "Job" << entry.id << "started," << running_.size() << "running";
+
+    co_spawn(client->executor(),
+        [job = std::move(entry.job), id = entry.id]() -> awaitable<bool>{
+            TraceSpan span("job", 0, job.input);
+            if(job.kind == Kind::Import){
+                co_return co_await job.client->likeTracksFromJson(job.input);
+            }
+            co_return co_await job.client->removeLastN(job.count);
+        },
+        bind_executor(strand_, [this, id = entry.id, client, bulk](std::exception_ptr e, bool ok){
+            if(e){
+                try{
+                    std::rethrow_exception(e);
+                }
+                catch(std::exception& ex){
+                    qWarning() << "Job" << id << "failed:" << ex.what();
+                }
+            }
+            running_.erase(id);
+            if(bulk){
+                --runningBulk_;
+            }
+            auto state = client->cancelled() ? State::Cancelled : ok ? State::Done : State::Failed;
+            finished(id, state);
+            startJobs();
+        }));
+}
+
+const char* JobQueue::name(State state){
+    switch(state){
+    case State::Done: return "done";
+    case State::Failed: return "failed";
+    case State::Cancelled: return "cancelled";
+    }
+    return "unknown";
+}
+
+void JobQueue::finished(JobId id, State state){
+    qDebug() << "Job" << id << name(state);
+    if(doneHandler_){
+        doneHandler_(id, state);
+    }
+    idle_.notifyAll();
+}
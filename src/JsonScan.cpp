@@ -0,0 +1,269 @@
+#include "JsonScan.hpp"
+#include <charconv>
+#include <cstring>
+
+namespace {
+int hexValue(char c){
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Read 4 hex digits after "\u"
+const char* parseHex4(const char* p, const char* end, unsigned& value){
+    if(end - p < 4){
+        return nullptr;
+    }
+    value = 0;
+    for(int i = 0; i < 4; ++i){
+        int digit = hexValue(p[i]);
+        if(digit < 0){
+            return nullptr;
+        }
+        value = (value << 4) | unsigned(digit);
+    }
+    return p + 4;
+}
+
+void appendUtf8(std::string& out, unsigned cp){
+    if(cp < 0x80){
+        out += char(cp);
+    }
+    else if(cp < 0x800){
+        out += char(0xC0 | (cp >> 6));
+        out += char(0x80 | (cp & 0x3F));
+    }
+    else if(cp < 0x10000){
+        out += char(0xE0 | (cp >> 12));
+        out += char(0x80 | ((cp >> 6) & 0x3F));
+        out += char(0x80 | (cp & 0x3F));
+    }
+    else{
+        out += char(0xF0 | (cp >> 18));
+        out += char(0x80 | ((cp >> 12) & 0x3F));
+        out += char(0x80 | ((cp >> 6) & 0x3F));
+        out += char(0x80 | (cp & 0x3F));
+    }
+}
+
+// Skip object or array, p points to '{' or '['
+const char* skipContainer(const char* p, const char* end){
+    int depth = 0;
+    while(p < end){
+        char c = *p;
+        if(c == '"'){
+            p = jsonSkipString(p, end);
+            if(!p){
+                return nullptr;
+            }
+            continue;
+        }
+        if(c == '{' || c == '['){
+            ++depth;
+        }
+        else if(c == '}' || c == ']'){
+            if(--depth == 0){
+                return p + 1;
+            }
+        }
+        ++p;
+    }
+    return nullptr;
+}
+}
+
+const char* jsonSkipWhitespace(const char* p, const char* end){
+    while(p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')){
+        ++p;
+    }
+    return p;
+}
+
+const char* jsonSkipString(const char* p, const char* end){
+    if(p >= end || *p != '"'){
+        return nullptr;
+    }
+    ++p;
+    while(p < end){
+        // Jump to the next quote or backslash
+        auto* q = static_cast<const char*>(std::memchr(p, '"', std::size_t(end - p)));
+        if(!q){
+            return nullptr;
+        }
+        // Quote is escaped if preceded by an odd number of backslashes
+        const char* b = q;
+        while(b > p && b[-1] == '\\'){
+            --b;
+        }
+        if((q - b) % 2 == 0){
+            return q + 1;
+        }
+        p = q + 1;
+    }
+    return nullptr;
+}
+
+const char* jsonParseString(const char* p, const char* end, std::string& out){
+    out.clear();
+    if(p >= end || *p != '"'){
+        return nullptr;
+    }
+    ++p;
+    while(p < end){
+        // Copy plain runs at once
+        const char* run = p;
+        while(p < end && *p != '"' && *p != '\\'){
+            ++p;
+        }
+        out.append(run, std::size_t(p - run));
+        if(p >= end){
+            return nullptr;
+        }
+        if(*p == '"'){
+            return p + 1;
+        }
+
+        // Escape sequence
+        if(++p >= end){
+            return nullptr;
+        }
+        char esc = *p++;
+        switch(esc){
+        case '"':  out += '"';  break;
+        case '\\': out += '\\'; break;
+        case '/':  out += '/';  break;
+        case 'b':  out += '\b'; break;
+        case 'f':  out += '\f'; break;
+        case 'n':  out += '\n'; break;
+        case 'r':  out += '\r'; break;
+        case 't':  out += '\t'; break;
+        case 'u':{
+            unsigned cp;
+            p = parseHex4(p, end, cp);
+            if(!p){
+                return nullptr;
+            }
+            // Surrogate pair
+            if(cp >= 0xD800 && cp <= 0xDBFF
+                && end - p >= 6 && p[0] == '\\' && p[1] == 'u'){
+                unsigned low;
+                const char* q = parseHex4(p + 2, end, low);
+                if(q && low >= 0xDC00 && low <= 0xDFFF){
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    p = q;
+                }
+            }
+            appendUtf8(out, cp);
+            break;
+        }
+        default:
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+const char* jsonSkipValue(const char* p, const char* end){
+    p = jsonSkipWhitespace(p, end);
+    if(p >= end){
+        return nullptr;
+    }
+    switch(*p){
+    case '"':
+        return jsonSkipString(p, end);
+    case '{':
+    case '[':
+        return skipContainer(p, end);
+    default:
+        // Number or literal: up to the next delimiter
+        while(p < end && *p != ',' && *p != '}' && *p != ']'
+               && *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t'){
+            ++p;
+        }
+        return p;
+    }
+}
+
+const char* jsonParseInteger(const char* p, const char* end, long long& out){
+    auto [after, ec] = std::from_chars(p, end, out);
+    if(ec != std::errc{}){
+        return nullptr;
+    }
+    // 1.5 or 1e3 is not an integer
+    if(after < end && (*after == '.' || *after == 'e' || *after == 'E')){
+        return nullptr;
+    }
+    return after;
+}
+
+const char* jsonFindMember(const char* p, const char* end, std::string_view key){
+    if(p >= end || *p != '{'){
+        return nullptr;
+    }
+    ++p;
+    std::string decoded;
+    while(true){
+        p = jsonSkipWhitespace(p, end);
+        if(p == end || *p == '}'){
+            return nullptr;
+        }
+        if(*p == ','){
+            ++p;
+            continue;
+        }
+        if(*p != '"'){
+            return nullptr;
+        }
+
+        // Keys without escapes are compared in place
+        const char* afterKey = jsonSkipString(p, end);
+        if(!afterKey){
+            return nullptr;
+        }
+        std::string_view raw(p + 1, std::size_t(afterKey - p - 2));
+        bool match;
+        if(raw.find('\\') == std::string_view::npos){
+            match = raw == key;
+        }
+        else{
+            decoded.clear();
+            jsonParseString(p, end, decoded);
+            match = decoded == key;
+        }
+
+        p = jsonSkipWhitespace(afterKey, end);
+        if(p == end || *p != ':'){
+            return nullptr;
+        }
+        p = jsonSkipWhitespace(p + 1, end);
+        if(match){
+            return p < end ? p : nullptr;
+        }
+        p = jsonSkipValue(p, end);
+        if(!p){
+            return nullptr;
+        }
+    }
+}
+
+const char* jsonFindPath(const char* p, const char* end,
+                         std::initializer_list<std::string_view> path){
+    for(auto key : path){
+        p = jsonFindMember(p, end, key);
+        if(!p){
+            return nullptr;
+        }
+    }
+    return p;
+}
+
+bool jsonGetString(const char* p, const char* end, std::string_view key, std::string& out){
+    auto* value = jsonFindMember(p, end, key);
+    return value && *value == '"' && jsonParseString(value, end, out);
+}
+
+bool jsonGetInteger(const char* p, const char* end, std::string_view key, long long& out){
+    auto* value = jsonFindMember(p, end, key);
+    return value && jsonParseInteger(value, end, out);
+}
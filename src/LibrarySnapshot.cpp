@@ -0,0 +1,24 @@
+#include "LibrarySnapshot.hpp"
+#include "Fnv1a.hpp"
+#include <algorithm>
+
+
+void LibrarySnapshot::insert(const std::string& id){
+    if(!id.empty()){
+        hashes_.push_back(hash(id));
+    }
+}
+
+void LibrarySnapshot::seal(){
+    std::sort(hashes_.begin(), hashes_.end());
+    hashes_.erase(std::unique(hashes_.begin(), hashes_.end()), hashes_.end());
+    hashes_.shrink_to_fit();
+}
+
+bool LibrarySnapshot::contains(const std::string& id) const{
+    return std::binary_search(hashes_.begin(), hashes_.end(), hash(id));
+}
+
+std::uint64_t LibrarySnapshot::hash(const std::string& id){
+    return fnv1a(id);
+}
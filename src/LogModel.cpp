@@ -0,0 +1,144 @@
+#include "LogModel.hpp"
+#include <algorithm>
+#include <QBrush>
+#include <QColor>
+#include <QDateTime>
+#include <QDebug>
+
+namespace {
+// Pending lines are inserted at most this often (about 30 frames per second)
+constexpr int kFlushIntervalMs = 33;
+}
+
+LogModel::LogModel(std::size_t capacity, QObject* parent)
+    : QAbstractListModel(parent)
+    , capacity_(std::max<std::size_t>(capacity, 1))
+{
+    ring_.resize(capacity_);
+    flushTimer_.setSingleShot(true);
+    flushTimer_.setInterval(kFlushIntervalMs);
+    connect(&flushTimer_, &QTimer::timeout, this, &LogModel::flush);
+}
+
+LogModel::~LogModel(){
+    // Lines of the last frame still go to the file
+    writeSpill();
+}
+
+int LogModel::rowCount(const QModelIndex& parent) const{
+    return parent.isValid() ? 0 : int(size_);
+}
+
+const LogModel::Entry& LogModel::at(int row) const{
+    return ring_[(head_ + std::size_t(row)) % capacity_];
+}
+
+QVariant LogModel::data(const QModelIndex& index, int role) const{
+    if(!index.isValid() || index.row() < 0 || std::size_t(index.row()) >= size_){
+        return {};
+    }
+    const auto& entry = at(index.row());
+    switch(role){
+    case Qt::DisplayRole:
+    case Qt::ToolTipRole:
+        return entry.text;
+    case Qt::ForegroundRole:
+        if(entry.level == Level::Error){
+            return QBrush(QColor(Qt::red));
+        }
+        return {};
+    default:
+        return {};
+    }
+}
+
+void LogModel::append(const QString& text, Level level){
+    // Process output comes in chunks of several lines
+    const auto lines = text.split('\n');
+    for(const auto& line : lines){
+        auto trimmed = line;
+        if(trimmed.endsWith('\r')){
+            trimmed.chop(1);
+        }
+        if(trimmed.isEmpty() && lines.size() > 1){
+            continue;
+        }
+        pending_.push_back({trimmed, level});
+    }
+    // Lines that would be evicted in the same frame are never shown
+    if(std::size_t(pending_.size()) > capacity_ && !spill_.isOpen()){
+        pending_.erase(pending_.begin(), pending_.end() - qsizetype(capacity_));
+    }
+    if(!flushTimer_.isActive()){
+        flushTimer_.start();
+    }
+}
+
+bool LogModel::setSpillFile(const QString& path){
+    if(spill_.isOpen()){
+        spill_.close();
+    }
+    if(path.isEmpty()){
+        return true;
+    }
+    // Log of the previous session is kept as <path>.1: that is the one
+    // to read after a failure and a restart
+    if(QFile::exists(path)){
+        QFile::remove(path + ".1");
+        if(!QFile::rename(path, path + ".1")){
+            qWarning() << "Unable to keep the previous log:" << path;
+        }
+    }
+    spill_.setFileName(path);
+    return spill_.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+}
+
+void LogModel::writeSpill(){
+    if(!spill_.isOpen() || pending_.isEmpty()){
+        return;
+    }
+    // One write per frame
+    QByteArray out;
+    auto stamp = QDateTime::currentDateTime().toString(Qt::ISODate).toUtf8();
+    for(const auto& entry : pending_){
+        out += stamp;
+        out += entry.level == Level::Error ? " E " : " I ";
+        out += entry.text.toUtf8();
+        out += '\n';
+    }
+    spill_.write(out);
+    spill_.flush();
+}
+
+void LogModel::flush(){
+    flushTimer_.stop();
+    if(pending_.isEmpty()){
+        return;
+    }
+
+    writeSpill();
+
+    // Only the newest capacity_ lines can stay
+    qsizetype first = std::max<qsizetype>(0, pending_.size() - qsizetype(capacity_));
+    std::size_t incoming = std::size_t(pending_.size() - first);
+
+    // Evict the oldest rows to make room
+    std::size_t evict = size_ + incoming > capacity_ ? size_ + incoming - capacity_ : 0;
+    if(evict > 0){
+        beginRemoveRows(QModelIndex(), 0, int(evict) - 1);
+        for(std::size_t i = 0; i < evict; ++i){
+            ring_[(head_ + i) % capacity_] = Entry{};
+        }
+        head_ = (head_ + evict) % capacity_;
+        size_ -= evict;
+        endRemoveRows();
+    }
+
+    beginInsertRows(QModelIndex(), int(size_), int(size_ + incoming) - 1);
+    for(qsizetype i = first; i < pending_.size(); ++i){
+        ring_[(head_ + size_) % capacity_] = std::move(pending_[i]);
+        ++size_;
+    }
+    endInsertRows();
+    pending_.clear();
+}
@@ -0,0 +1,224 @@
+#include "Metrics.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace {
+// Quantiles in dumps
+constexpr double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+double seconds(std::chrono::microseconds us){
+    return double(us.count()) / 1e6;
+}
+}
+
+void LatencyHistogram::record(std::chrono::steady_clock::duration elapsed){
+    auto micros = std::uint64_t(std::max<std::int64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(), 0));
+    buckets_[bucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sumMicros_.fetch_add(micros, std::memory_order_relaxed);
+
+    auto seen = maxMicros_.load(std::memory_order_relaxed);
+    while(micros > seen && !maxMicros_.compare_exchange_weak(seen, micros, std::memory_order_relaxed)){
+    }
+}
+
+std::chrono::microseconds LatencyHistogram::sum() const{
+    return std::chrono::microseconds(sumMicros_.load(std::memory_order_relaxed));
+}
+
+std::chrono::microseconds LatencyHistogram::max() const{
+    return std::chrono::microseconds(maxMicros_.load(std::memory_order_relaxed));
+}
+
+std::chrono::microseconds LatencyHistogram::percentile(double q) const{
+    std::uint64_t total = 0;
+    for(auto& bucket : buckets_){
+        total += bucket.load(std::memory_order_relaxed);
+    }
+    if(total == 0){
+        return std::chrono::microseconds(0);
+    }
+
+    auto rank = std::uint64_t(std::clamp(q, 0.0, 1.0) * double(total - 1)) + 1;
+    std::uint64_t seen = 0;
+    for(std::size_t i = 0; i < kBuckets; ++i){
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if(seen >= rank){
+            // Bucket bound may overshoot the largest value seen
+            return std::min(std::chrono::microseconds(bucketUpper(i)), max());
+        }
+    }
+    return max();
+}
+
+std::size_t LatencyHistogram::bucketOf(std::uint64_t micros){
+    // 0..15 us exactly, then 16 sub-buckets per power of two
+    if(micros < kSubBuckets){
+        return std::size_t(micros);
+    }
+    std::size_t msb = std::size_t(std::bit_width(micros)) - 1;
+    if(msb >= kMaxBit){
+        return kBuckets - 1;
+    }
+    std::size_t sub = std::size_t(micros >> (msb - 4)) & (kSubBuckets - 1);
+    return (msb - 3) * kSubBuckets + sub;
+}
+
+std::uint64_t LatencyHistogram::bucketUpper(std::size_t bucket){
+    if(bucket < kSubBuckets){
+        return bucket;
+    }
+    std::size_t msb = bucket / kSubBuckets + 3;
+    std::uint64_t sub = bucket % kSubBuckets;
+    std::uint64_t width = std::uint64_t(1) << (msb - 4);
+    return ((kSubBuckets + sub) << (msb - 4)) + width - 1;
+}
+
+
+Metrics::Endpoint Metrics::classify(boost::beast::http::verb method, std::string_view target){
+    using boost::beast::http::verb;
+
+    auto path = target.substr(0, target.find('?'));
+    if(path == "/v1/search"){
+        return Endpoint::Search;
+    }
+    if(path == "/v1/me/tracks"){
+        switch(method){
+        case verb::get: return Endpoint::SavedTracksGet;
+        case verb::put: return Endpoint::SavedTracksPut;
+        case verb::delete_: return Endpoint::SavedTracksDelete;
+        default: break;
+        }
+    }
+    if(path == "/api/token"){
+        return Endpoint::Token;
+    }
+    return Endpoint::Other;
+}
+
+const char* Metrics::name(Endpoint endpoint){
+    switch(endpoint){
+    case Endpoint::Search: return "search";
+    case Endpoint::SavedTracksGet: return "saved_tracks_get";
+    case Endpoint::SavedTracksPut: return "saved_tracks_put";
+    case Endpoint::SavedTracksDelete: return "saved_tracks_delete";
+    case Endpoint::Token: return "token";
+    default: return "other";
+    }
+}
+
+const char* Metrics::name(Stage stage){
+    switch(stage){
+    case Stage::Queue: return "queue";
+    case Stage::Dns: return "dns";
+    case Stage::Connect: return "connect";
+    case Stage::Tls: return "tls";
+    case Stage::Ttfb: return "ttfb";
+    case Stage::Body: return "body";
+    case Stage::Parse: return "parse";
+    default: return "total";
+    }
+}
+
+const char* Metrics::name(Counter counter){
+    switch(counter){
+    case Counter::Requests: return "requests";
+    case Counter::RateLimited: return "rate_limited";
+    case Counter::ServerErrors: return "server_errors";
+    case Counter::Retries: return "retries";
+    case Counter::RetriesDenied: return "retries_denied";
+    case Counter::Failures: return "failures";
+    case Counter::ConnectionsOpened: return "connections_opened";
+    default: return "connections_reused";
+    }
+}
+
+std::string Metrics::toPrometheus() const{
+    std::ostringstream out;
+    out.precision(12);
+
+    out << "# HELP exportlikes_stage_seconds Spotify request stage latency.\n"
+        << "# TYPE exportlikes_stage_seconds summary\n";
+    for(std::size_t e = 0; e < kEndpoints; ++e){
+        for(std::size_t s = 0; s < kStages; ++s){
+            const auto& h = histograms_[e][s];
+            if(h.count() == 0){
+                continue;
+            }
+            std::string labels = std::string("endpoint=\"") + name(Endpoint(e))
+                                 + "\",stage=\"" + name(Stage(s)) + "\"";
+            for(double q : kQuantiles){
+                out << "exportlikes_stage_seconds{" << labels << ",quantile=\"" << q << "\"} "
+                    << seconds(h.percentile(q)) << "\n";
+            }
+            out << "exportlikes_stage_seconds_sum{" << labels << "} " << seconds(h.sum()) << "\n"
+                << "exportlikes_stage_seconds_count{" << labels << "} " << h.count() << "\n";
+        }
+    }
+
+    for(std::size_t c = 0; c < kCounters; ++c){
+        auto metric = std::string("exportlikes_") + name(Counter(c)) + "_total";
+        out << "# TYPE " << metric << " counter\n";
+        for(std::size_t e = 0; e < kEndpoints; ++e){
+            out << metric << "{endpoint=\"" << name(Endpoint(e)) << "\"} "
+                << counters_[e][c].load(std::memory_order_relaxed) << "\n";
+        }
+    }
+    return out.str();
+}
+
+std::string Metrics::toJson() const{
+    std::ostringstream out;
+    out.precision(12);
+    out << "{";
+    for(std::size_t e = 0; e < kEndpoints; ++e){
+        out << (e ? "," : "") << "\"" << name(Endpoint(e)) << "\":{\"counters\":{";
+        for(std::size_t c = 0; c < kCounters; ++c){
+            out << (c ? "," : "") << "\"" << name(Counter(c)) << "\":"
+                << counters_[e][c].load(std::memory_order_relaxed);
+        }
+        out << "},\"stages\":{";
+        bool first = true;
+        for(std::size_t s = 0; s < kStages; ++s){
+            const auto& h = histograms_[e][s];
+            if(h.count() == 0){
+                continue;
+            }
+            out << (first ? "" : ",") << "\"" << name(Stage(s)) << "\":{"
+                << "\"count\":" << h.count()
+                << ",\"sum_ms\":" << double(h.sum().count()) / 1e3
+                << ",\"p50_ms\":" << double(h.percentile(0.5).count()) / 1e3
+                << ",\"p90_ms\":" << double(h.percentile(0.9).count()) / 1e3
+                << ",\"p99_ms\":" << double(h.percentile(0.99).count()) / 1e3
+                << ",\"max_ms\":" << double(h.max().count()) / 1e3 << "}";
+            first = false;
+        }
+        out << "}}";
+    }
+    out << "}";
+    return out.str();
+}
+
+bool Metrics::writeFile(const std::string& path) const{
+    bool json = std::filesystem::path(path).extension() == ".json";
+    // Readers (node exporter, scripts) never see a half-written file
+    auto tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::trunc);
+        if(!out){
+            return false;
+        }
+        out << (json ? toJson() : toPrometheus());
+        if(!out){
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, path, ec);
+    return !ec;
+}
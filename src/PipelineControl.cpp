@@ -0,0 +1,25 @@
+#include "PipelineControl.hpp"
+#include <chrono>
+#include <optional>
+#include <boost/asio.hpp>
+
+namespace {
+// Paused coroutines look at the switch this often
+constexpr auto kPausePoll = std::chrono::milliseconds(100);
+}
+
+boost::asio::awaitable<bool> PipelineControl::proceed() const{
+    using namespace boost::asio;
+
+    // Coroutines of every strand sleep here: a timer each, no shared waiters
+    std::optional<steady_timer> timer;
+    while(paused()){
+        if(!timer){
+            timer.emplace(co_await this_coro::executor);
+        }
+        timer->expires_after(kPausePoll);
+        boost::system::error_code ec;
+        co_await timer->async_wait(redirect_error(use_awaitable, ec));
+    }
+    co_return !cancelled();
+}
@@ -0,0 +1,57 @@
+#include "ProgressTracker.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Time constant of the rate average, seconds
+constexpr double kRateWindow = 5.0;
+}
+
+void ProgressTracker::start(std::uint64_t total){
+    done_.store(0, std::memory_order_relaxed);
+    total_.store(total, std::memory_order_relaxed);
+    startedAt_.store(std::chrono::steady_clock::now().time_since_epoch().count(),
+                     std::memory_order_relaxed);
+    running_.store(true, std::memory_order_relaxed);
+    run_.fetch_add(1, std::memory_order_release);
+}
+
+ProgressSnapshot ProgressSampler::sample(){
+    auto now = std::chrono::steady_clock::now();
+    ProgressSnapshot snapshot;
+    snapshot.running = tracker_.running();
+    snapshot.done = tracker_.done();
+    snapshot.total = tracker_.total();
+
+    auto run = tracker_.run();
+    if(run == 0){
+        return snapshot;
+    }
+    auto startedAt = tracker_.startedAt();
+    snapshot.elapsed = now - startedAt;
+
+    // New run: rate starts from scratch
+    if(run != run_){
+        run_ = run;
+        lastDone_ = 0;
+        lastAt_ = startedAt;
+        rate_ = 0.0;
+    }
+
+    double dt = std::chrono::duration<double>(now - lastAt_).count();
+    if(dt > 0.0 && snapshot.done >= lastDone_){
+        double instant = double(snapshot.done - lastDone_) / dt;
+        // First interval sets the rate, later ones are blended in
+        double alpha = rate_ == 0.0 ? 1.0 : 1.0 - std::exp(-dt / kRateWindow);
+        rate_ += alpha * (instant - rate_);
+        lastDone_ = snapshot.done;
+        lastAt_ = now;
+    }
+    snapshot.rate = rate_;
+
+    if(rate_ > 0.0 && snapshot.total >= snapshot.done){
+        snapshot.eta = std::chrono::seconds(
+            std::llround(double(snapshot.total - snapshot.done) / rate_));
+    }
+    return snapshot;
+}
@@ -2,6 +2,8 @@
 #include "SpotifyClient.hpp"
 #include "AuthorizationServer.hpp"
 #include "SpotifyIoService.hpp"
+#include "Trace.hpp"
+#include "TrackStream.hpp"
 
 #include <QDesktopServices>
 #include <QInputDialog>
@@ -11,6 +13,8 @@
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QDebug>
+#include <QStandardPaths>
+#include <QDir>
 
 #include <boost/asio/co_spawn.hpp>
 #include <boost/asio/detached.hpp>
@@ -25,6 +29,12 @@ QtSpotifyClient::QtSpotifyClient(QObject* parent)
     try {
         sp_client_ = std::make_unique<SpotifyClient>();
         qDebug() << "SpotifyClient created";
+
+        // Search results survive between runs
+        QString dataDir = QStandardPaths::writableLocation(
+            QStandardPaths::AppLocalDataLocation);
+        QDir().mkpath(dataDir);
+        sp_client_->setSearchCachePath((dataDir + "/search_cache.bin").toStdString());
     } catch (...) {
         qWarning() << "Failed to create SpotifyClient";
     }
@@ -54,6 +64,10 @@ QtSpotifyClient::~QtSpotifyClient(){
 }
 
 
+const ProgressTracker& QtSpotifyClient::progress() const{
+    return sp_client_->progress();
+}
+
 void QtSpotifyClient::setClientId(const QString& id){
     clientId_ = id;
     sp_client_->setClientId(id.toStdString());
@@ -68,14 +82,36 @@ void QtSpotifyClient::loadLocalJson(const QString& path){
     jsonPath_ = path;
 }
 
+std::shared_ptr<TrackStream> QtSpotifyClient::createTrackStream() const{
+    // Read by the import on the client strand
+    return std::make_shared<TrackStream>(sp_client_->executor());
+}
+
 void QtSpotifyClient::addTracks(){
     if (jsonPath_.isEmpty()) {
         emit logMessage("Error: enter path to JSON.");
         emit finishedAdding(false);
         return;
     }
+    startAdding(nullptr);
+}
+
+void QtSpotifyClient::addTracksFromStream(std::shared_ptr<TrackStream> stream){
+    if(!stream){
+        emit finishedAdding(false);
+        return;
+    }
+    startAdding(std::move(stream));
+}
+
+void QtSpotifyClient::startAdding(std::shared_ptr<TrackStream> stream){
+    stopRequested_ = false;
+    // Stop pressed from here on, even before the pipeline starts, ends it
+    sp_client_->reset();
 
-    if(!sp_client_->hasValidAccessToken()){
+    // Expired session is renewed in the pipeline, the browser is
+    // only needed without a refresh token
+    if(!sp_client_->hasValidAccessToken() && !sp_client_->hasRefreshToken()){
         emit reauthorization();
         authorization();
     }
@@ -83,13 +119,19 @@ void QtSpotifyClient::addTracks(){
 
     // Start corutine with pipeline
     boost::asio::co_spawn(
-        GlobalIoService::instance(),
-        [this]() -> boost::asio::awaitable<void>{
+        sp_client_->executor(),
+        [this, stream]() -> boost::asio::awaitable<void>{
             QPointer<QtSpotifyClient> safeThis(this);
             try{
+                if(!co_await renewAccessToken()){
+                    safeCall(safeThis, &QtSpotifyClient::logMessage,
+                             "Not authorized, start the import again after authorization");
+                    safeCall(safeThis, &QtSpotifyClient::finishedAdding, false);
+                    co_return;
+                }
                 safeCall(safeThis, &QtSpotifyClient::logMessage, "# Launch adding pipeline...");
                 qDebug() << "About async pipeline";
-                co_await runAsyncAddingPipeline();
+                co_await runAsyncAddingPipeline(stream);
             }
             catch(std::exception& e){
                 qWarning() << "Exception in auth/add pipeline: " << e.what();
@@ -101,21 +143,48 @@ void QtSpotifyClient::addTracks(){
     qDebug() << "co_spawn returned";
 }
 
-boost::asio::awaitable<void> QtSpotifyClient::runAsyncAddingPipeline(){
+boost::asio::awaitable<void> QtSpotifyClient::runAsyncAddingPipeline(std::shared_ptr<TrackStream> stream){
     QPointer<QtSpotifyClient> safeThis(this);
     qDebug() << "In runAsyncAddingPipeline";
+    TraceSpan span("adding pipeline");
     boost::asio::steady_timer t(co_await boost::asio::this_coro::executor, std::chrono::milliseconds(1));
     co_await t.async_wait(boost::asio::use_awaitable);
 
     try{
-        safeCall(safeThis, &QtSpotifyClient::logMessage, "# Liking tracks from json...");
-        co_await sp_client_->likeTracksFromJson(jsonPath_.toStdString(),
-            [this, safeThis](int current, int total){
-                safeCall(safeThis, &QtSpotifyClient::progress, current, total);
-                //safeCall(safeThis, &QtSpotifyClient::logMessage, QString("Added: %1/%2")
-                //    .arg(current).arg(total));
-            });
+        if(stopRequested_){
+            safeCall(safeThis, &QtSpotifyClient::logMessage, "Stopped before start");
+            safeCall(safeThis, &QtSpotifyClient::finishedAdding, false);
+            co_return;
+        }
+        // Progress is sampled by the window, not pushed per track
+        bool imported;
+        if(stream){
+            safeCall(safeThis, &QtSpotifyClient::logMessage, "# Liking tracks while they are exported...");
+            imported = co_await sp_client_->likeTracksFromStream(stream);
+        }
+        else{
+            safeCall(safeThis, &QtSpotifyClient::logMessage, "# Liking tracks from json...");
+            imported = co_await sp_client_->likeTracksFromJson(jsonPath_.toStdString());
+        }
 
+        if(sp_client_->cancelled()){
+            safeCall(safeThis, &QtSpotifyClient::logMessage, "Stopped");
+            safeCall(safeThis, &QtSpotifyClient::finishedAdding, false);
+            co_return;
+        }
+        // Exporter failed: what arrived is liked, the rest is missing
+        if(stream && !stream->complete()){
+            safeCall(safeThis, &QtSpotifyClient::logMessage,
+                     QString("Export ended early, %1 tracks were imported").arg(stream->received()));
+            safeCall(safeThis, &QtSpotifyClient::finishedAdding, false);
+            co_return;
+        }
+        if(!imported){
+            safeCall(safeThis, &QtSpotifyClient::logMessage,
+                     "Import is incomplete, start it again to resume");
+            safeCall(safeThis, &QtSpotifyClient::finishedAdding, false);
+            co_return;
+        }
         safeCall(safeThis, &QtSpotifyClient::logMessage, "Finished!");
         safeCall(safeThis, &QtSpotifyClient::finishedAdding, true);
     }
@@ -129,7 +198,12 @@ boost::asio::awaitable<void> QtSpotifyClient::runAsyncAddingPipeline(){
 
 
 void QtSpotifyClient::removeLastNTracks(const std::size_t n){
-    if(!sp_client_->hasValidAccessToken()){
+    stopRequested_ = false;
+    // Stop pressed from here on, even before the pipeline starts, ends it
+    sp_client_->reset();
+    // Expired session is renewed in the pipeline, the browser is
+    // only needed without a refresh token
+    if(!sp_client_->hasValidAccessToken() && !sp_client_->hasRefreshToken()){
         emit reauthorization();
         authorization();
     }
@@ -137,10 +211,16 @@ void QtSpotifyClient::removeLastNTracks(const std::size_t n){
     // Start corutine with pipeline
 
     boost::asio::co_spawn(
-        GlobalIoService::instance(),
+        sp_client_->executor(),
         [this, n]() -> boost::asio::awaitable<void>{
             QPointer<QtSpotifyClient> safeThis(this);
             try{
+                if(!co_await renewAccessToken()){
+                    safeCall(safeThis, &QtSpotifyClient::logMessage,
+                             "Not authorized, start the removal again after authorization");
+                    safeCall(safeThis, &QtSpotifyClient::finishedRemoving, false);
+                    co_return;
+                }
                 safeCall(safeThis, &QtSpotifyClient::logMessage, "# Launch removing pipeline...");
                 qDebug() << "About async pipeline";
                 co_await runAsyncRemovingPipeline(n);
@@ -157,17 +237,30 @@ void QtSpotifyClient::removeLastNTracks(const std::size_t n){
 boost::asio::awaitable<void> QtSpotifyClient::runAsyncRemovingPipeline(const std::size_t n){
     QPointer<QtSpotifyClient> safeThis(this);
     qDebug() << "In runAsyncRemovingPipeline";
+    TraceSpan span("removing pipeline");
     boost::asio::steady_timer t(co_await boost::asio::this_coro::executor, std::chrono::milliseconds(1));
     co_await t.async_wait(boost::asio::use_awaitable);
 
     try{
+        if(stopRequested_){
+            safeCall(safeThis, &QtSpotifyClient::logMessage, "Stopped before start");
+            safeCall(safeThis, &QtSpotifyClient::finishedRemoving, false);
+            co_return;
+        }
         safeCall(safeThis, &QtSpotifyClient::logMessage, "# Removing tracks from \"Liked Library\"...");
-        co_await sp_client_->removeLastN(n,
-            [this, safeThis](int current, int total){
-                safeCall(safeThis, &QtSpotifyClient::progress, current, total);
-                //safeCall(safeThis, &QtSpotifyClient::logMessage, QString("Removed: %1/%2")                                                                                            .arg(current).arg(total));
-        });
+        bool removed = co_await sp_client_->removeLastN(n);
 
+        if(sp_client_->cancelled()){
+            safeCall(safeThis, &QtSpotifyClient::logMessage, "Stopped");
+            safeCall(safeThis, &QtSpotifyClient::finishedRemoving, false);
+            co_return;
+        }
+        if(!removed){
+            safeCall(safeThis, &QtSpotifyClient::logMessage,
+                     QString("Removal failed, %1 tracks were removed").arg(sp_client_->progress().done()));
+            safeCall(safeThis, &QtSpotifyClient::finishedRemoving, false);
+            co_return;
+        }
         safeCall(safeThis, &QtSpotifyClient::logMessage, "Finished!");
         safeCall(safeThis, &QtSpotifyClient::finishedRemoving, true);
     }
@@ -179,6 +272,50 @@ boost::asio::awaitable<void> QtSpotifyClient::runAsyncRemovingPipeline(const std
     co_return;
 }
 
+void QtSpotifyClient::stop(){
+    stopRequested_ = true;
+    sp_client_->cancel();
+    // Authorization server runs on the client strand
+    if(authSrv_){
+        boost::asio::post(sp_client_->executor(), [srv = authSrv_.get()]{
+            srv->cancel();
+        });
+    }
+}
+
+void QtSpotifyClient::pause(){
+    sp_client_->pause();
+}
+
+void QtSpotifyClient::resume(){
+    sp_client_->resume();
+}
+
+boost::asio::awaitable<bool> QtSpotifyClient::renewAccessToken(){
+    QPointer<QtSpotifyClient> safeThis(this);
+    if(sp_client_->hasValidAccessToken()){
+        co_return true;
+    }
+    // No session at all: the browser was opened when the pipeline started
+    if(!sp_client_->hasRefreshToken()){
+        co_return false;
+    }
+    safeCall(safeThis, &QtSpotifyClient::logMessage, "# Refreshing access token...");
+    if(co_await sp_client_->refreshAccessToken()){
+        co_return true;
+    }
+    // Refresh token is gone: back to the browser
+    safeCall(safeThis, &QtSpotifyClient::logMessage, "Token refresh failed, authorize again.");
+    safeCall(safeThis, &QtSpotifyClient::reauthorization);
+    if(safeThis){
+        // Browser and auth server are driven from the GUI thread
+        QMetaObject::invokeMethod(safeThis.data(), [self = safeThis.data()]{
+            self->authorization();
+        }, Qt::QueuedConnection);
+    }
+    co_return false;
+}
+
 void QtSpotifyClient::authorization(){
     if(clientId_.isEmpty() ||
         redirectUri_.isEmpty()){
@@ -193,12 +330,21 @@ void QtSpotifyClient::authorization(){
     qDebug() << "Browser opened, now co_spawn";
 
     boost::asio::co_spawn(
-        GlobalIoService::instance(),
+        sp_client_->executor(),
         [this]() -> boost::asio::awaitable<void>{
             QPointer<QtSpotifyClient> safeThis(this);
+            TraceSpan span("authorization");
             try{
                 safeCall(safeThis, &QtSpotifyClient::logMessage, "# Launch authorization server...");
+                std::optional<TraceSpan> waitSpan(std::in_place, "authorization code", span.lane());
                 std::string code = co_await authSrv_->asyncGetAuthorizationCode();
+                waitSpan.reset();
+                if(code.empty()){
+                    // Timed out or stopped
+                    safeCall(safeThis, &QtSpotifyClient::logMessage, "Authorization was not completed");
+                    safeCall(safeThis, &QtSpotifyClient::finishedAuthorization, false);
+                    co_return;
+                }
                 qDebug() << "About write code to client";
                 safeCall(safeThis, &QtSpotifyClient::logMessage, "# Changing code to token...");
                 sp_client_->setAuthorizationCode(code);
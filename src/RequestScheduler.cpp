@@ -0,0 +1,187 @@
+#include "RequestScheduler.hpp"
+#include "SpotifyIoService.hpp"
+#include <algorithm>
+#include <QDebug>
+
+
+RequestScheduler::Ticket& RequestScheduler::Ticket::operator=(Ticket&& other) noexcept{
+    if(this != &other){
+        if(owner_){
+            owner_->release();
+        }
+        owner_ = std::exchange(other.owner_, nullptr);
+    }
+    return *this;
+}
+
+RequestScheduler::Ticket::~Ticket(){
+    if(owner_){
+        owner_->release();
+    }
+}
+
+
+RequestScheduler::RequestScheduler() :
+    RequestScheduler(Options{})
+{}
+
+RequestScheduler::RequestScheduler(Options options) :
+    RequestScheduler(GlobalIoService::instance(), options)
+{}
+
+RequestScheduler::RequestScheduler(boost::asio::io_context& io, Options options) :
+    options_(options)
+    , strand_(boost::asio::make_strand(io))
+    , limit_(std::clamp(options.initialConcurrency,
+                        options.minConcurrency, options.maxConcurrency))
+{}
+
+RequestScheduler::FlowId RequestScheduler::addFlow(double weight, Priority priority,
+                                                   const PipelineControl* control){
+    auto id = nextFlowId_++;
+    setFlowShare(id, weight, priority);
+    if(control){
+        boost::asio::post(strand_, [this, id, control]{
+            flows_[id].control = control;
+        });
+    }
+    return id;
+}
+
+void RequestScheduler::setFlowShare(FlowId id, double weight, Priority priority){
+    // Posted before any acquire() of the flow from the same thread
+    boost::asio::post(strand_, [this, id, weight, priority]{
+        auto& flow = flows_[id];
+        flow.weight = weight > 0.0 ? weight : 1.0;
+        flow.priority = priority;
+    });
+}
+
+void RequestScheduler::removeFlow(FlowId id){
+    boost::asio::post(strand_, [this, id]{
+        auto it = flows_.find(id);
+        if(it != flows_.end() && it->second.waiting == 0){
+            flows_.erase(it);
+        }
+    });
+}
+
+void RequestScheduler::interrupt(FlowId id){
+    boost::asio::post(strand_, [this, id]{
+        if(auto it = flows_.find(id); it != flows_.end()){
+            it->second.waiters.notifyAll();
+            it->second.paused.notifyAll();
+        }
+    });
+}
+
+boost::asio::awaitable<RequestScheduler::Ticket> RequestScheduler::acquire(FlowId flow){
+    using namespace boost::asio;
+    // Caller resumes on its own executor
+    co_return co_await co_spawn(strand_, waitSlot(flow), use_awaitable);
+}
+
+RequestScheduler::Flow* RequestScheduler::nextFlow(){
+    Flow* best = nullptr;
+    for(auto& [id, flow] : flows_){
+        if(flow.waiting == 0){
+            continue;
+        }
+        if(!best || flow.priority > best->priority
+           || (flow.priority == best->priority && flow.tag < best->tag)){
+            best = &flow;
+        }
+    }
+    return best;
+}
+
+void RequestScheduler::wakeNext(){
+    if(auto* flow = nextFlow()){
+        flow->waiters.notifyOne();
+    }
+}
+
+boost::asio::awaitable<RequestScheduler::Ticket> RequestScheduler::waitSlot(FlowId id){
+    using namespace boost::asio;
+
+    auto& flow = flows_[id];
+    // Idle flow does not bank credit for the time it was idle
+    if(flow.waiting++ == 0){
+        flow.tag = std::max(flow.tag, virtualTime_);
+    }
+
+    while(true){
+        // Stopped pipeline leaves the queue, its turn goes to the next flow
+        if(flow.control && flow.control->cancelled()){
+            --flow.waiting;
+            if(inFlight_ < limit_){
+                wakeNext();
+            }
+            co_return Ticket{};
+        }
+
+        // Whole client sleeps out the Retry-After, interrupt() wakes it early
+        if(std::chrono::steady_clock::now() < pausedUntil_){
+            co_await flow.paused.waitUntil(pausedUntil_);
+            continue;
+        }
+
+        if(inFlight_ < limit_){
+            if(nextFlow() == &flow){
+                break;
+            }
+            // Slot belongs to another flow
+            wakeNext();
+        }
+        co_await flow.waiters.wait();
+    }
+
+    --flow.waiting;
+    ++inFlight_;
+    virtualTime_ = flow.tag;
+    flow.tag += 1.0 / flow.weight;
+    // Slots left: next flow goes on
+    if(inFlight_ < limit_){
+        wakeNext();
+    }
+    co_return Ticket{this};
+}
+
+void RequestScheduler::release(){
+    boost::asio::post(strand_, [this]{
+        --inFlight_;
+        wakeNext();
+    });
+}
+
+void RequestScheduler::onSuccess(){
+    boost::asio::post(strand_, [this]{
+        // Additive increase: one more slot per window of `limit_` successes
+        if(++successes_ < limit_ || limit_ >= options_.maxConcurrency){
+            return;
+        }
+        successes_ = 0;
+        ++limit_;
+        wakeNext();
+    });
+}
+
+void RequestScheduler::onRateLimited(std::chrono::seconds retryAfter){
+    if(retryAfter.count() <= 0){
+        retryAfter = options_.defaultRetryAfter;
+    }
+
+    // Pause is taken before the request is retried: the retry goes
+    // through acquire() on the same strand after this handler
+    boost::asio::post(strand_, [this, retryAfter]{
+        auto now = std::chrono::steady_clock::now();
+        // Lanes in flight get 429 together: decrease once per pause
+        if(now >= pausedUntil_){
+            limit_ = std::max(options_.minConcurrency, limit_ / 2);
+            successes_ = 0;
+            qWarning() << "Rate limited, pausing for" << retryAfter.count()
+                       << "s, concurrency ->" << std::size_t(limit_);
+        }
+        pausedUntil_ = std::max(pausedUntil_, now + retryAfter);
+    });
+}
@@ -0,0 +1,91 @@
+#include "RetryPolicy.hpp"
+#include <algorithm>
+#include <random>
+#include <boost/asio/error.hpp>
+#include <boost/asio/ssl/error.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/http/error.hpp>
+
+namespace {
+constexpr double kMilli = 1000.0;
+}
+
+
+RetryPolicy::RetryPolicy() : RetryPolicy(Options{}) {}
+
+RetryPolicy::RetryPolicy(Options options) :
+    options_(options)
+    , budget_(std::int64_t(options.budgetMin * kMilli))
+{}
+
+RetryPolicy::Idempotency RetryPolicy::classify(boost::beast::http::verb method){
+    using boost::beast::http::verb;
+    switch(method){
+    case verb::get:
+    case verb::head:
+    case verb::put:
+    case verb::delete_:
+    case verb::options:
+        return Idempotency::Idempotent;
+    default:
+        return Idempotency::NotIdempotent;
+    }
+}
+
+bool RetryPolicy::transient(const boost::system::error_code& ec){
+    namespace error = boost::asio::error;
+    // operation_aborted is a stop, not a fault
+    return ec == error::connection_reset
+        || ec == error::connection_refused
+        || ec == error::connection_aborted
+        || ec == error::timed_out
+        || ec == error::host_unreachable
+        || ec == error::network_unreachable
+        || ec == error::network_down
+        || ec == error::network_reset
+        || ec == error::host_not_found_try_again
+        || ec == error::eof
+        || ec == error::broken_pipe
+        || ec == boost::asio::ssl::error::stream_truncated
+        || ec == boost::beast::error::timeout
+        || ec == boost::beast::http::error::end_of_stream
+        || ec == boost::beast::http::error::partial_message;
+}
+
+bool RetryPolicy::transient(unsigned status){
+    return status == 500 || status == 502 || status == 503 || status == 504;
+}
+
+void RetryPolicy::onRequest(){
+    auto max = std::int64_t(options_.budgetMax * kMilli);
+    auto refill = std::int64_t(options_.budgetRatio * kMilli);
+    auto budget = budget_.load(std::memory_order_relaxed);
+    while(budget < max
+          && !budget_.compare_exchange_weak(budget, std::min(max, budget + refill),
+                                            std::memory_order_relaxed)){
+    }
+}
+
+bool RetryPolicy::allowRetry(int attempt){
+    if(attempt >= options_.maxAttempts){
+        return false;
+    }
+    auto cost = std::int64_t(kMilli);
+    auto budget = budget_.load(std::memory_order_relaxed);
+    while(budget >= cost){
+        if(budget_.compare_exchange_weak(budget, budget - cost, std::memory_order_relaxed)){
+            return true;
+        }
+    }
+    return false;
+}
+
+std::chrono::milliseconds RetryPolicy::backoff(int attempt) const{
+    // One generator per io thread, no lock
+    thread_local std::minstd_rand random{std::random_device{}()};
+    auto shift = std::clamp(attempt - 1, 0, 20);
+    auto ceiling = std::min<std::int64_t>(options_.maxDelay.count(),
+                                          options_.baseDelay.count() << shift);
+    std::uniform_int_distribution<std::int64_t> pick(0, std::max<std::int64_t>(ceiling, 0));
+    return std::chrono::milliseconds(pick(random));
+}
@@ -0,0 +1,282 @@
+#include "SearchCache.hpp"
+#include "Fnv1a.hpp"
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <QDebug>
+#include <QString>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace {
+// File header: magic + version, then kTrackKeyVersion of the keys
+constexpr char kMagic[8] = {'E', 'L', 'S', 'C', 'A', 'C', 'H', '2'};
+// Version 1 had the magic only, its keys are of key version 1
+constexpr char kMagicV1[8] = {'E', 'L', 'S', 'C', 'A', 'C', 'H', '1'};
+
+struct Header{
+    char magic[8];
+    std::uint32_t keyVersion;
+    std::uint32_t reserved;
+};
+
+void writeHeader(std::ofstream& out){
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.keyVersion = kTrackKeyVersion;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+// Flush after this many new results
+constexpr std::size_t kFlushEvery = 256;
+
+std::int64_t nowSeconds(){
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+}
+
+std::string normalizeTrackText(const std::string& text){
+    QString folded = QString::fromStdString(text)
+        .normalized(QString::NormalizationForm_KC)
+        .toCaseFolded();
+
+    // Letters and digits stay, everything else becomes a single space
+    QString out;
+    out.reserve(folded.size());
+    bool space = false;
+    for(QChar c : folded){
+        if(c.isLetterOrNumber()){
+            if(space && !out.isEmpty()){
+                out.append(QChar(' '));
+            }
+            out.append(c);
+            space = false;
+        }
+        else{
+            space = true;
+        }
+    }
+    return out.toStdString();
+}
+
+std::uint64_t trackKey(const std::string& artist, const std::string& title){
+    return trackKeyOfTitle(artistKeyPrefix(artist), title);
+}
+
+std::uint64_t artistKeyPrefix(const std::string& artist){
+    auto hash = fnv1a(normalizeTrackText(artist));
+    // Unit separator: ("ab", "c") != ("a", "bc")
+    return fnv1a("\x1f", hash);
+}
+
+std::uint64_t trackKeyOfTitle(std::uint64_t artistPrefix, const std::string& title){
+    return fnv1a(normalizeTrackText(title), artistPrefix);
+}
+
+
+SearchCache::SearchCache(std::string path, std::chrono::seconds negativeTtl) :
+    path_(std::move(path))
+    , negativeTtl_(negativeTtl)
+{
+    try{
+        load();
+    }
+    catch(std::exception& e){
+        qWarning() << "Search cache is not loaded:" << e.what();
+        entries_.clear();
+        recordsOnDisk_ = 0;
+        readOnly_ = true;
+    }
+}
+
+SearchCache::~SearchCache(){
+    try{
+        // Most of the file is dead records: rewrite
+        if(recordsOnDisk_ + pending_.size() > 2 * entries_.size() + kFlushEvery
+            && compact()){
+            return;
+        }
+        appendPending();
+    }
+    catch(std::exception& e){
+        qWarning() << "Error in saving search cache:" << e.what();
+    }
+}
+
+std::optional<std::string> SearchCache::find(std::uint64_t key) const{
+    std::lock_guard lock(mutex_);
+    auto it = entries_.find(key);
+    if(it == entries_.end()){
+        return std::nullopt;
+    }
+    // Spotify catalogue grows: "not found" is only trusted for a while
+    if(it->second.id.empty() && nowSeconds() - it->second.storedAt > negativeTtl_.count()){
+        return std::nullopt;
+    }
+    return it->second.id;
+}
+
+void SearchCache::store(std::uint64_t key, const std::string& id){
+    Record rec{};
+    rec.key = key;
+    rec.storedAt = nowSeconds();
+    std::memcpy(rec.id, id.data(), std::min(id.size(), sizeof(rec.id)));
+
+    std::lock_guard lock(mutex_);
+    entries_[key] = Entry{id, rec.storedAt};
+    pending_.push_back(rec);
+    if(pending_.size() >= kFlushEvery){
+        appendPending();
+    }
+}
+
+void SearchCache::flush(){
+    std::lock_guard lock(mutex_);
+    appendPending();
+}
+
+std::size_t SearchCache::size() const{
+    std::lock_guard lock(mutex_);
+    return entries_.size();
+}
+
+void SearchCache::appendPending(){
+    if(pending_.empty()){
+        return;
+    }
+    if(readOnly_){
+        pending_.clear();
+        return;
+    }
+    // Old format or stale keys on disk: replace the file, never append
+    if(rewrite_){
+        compact();
+        return;
+    }
+
+    bool fresh = recordsOnDisk_ == 0;
+    std::ofstream out(path_, std::ios::binary | (fresh ? std::ios::trunc : std::ios::app));
+    if(!out){
+        qWarning() << "Unable to open search cache:" << QString::fromStdString(path_);
+        return;
+    }
+    if(fresh){
+        writeHeader(out);
+    }
+    out.write(reinterpret_cast<const char*>(pending_.data()),
+              std::streamsize(pending_.size() * sizeof(Record)));
+    recordsOnDisk_ += pending_.size();
+    pending_.clear();
+}
+
+void SearchCache::load(){
+    namespace bip = boost::interprocess;
+
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path_, ec);
+    if(ec || size == 0){
+        return;
+    }
+
+    std::size_t headerSize;
+    std::size_t count;
+    {
+        bip::file_mapping file(path_.c_str(), bip::read_only);
+        bip::mapped_region region(file, bip::read_only);
+        auto* data = static_cast<const char*>(region.get_address());
+
+        // A short file may be ours, torn while the header was written
+        auto head = std::min<std::size_t>(size, sizeof(kMagic));
+        bool legacy = std::memcmp(data, kMagicV1, head) == 0;
+        if(!legacy && std::memcmp(data, kMagic, head) != 0){
+            qWarning() << "Search cache path holds another file, cache is off:"
+                       << QString::fromStdString(path_);
+            readOnly_ = true;
+            return;
+        }
+        headerSize = legacy ? sizeof(kMagicV1) : sizeof(Header);
+        if(size < headerSize){
+            rewrite_ = true;
+            return;
+        }
+
+        std::uint32_t keyVersion = 1;
+        if(!legacy){
+            std::memcpy(&keyVersion, data + offsetof(Header, keyVersion), sizeof(keyVersion));
+        }
+        // Ids of other keys would be given to the wrong tracks
+        if(keyVersion != kTrackKeyVersion){
+            qDebug() << "Search cache keys are of version" << keyVersion << ", starting empty";
+            rewrite_ = true;
+            return;
+        }
+        rewrite_ = legacy;
+
+        count = (size - headerSize) / sizeof(Record);
+        entries_.reserve(count);
+        for(std::size_t i = 0; i < count; ++i){
+            Record rec;
+            std::memcpy(&rec, data + headerSize + i * sizeof(Record), sizeof(Record));
+            // Later records override earlier ones
+            entries_[rec.key] = Entry{std::string(rec.id, strnlen(rec.id, sizeof(rec.id))),
+                                      rec.storedAt};
+        }
+    }
+    recordsOnDisk_ = count;
+
+    // Torn tail after a crash: cut it so appends stay aligned
+    auto aligned = headerSize + count * sizeof(Record);
+    if(!rewrite_ && aligned != size){
+        std::filesystem::resize_file(path_, aligned);
+    }
+    qDebug() << "Search cache loaded:" << entries_.size() << "entries";
+}
+
+bool SearchCache::compact(){
+    if(readOnly_){
+        return false;
+    }
+    std::vector<Record> live;
+    live.reserve(entries_.size());
+    auto now = nowSeconds();
+    for(const auto& [key, entry] : entries_){
+        // Expired "not found" answers are dropped
+        if(entry.id.empty() && now - entry.storedAt > negativeTtl_.count()){
+            continue;
+        }
+        Record rec{};
+        rec.key = key;
+        rec.storedAt = entry.storedAt;
+        std::memcpy(rec.id, entry.id.data(), std::min(entry.id.size(), sizeof(rec.id)));
+        live.push_back(rec);
+    }
+
+    // Write aside and swap, so a crash keeps the old file.
+    // Pending records stay pending until the new file is in place
+    auto tmpPath = path_ + ".tmp";
+    std::error_code ec;
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        writeHeader(out);
+        out.write(reinterpret_cast<const char*>(live.data()),
+                  std::streamsize(live.size() * sizeof(Record)));
+        out.close();
+        if(!out){
+            qWarning() << "Unable to write search cache:" << QString::fromStdString(tmpPath);
+            std::filesystem::remove(tmpPath, ec);
+            return false;
+        }
+    }
+    std::filesystem::rename(tmpPath, path_, ec);
+    if(ec){
+        qWarning() << "Unable to replace search cache:" << QString::fromStdString(ec.message());
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    recordsOnDisk_ = live.size();
+    pending_.clear();
+    rewrite_ = false;
+    return true;
+}
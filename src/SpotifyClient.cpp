@@ -1,12 +1,20 @@
 #include "SpotifyClient.hpp"
 #include "HelperPKCE.hpp"
+#include "AsyncPrimitives.hpp"
+#include "TrackReader.hpp"
+#include "TrackList.hpp"
+#include "TrackStream.hpp"
+#include "LibrarySnapshot.hpp"
+#include "UrlEncode.hpp"
+#include "JsonScan.hpp"
 #include <sstream>
+#include <deque>
+#include <unordered_set>
+#include <optional>
+#include <memory>
+#include <future>
+#include <limits>
 #include <QDebug>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonArray>
-#include <QFile>
-#include <QIODevice>
 #include <QString>
 #include <boost/beast/ssl.hpp>
 #include <boost/beast/http.hpp>
@@ -15,50 +23,55 @@
 
 
 SpotifyClient::SpotifyClient() :
-    resolver_(GlobalIoService::instance())
-    , ssl_ctx_(boost::asio::ssl::context::tls_client)
-{
-    // Off old protocols and compression
-    ssl_ctx_.set_options(
-        boost::asio::ssl::context::default_workarounds
-        | boost::asio::ssl::context::no_sslv2
-        | boost::asio::ssl::context::no_sslv3
-        | boost::asio::ssl::context::single_dh_use
-        );
-    // Optionally on OpenSSL level off the compression
-    SSL_CTX_set_options(
-        ssl_ctx_.native_handle(),
-        SSL_OP_NO_COMPRESSION
-        );
-
-    ssl_ctx_.set_default_verify_paths();
-
-    // Load CA bundle (certificates)
-    boost::system::error_code ec;
-    ssl_ctx_.load_verify_file("cacert.pem", ec);
-    if (ec) {
-        qWarning() << "Unable to load CA bundle:" << QString::fromStdString(ec.message());
-    }
-}
+    SpotifyClient(std::make_shared<SpotifyTransport>())
+{}
+
+SpotifyClient::SpotifyClient(std::shared_ptr<SpotifyTransport> transport) :
+    transport_(std::move(transport))
+    , pool_(transport_->pool())
+    , scheduler_(transport_->scheduler())
+    , retry_(transport_->retry())
+    , metrics_(transport_->metrics())
+    , flow_(scheduler_.addFlow(1.0, RequestScheduler::Priority::Bulk, &control_))
+    , strand_(boost::asio::make_strand(GlobalIoService::instance()))
+{}
 
 SpotifyClient::~SpotifyClient(){
-    //shoutdown();
+    using namespace boost::asio;
+    // Pipelines, lanes and the token refresh loop hold this: stop them
+    // and wait for the last one. Returned leases and tickets are then
+    // posted to the pool and scheduler strands: let them run before
+    // the members go away. Client is never destroyed on an io thread
+    std::promise<void> returned;
+    cancel();
+    co_spawn(strand_,
+        [this, &returned]() -> awaitable<void>{
+            // Token refresh loop ends on its next turn
+            stopping_ = true;
+            refreshWake_.notifyAll();
+            co_await running_.wait();
+            post(pool_.executor(), [this, &returned]{
+                post(scheduler_.executor(), [&returned]{ returned.set_value(); });
+            });
+        },
+        detached);
+    returned.get_future().wait();
+    scheduler_.removeFlow(flow_);
     qDebug() << "Destructor client";
 }
 
 
-std::string SpotifyClient::encodeURL(const std::string& val){
-    std::ostringstream encoded;
-    for (unsigned char c : val){
-        if (std::isalnum(c) || c == '_' ||
-            c == '-' || c == '.' || c == '~'){
-            encoded << c;
-        }
-        else{
-            encoded << '%' << std::uppercase << std::hex << int(c);
-        }
+void SpotifyClient::releaseConnections(){
+    // Connections of a shared transport serve the other jobs too
+    if(transport_.use_count() == 1){
+        pool_.closeIdle();
     }
-    return encoded.str();
+}
+
+std::string SpotifyClient::encodeURL(const std::string& val){
+    std::string encoded;
+    appendUrlEncoded(encoded, val);
+    return encoded;
 }
 
 std::string SpotifyClient::authorize(){
@@ -70,7 +83,10 @@ std::string SpotifyClient::authorize(){
 
     // Make url
     auto scope = encodeURL("user-library-modify user-library-read");
-    std::string url = "https://accounts.spotify.com/authorize?"
+    std::string url = (endpoints_.useTls ? "https://" : "http://")
+        + endpoints_.accountsHost
+        + (endpoints_.accountsPort == "443" ? "" : ":" + endpoints_.accountsPort)
+        + "/authorize?"
         "response_type=code"
         "&client_id=" + encodeURL(clientId_)
         + "&redirect_uri=" + encodeURL(redirectUri_)
@@ -81,350 +97,941 @@ std::string SpotifyClient::authorize(){
     return url;
 }
 
-static void configure_stream(boost::beast::ssl_stream<boost::beast::tcp_stream>& stream, char const* host)
-{
-    stream.set_verify_mode(boost::asio::ssl::verify_peer);
-
-#ifdef DEBUG
-    // только для отладки:
-    stream.set_verify_callback(
-        [](bool pre, ssl::verify_context& ctx) {
-            X509_STORE_CTX* c = ctx.native_handle();
-            int depth = X509_STORE_CTX_get_error_depth(c);
-            int err   = X509_STORE_CTX_get_error(c);
-            qDebug() << "SSL verify: depth=" << depth
-                     << "err=" << err
-                     << "(" << X509_verify_cert_error_string(err) << ")"
-                     << "pre=" << pre;
-            return pre;
-        }
-        );
-#endif
+namespace {
+// Upper bound for write + read of one request
+constexpr auto kRequestTimeout = std::chrono::seconds(30);
+
+// Marks the progress run finished on every way out
+struct ProgressRun{
+    ProgressTracker& tracker;
+    ~ProgressRun() { tracker.finish(); }
+};
+
+// Counts a coroutine as running while it lives, on the strand of the group
+struct RunningScope{
+    explicit RunningScope(AsyncWaitGroup& group) : group(group) { group.add(); }
+    ~RunningScope() { group.done(); }
+    AsyncWaitGroup& group;
+};
+
+// Token is refreshed this long before it expires (at most a fifth of its lifetime)
+constexpr auto kTokenRefreshLead = std::chrono::seconds(300);
+
+// Pause after a failed background refresh
+constexpr auto kTokenRefreshRetry = std::chrono::seconds(30);
+
+// Found ids waiting for the like stage (4 batches)
+constexpr std::size_t kLikeQueueCapacity = 200;
+
+// Errors of a reused connection that the server closed while it was idle
+bool isStaleConnectionError(const boost::system::error_code& ec){
+    return ec == boost::asio::error::eof
+        || ec == boost::asio::error::connection_reset
+        || ec == boost::asio::error::broken_pipe
+        || ec == boost::asio::ssl::error::stream_truncated
+        || ec == boost::beast::http::error::end_of_stream;
+}
 
-    // SNI
-    if (!SSL_set_tlsext_host_name(stream.native_handle(), host)) {
-        throw boost::system::system_error{boost::asio::error::invalid_argument};
+// Seconds from Retry-After, 0 when absent or not a number
+std::chrono::seconds retryAfter(const boost::beast::http::response<boost::beast::http::string_body>& res){
+    auto it = res.find(boost::beast::http::field::retry_after);
+    if(it == res.end()){
+        return std::chrono::seconds{0};
+    }
+    try{
+        return std::chrono::seconds{std::stol(std::string(it->value()))};
+    }
+    catch(std::exception&){
+        return std::chrono::seconds{0};
     }
 }
+}
 
-boost::asio::awaitable<void> SpotifyClient::fetchTokens(std::string code){
+boost::asio::awaitable<SpotifyClient::Response> SpotifyClient::sendRequest(
+    Service service, boost::beast::http::verb method, const std::string& target,
+    std::string body, const char* contentType){
     using namespace boost::asio;
     using namespace boost::beast;
-    try{
-        // Make POST body
-        std::ostringstream oss;
-        oss << "grant_type=authorization_code"
-            << "&code=" << encodeURL(code)
-            << "&redirect_uri=" << encodeURL(redirectUri_)
-            << "&client_id=" << encodeURL(clientId_)
-            << "&code_verifier=" << encodeURL(codeVerifier_);
-
-        const auto body = oss.str();
-        auto& io_ctx = GlobalIoService::instance();
-
-        // Resolving
-        auto endpoints = co_await resolver_
-            .async_resolve("accounts.spotify.com","443", use_awaitable);
-
-        // SSL-stream
-        ssl_stream<tcp_stream> stream{io_ctx, ssl_ctx_};
-        configure_stream(stream, "accounts.spotify.com");
-
-
-        // TCP connetcion
-        co_await get_lowest_layer(stream)
-            .async_connect(endpoints, use_awaitable);
-
-        // Handshake
-        co_await stream
-            .async_handshake(ssl::stream_base::client, use_awaitable);
-
-        // Form POST-request
-        http::request<http::string_body> req{http::verb::post, "/api/token", 11};
-        req.set(http::field::host, "accounts.spotify.com");
-        req.set(http::field::user_agent, "ExportLikes/1.0");
-        req.set(http::field::content_type, "application/x-www-form-urlencoded");
-        req.set(http::field::content_length, std::to_string(body.size()));
-        req.body() = body;
-        req.prepare_payload();
-
-        // Send request
-        co_await async_write(stream, req, use_awaitable);
-
-        // Prepare buffer and response
-        flat_buffer buf;
-        http::response<http::string_body> res;
-
-        // Get response
-        co_await http::async_read(stream, buf, res, use_awaitable);
 
-        // Close session
-        error_code ec;
-        co_await stream.async_shutdown(redirect_error(use_awaitable, ec));
-        if(ec == boost::asio::error::eof ||
-            ec == boost::asio::ssl::error::stream_truncated){
-            ec.clear();
+    const auto& host = service == Service::Api ? endpoints_.apiHost : endpoints_.accountsHost;
+    const auto& port = service == Service::Api ? endpoints_.apiPort : endpoints_.accountsPort;
+
+    // Form request
+    Request req{method, target, 11};
+    req.set(http::field::host, host);
+    req.set(http::field::user_agent, "ExportLikes/1.0");
+    // Token the request carries, to tell a stale token from a rejected one
+    std::uint64_t generation = 0;
+    auto authorize = [&]{
+        // Header value is built once per token
+        std::lock_guard lock(tokenMutex_);
+        req.set(http::field::authorization, authorizationHeader_);
+        generation = tokenGeneration_;
+    };
+    if(service == Service::Api){
+        authorize();
+    }
+    if(contentType){
+        req.set(http::field::content_type, contentType);
+    }
+    req.body() = std::move(body);
+    req.keep_alive(true);
+    req.prepare_payload();
+
+    auto endpoint = Metrics::classify(method, target);
+    StageTimer total(metrics_, endpoint, Metrics::Stage::Total);
+    TraceSpan span(Metrics::name(endpoint), 0, target);
+    auto countResponse = [&](const Response& res){
+        metrics_.add(endpoint, Metrics::Counter::Requests);
+        if(res.result() == http::status::too_many_requests){
+            metrics_.add(endpoint, Metrics::Counter::RateLimited);
         }
-        if(ec){
-            throw system_error{ec};
+        else if(res.result_int() >= 500){
+            metrics_.add(endpoint, Metrics::Counter::ServerErrors);
         }
+    };
 
-        // Parse JSON-response
-        QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromStdString(res.body()));
-        if(!doc.isObject()){
-            qDebug() << "Invalid token response\n";
-            co_return;
+    try{
+        // Accounts service has its own limits
+        if(service != Service::Api){
+            auto res = co_await roundTrip(host, port, req, endpoint, span.lane());
+            countResponse(res);
+            co_return res;
         }
 
-        QJsonObject obj = doc.object();
-        accessToken_ = obj["access_token"].toString().toStdString();
-        refreshToken_ = obj["refresh_token"].toString().toStdString();
-        int expiresIn = obj["expires_in"].toInt();
-        tokenExpiry_ = std::chrono::steady_clock::now() + std::chrono::seconds(expiresIn);
-
-        qDebug() << "Access token received.";
-        //qDebug() << "tokenExpiry_ = " << expiresIn;
+        bool refreshed = false;
+        bool idempotent = RetryPolicy::classify(method) == RetryPolicy::Idempotency::Idempotent;
+        // Backoff after a transient fault, waited without a scheduler slot
+        std::chrono::milliseconds delay{0};
+        for(int attempt = 1;; ++attempt){
+            if(delay.count() > 0){
+                TraceSpan backoffSpan("backoff", span.lane());
+                steady_timer timer(co_await this_coro::executor, delay);
+                co_await timer.async_wait(use_awaitable);
+                delay = std::chrono::milliseconds{0};
+            }
+            // Stopped pipeline sends nothing new, paused one waits here
+            if(!co_await control_.proceed()){
+                throw boost::system::system_error(error::operation_aborted);
+            }
+            auto queued = std::chrono::steady_clock::now();
+            std::optional<TraceSpan> queueSpan(std::in_place, "queue", span.lane());
+            auto ticket = co_await scheduler_.acquire(flow_);
+            queueSpan.reset();
+            // Stop came while queued or during a rate limit pause
+            if(!ticket || control_.cancelled()){
+                throw boost::system::system_error(error::operation_aborted);
+            }
+            auto start = std::chrono::steady_clock::now();
+            metrics_.record(endpoint, Metrics::Stage::Queue, start - queued);
+            retry_.onRequest();
+
+            // Reset, refused or timed out: repeat an idempotent request
+            // after a backoff. No co_await in a handler, the fault is kept
+            Response res;
+            boost::system::error_code fault;
+            try{
+                res = co_await roundTrip(host, port, req, endpoint, span.lane());
+            }
+            catch(boost::system::system_error& e){
+                if(!idempotent || !RetryPolicy::transient(e.code())){
+                    throw;
+                }
+                fault = e.code();
+            }
+            if(fault){
+                if(!retry_.allowRetry(attempt)){
+                    metrics_.add(endpoint, Metrics::Counter::RetriesDenied);
+                    qWarning() << "Giving up after" << attempt << "attempts:"
+                               << QString::fromStdString(fault.message());
+                    throw boost::system::system_error(fault);
+                }
+                delay = retry_.backoff(attempt);
+                qDebug() << "Transient error, retry in" << delay.count() << "ms:"
+                         << QString::fromStdString(fault.message());
+                metrics_.add(endpoint, Metrics::Counter::Retries);
+                continue;
+            }
+            countResponse(res);
+            if(requestObserver_){
+                requestObserver_(method, std::chrono::steady_clock::now() - start, res.result_int());
+            }
+            // 401: token expired under us. Wait for the refresh
+            // (shared with every other rejected request) and repeat once
+            if(res.result() == http::status::unauthorized && !refreshed){
+                refreshed = true;
+                auto renewed = co_await co_spawn(strand_, refreshOnStrand(generation), use_awaitable);
+                if(renewed){
+                    authorize();
+                    metrics_.add(endpoint, Metrics::Counter::Retries);
+                    continue;
+                }
+            }
+            // 5xx: the server may not have done it, repeat an idempotent request
+            if(idempotent && RetryPolicy::transient(res.result_int())){
+                if(retry_.allowRetry(attempt)){
+                    delay = retry_.backoff(attempt);
+                    qDebug() << "Server error" << res.result_int() << ", retry in"
+                             << delay.count() << "ms";
+                    metrics_.add(endpoint, Metrics::Counter::Retries);
+                    continue;
+                }
+                metrics_.add(endpoint, Metrics::Counter::RetriesDenied);
+            }
+            if(res.result() != http::status::too_many_requests){
+                scheduler_.onSuccess();
+                co_return res;
+            }
 
+            // 429: request was not processed, pause every lane and repeat
+            scheduler_.onRateLimited(retryAfter(res));
+            if(attempt >= scheduler_.options().maxAttempts){
+                qWarning() << "Rate limit persists after" << attempt << "attempts:"
+                           << QString::fromStdString(target);
+                co_return res;
+            }
+            metrics_.add(endpoint, Metrics::Counter::Retries);
+        }
     }
-    catch(std::exception& e){
-        qDebug() << "Error in fetchTokens: " << e.what() << "\n";
+    catch(...){
+        metrics_.add(endpoint, Metrics::Counter::Failures);
+        throw;
     }
-
-    co_return;
 }
 
-boost::asio::awaitable<std::string> SpotifyClient::searchTrack(
-    const std::string& artist, const std::string& title){
+boost::asio::awaitable<SpotifyClient::Response> SpotifyClient::roundTrip(
+    const std::string& host, const std::string& port, const Request& req,
+    Metrics::Endpoint endpoint, std::uint64_t traceLane){
     using namespace boost::asio;
     using namespace boost::beast;
-    try{
-        // Make GET path
-        std::string s;
-        if(artist.empty()){
-            s = "track:" + title;
+
+    while(true){
+        std::optional<TraceSpan> acquireSpan(std::in_place, "connection", traceLane);
+        auto conn = co_await pool_.acquire(host, port, endpoints_.useTls);
+        acquireSpan.reset();
+        bool reused = conn->requests > 0;
+        if(auto times = std::exchange(conn->setupTimes, std::nullopt)){
+            metrics_.add(endpoint, Metrics::Counter::ConnectionsOpened);
+            if(times->dns.count() > 0){
+                metrics_.record(endpoint, Metrics::Stage::Dns, times->dns);
+            }
+            metrics_.record(endpoint, Metrics::Stage::Connect, times->connect);
+            if(conn->tls){
+                metrics_.record(endpoint, Metrics::Stage::Tls, times->tls);
+            }
         }
         else{
-            s = "artist:" + artist + " track:" + title;
+            metrics_.add(endpoint, Metrics::Counter::ConnectionsReused);
         }
-        std::string path = "/v1/search?q=" + encodeURL(s)
-                           + "&type=track&limit=1";
-
-
-        // Resolve
-        auto& io_ctx = GlobalIoService::instance();
+        try{
+            // Send request
+            auto start = std::chrono::steady_clock::now();
+            conn->socket().expires_after(kRequestTimeout);
+            co_await conn->write(req);
+
+            // Get response: headers and body timed apart
+            http::response_parser<http::string_body> parser;
+            std::optional<TraceSpan> waitSpan(std::in_place, "ttfb", traceLane);
+            co_await conn->readHeader(parser);
+            waitSpan.reset();
+            auto headersAt = std::chrono::steady_clock::now();
+            metrics_.record(endpoint, Metrics::Stage::Ttfb, headersAt - start);
+            waitSpan.emplace("body", traceLane);
+            co_await conn->readBody(parser);
+            waitSpan.reset();
+            metrics_.record(endpoint, Metrics::Stage::Body, std::chrono::steady_clock::now() - headersAt);
+            conn->socket().expires_never();
+
+            // Keep connection if server allows
+            Response res = parser.release();
+            conn.release(res.keep_alive());
+            co_return res;
+        }
+        catch(boost::system::system_error& e){
+            // Server dropped the idle connection right before we used it,
+            // request was not processed: repeat on another connection
+            if(reused && isStaleConnectionError(e.code())){
+                qDebug() << "Stale connection, retrying:" << e.what();
+                metrics_.add(endpoint, Metrics::Counter::Retries);
+                continue;
+            }
+            throw;
+        }
+    }
+}
 
-        auto endpoints = co_await resolver_
-            .async_resolve("api.spotify.com", "443", use_awaitable);
+boost::asio::awaitable<void> SpotifyClient::fetchTokens(std::string code){
+    RunningScope running{running_};
+    // Make POST body
+    std::ostringstream oss;
+    oss << "grant_type=authorization_code"
+        << "&code=" << encodeURL(code)
+        << "&redirect_uri=" << encodeURL(redirectUri_)
+        << "&client_id=" << encodeURL(clientId_)
+        << "&code_verifier=" << encodeURL(codeVerifier_);
+
+    if(co_await requestTokens(oss.str(), false)){
+        qDebug() << "Access token received.";
+    }
+    co_return;
+}
 
-        // SSL-stream
-        ssl_stream<tcp_stream> stream{io_ctx, ssl_ctx_};
-        configure_stream(stream, "accounts.spotify.com");
+boost::asio::awaitable<bool> SpotifyClient::refreshAccessToken(){
+    using namespace boost::asio;
+    std::uint64_t generation;
+    {
+        std::lock_guard lock(tokenMutex_);
+        generation = tokenGeneration_;
+    }
+    co_return co_await co_spawn(strand_, refreshOnStrand(generation), use_awaitable);
+}
 
+boost::asio::awaitable<bool> SpotifyClient::requestTokens(std::string body, bool refresh){
+    using namespace boost::asio;
+    using namespace boost::beast;
+    try{
+        // Send POST-request
+        auto res = co_await sendRequest(Service::Accounts, http::verb::post, "/api/token",
+                                        std::move(body), "application/x-www-form-urlencoded");
+
+        if(res.result_int() != 200){
+            qWarning() << "Token request failed:" << res.result_int()
+                       << QString::fromStdString(res.body());
+            // invalid_grant: refresh token was revoked, only the browser helps now
+            if(refresh && (res.result_int() == 400 || res.result_int() == 401)){
+                std::lock_guard lock(tokenMutex_);
+                refreshToken_.clear();
+            }
+            co_return false;
+        }
 
-        // TCP connection
-        co_await get_lowest_layer(stream)
-            .async_connect(endpoints, use_awaitable);
+        // Parse JSON-response
+        StageTimer parse(metrics_, Metrics::Endpoint::Token, Metrics::Stage::Parse);
+        const char* begin = res.body().data();
+        const char* end = begin + res.body().size();
+        begin = jsonSkipWhitespace(begin, end);
+        std::string accessToken;
+        std::string refreshToken;
+        long long expiresIn = 0;
+        if(!jsonGetString(begin, end, "access_token", accessToken)){
+            qDebug() << "Invalid token response\n";
+            co_return false;
+        }
+        jsonGetString(begin, end, "refresh_token", refreshToken);
+        jsonGetInteger(begin, end, "expires_in", expiresIn);
+        bool canRefresh;
+        {
+            auto now = std::chrono::steady_clock::now();
+            auto lifetime = std::chrono::seconds(std::max(expiresIn, 0LL));
+            std::lock_guard lock(tokenMutex_);
+            // Login may be of another account
+            if(!refresh){
+                userId_.clear();
+            }
+            accessToken_ = std::move(accessToken);
+            authorizationHeader_ = "Bearer " + accessToken_;
+            // Refresh responses may keep the old refresh token
+            if(!refreshToken.empty()){
+                refreshToken_ = std::move(refreshToken);
+            }
+            tokenExpiry_ = now + lifetime;
+            tokenRefreshDue_ = tokenExpiry_ - std::min<std::chrono::steady_clock::duration>(
+                kTokenRefreshLead, lifetime / 5);
+            ++tokenGeneration_;
+            canRefresh = !refreshToken_.empty() && expiresIn > 0;
+        }
+        if(canRefresh){
+            post(strand_, [this]{ startTokenRefresh(); });
+        }
+        co_return true;
+    }
+    catch(std::exception& e){
+        qDebug() << "Error in requestTokens: " << e.what() << "\n";
+        co_return false;
+    }
+}
 
-        // Handshake
-        co_await stream
-            .async_handshake(ssl::stream_base::client, use_awaitable);
+boost::asio::awaitable<bool> SpotifyClient::refreshOnStrand(std::uint64_t generation){
+    RunningScope running{running_};
+    // Refresh in flight: its token is ours too
+    if(refreshing_){
+        while(refreshing_){
+            co_await refreshDone_.wait();
+        }
+        std::lock_guard lock(tokenMutex_);
+        co_return tokenGeneration_ != generation;
+    }
 
-        // Form GET-request
-        http::request<http::string_body> req{http::verb::get, path, 11};
-        req.set(http::field::host, "api.spotify.com");
-        req.set(http::field::user_agent, "ExportLikes/1.0");
-        req.set(http::field::authorization,
-                std::string("Bearer ") + accessToken_);
+    std::string body;
+    {
+        std::lock_guard lock(tokenMutex_);
+        // Rejected token was replaced while this request was in flight
+        if(tokenGeneration_ != generation){
+            co_return true;
+        }
+        if(refreshToken_.empty()){
+            co_return false;
+        }
+        body = "grant_type=refresh_token&refresh_token=" + encodeURL(refreshToken_)
+               + "&client_id=" + encodeURL(clientId_);
+    }
 
-        // Send request
-        co_await http::async_write(stream, req, use_awaitable);
+    TraceSpan span("token refresh");
+    refreshing_ = true;
+    bool refreshed = co_await requestTokens(std::move(body), true);
+    refreshing_ = false;
+    refreshDone_.notifyAll();
 
-        // Prepare buffer and response
-        flat_buffer buf;
-        http::response<http::string_body> res;
+    if(refreshed){
+        qDebug() << "Access token refreshed.";
+    }
+    co_return refreshed;
+}
 
-        // Get response
-        co_await http::async_read(stream, buf, res, use_awaitable);
+void SpotifyClient::startTokenRefresh(){
+    using namespace boost::asio;
+    if(stopping_){
+        return;
+    }
+    if(refreshLoopRunning_){
+        refreshWake_.notifyAll();
+        return;
+    }
+    refreshLoopRunning_ = true;
+    running_.add();
+    co_spawn(strand_, tokenRefreshLoop(), detached);
+}
 
+boost::asio::awaitable<void> SpotifyClient::tokenRefreshLoop(){
+    try{
+        while(!stopping_){
+            std::chrono::steady_clock::time_point due;
+            std::uint64_t generation;
+            {
+                std::lock_guard lock(tokenMutex_);
+                if(refreshToken_.empty()){
+                    break;
+                }
+                due = tokenRefreshDue_;
+                generation = tokenGeneration_;
+            }
 
-        // Close TCP-sesson
-        error_code ec;
-        co_await stream.async_shutdown(redirect_error(use_awaitable, ec));
-        if(ec == boost::asio::error::eof ||
-            ec == boost::asio::ssl::error::stream_truncated){
-            ec.clear();
+            if(std::chrono::steady_clock::now() < due){
+                co_await refreshWake_.waitUntil(due);
+                continue;
+            }
+            bool refreshed = co_await refreshOnStrand(generation);
+            if(!refreshed && !stopping_){
+                qWarning() << "Token refresh failed, next attempt in"
+                           << kTokenRefreshRetry.count() << "s";
+                co_await refreshWake_.waitUntil(std::chrono::steady_clock::now() + kTokenRefreshRetry);
+            }
         }
-        if(ec){
-            throw system_error{ec};
-            co_return "";
+    }
+    catch(std::exception& e){
+        qWarning() << "Error in tokenRefreshLoop: " << e.what();
+    }
+    refreshLoopRunning_ = false;
+    running_.done();
+}
+
+boost::asio::awaitable<std::optional<std::string>> SpotifyClient::searchTrack(
+    const std::string& artist, const std::string& title){
+    using namespace boost::asio;
+    using namespace boost::beast;
+    try{
+        // Make GET path in one buffer
+        std::string path;
+        path.reserve(64 + 3 * (artist.size() + title.size()));
+        path += "/v1/search?q=";
+        if(!artist.empty()){
+            appendUrlEncoded(path, "artist:");
+            appendUrlEncoded(path, artist);
+            appendUrlEncoded(path, " ");
         }
+        appendUrlEncoded(path, "track:");
+        appendUrlEncoded(path, title);
+        path += "&type=track&limit=1";
+
+        // Send GET-request
+        auto res = co_await sendRequest(Service::Api, http::verb::get, path);
 
         //qDebug() << "searchTrack response status:" << res.result_int();
         //qDebug() << "response body:" << QString::fromStdString(res.body());
 
         //Check OK status
+        if(res.result_int() == 429){
+            qWarning() << "Search rate limited, track skipped:" << artist << "-" << title;
+            co_return std::nullopt;
+        }
         if(res.result_int() != 200 && res.result_int() != 201){
             qDebug() << "Response status is not 200/201\n";
-            co_return "";
+            co_return std::nullopt;
         }
 
-        // Parse Json-response
-        QJsonDocument doc = QJsonDocument::fromJson(
-            QByteArray::fromStdString(res.body()));
-
-        if(!doc.isObject()){
-            qDebug() << "doc from Json is not object\n";
-            co_return "";
+        // Pull tracks.items[0].id straight from the body
+        StageTimer parse(metrics_, Metrics::Endpoint::Search, Metrics::Stage::Parse);
+        const char* begin = res.body().data();
+        const char* end = begin + res.body().size();
+        auto* items = jsonFindPath(jsonSkipWhitespace(begin, end), end, {"tracks", "items"});
+        if(!items || *items != '['){
+            qDebug() << "No tracks.items in search response\n";
+            co_return std::nullopt;
         }
-
-        QJsonObject obj = doc.object();
-        QJsonObject tracks = obj.value("tracks").toObject();
-        QJsonArray items = tracks.value("items").toArray();
-        if(items.isEmpty()){
+        auto* first = jsonSkipWhitespace(items + 1, end);
+        if(first < end && *first == ']'){
             qDebug() << "items from Json is empty\n";
-            co_return "";
+            co_return std::optional<std::string>{""};
+        }
+        std::string id;
+        if(!jsonGetString(first, end, "id", id)){
+            qDebug() << "No id in first search item\n";
+            co_return std::nullopt;
         }
-        QJsonObject first = items[0].toObject();
-        QString id = first.value("id").toString();
 
-        co_return id.toStdString();
+        co_return std::optional<std::string>{std::move(id)};
     }
     catch(std::exception& e){
         qDebug() << "Error in SearchTrack(" << artist
                  << ", " << title << "): " << e.what() << "\n";
-        co_return "";
+        co_return std::nullopt;
     }
 }
 
-boost::asio::awaitable<void> SpotifyClient::likeTracksFromJson(const std::string& jsonPath,
-        std::function<void(int, int)> progressCb){
+boost::asio::awaitable<bool> SpotifyClient::likeTracksFromJson(const std::string& jsonPath){
+    using namespace boost::asio;
+
+    RunningScope running{running_};
+    TraceSpan span("import", 0, jsonPath);
+    progress_.start(0);
+    ProgressRun progressRun{progress_};
+
+    // Map the file, JSON records are parsed on demand,
+    // a binary track list is read in place
+    std::shared_ptr<TrackReader> reader;
+    std::shared_ptr<TrackList> list;
+    std::shared_ptr<ImportJournal> journal;
+    // Journal is of the account: another login does not resume it
+    auto account = co_await fetchUserId();
     try{
-        // Read json-file with tracks
-        auto path = QString::fromStdString(jsonPath);
-        QFile file{path};
-        if(!file.open(QIODevice::ReadOnly)){
-            qDebug() << "Error in opening file\n";
-            co_return;
+        if(TrackList::detect(jsonPath)){
+            list = std::make_shared<TrackList>(jsonPath);
+            progress_.setTotal(list->size());
+        }
+        else{
+            reader = std::make_shared<TrackReader>(jsonPath);
         }
-        QByteArray data = file.readAll();
-        file.close();
-
 
-        // Prepare for parsing
-        QJsonParseError er;
-        QJsonDocument doc = QJsonDocument::fromJson(data, &er);
-        if(er.error != QJsonParseError::NoError || !doc.isArray()){
-            qWarning() << "Invalid JSON file:" << er.errorString();
-            co_return;
+        // Work done by an interrupted run of the same file
+        if(account){
+            journal = std::make_shared<ImportJournal>(jsonPath, *account, resumeImports_);
+            if(journal->committed() > 0){
+                qDebug() << "Resuming import after record" << journal->committed();
+            }
+        }
+        else{
+            qWarning() << "Account is unknown, import is not journaled";
         }
+    }
+    catch(std::exception& e){
+        qWarning() << "Error in opening file:" << e.what();
+        co_return false;
+    }
+
+    // Named: GCC destroys temporaries of a co_await expression twice
+    RecordSource next;
+    if(list){
+        next = [list, pos = std::size_t(0)](TrackRecord& rec) mutable -> awaitable<bool>{
+            if(pos == list->size()){
+                co_return false;
+            }
+            list->read(pos++, rec);
+            co_return true;
+        };
+    }
+    else{
+        // Nothing is scanned ahead of the first search: total is estimated
+        // from the bytes per record so far and is exact at the end
+        next = [this, reader, records = std::uint64_t(0)](TrackRecord& rec) mutable
+            -> awaitable<bool>{
+            if(!reader->next(rec)){
+                progress_.setTotal(records);
+                co_return false;
+            }
+            ++records;
+            progress_.setTotal(std::max<std::uint64_t>(
+                records, records * reader->size() / std::max<std::size_t>(reader->offset(), 1)));
+            co_return true;
+        };
+    }
+    co_return co_await importTracks(std::move(next), std::move(journal));
+}
 
-        QJsonArray arr = doc.array();
-        std::vector<std::string> trackIds;
+boost::asio::awaitable<bool> SpotifyClient::likeTracksFromStream(std::shared_ptr<TrackStream> stream){
+    using namespace boost::asio;
 
-        int total = arr.size();
-        int count = 0;
+    RunningScope running{running_};
+    TraceSpan span("import", 0, "stream");
+    progress_.start(0);
+    ProgressRun progressRun{progress_};
+
+    // Total is known from the header, or grows with the records
+    RecordSource next = [this, stream](TrackRecord& rec) -> awaitable<bool>{
+        bool more = co_await stream->next(rec);
+        progress_.setTotal(std::max(stream->totalHint(), stream->received()));
+        co_return more;
+    };
+    std::shared_ptr<ImportJournal> journal;
+    bool imported = co_await importTracks(std::move(next), std::move(journal));
+
+    if(!stream->complete() && !control_.cancelled()){
+        qWarning() << "Track stream ended early:" << stream->received()
+                   << "records were imported";
+        co_return false;
+    }
+    co_return imported;
+}
 
-        // Parsing traсks from json and get their ids
-        for(const auto& val : arr){
-            if(!val.isObject()){
+boost::asio::awaitable<bool> SpotifyClient::importTracks(RecordSource next,
+                                                         std::shared_ptr<ImportJournal> journal){
+    using namespace boost::asio;
+
+    // Touched only on strand_ (lane completions are bound to it),
+    // shared so it outlives this frame
+    struct SearchState{
+        explicit SearchState(std::size_t lanes) : lanes(lanes) {}
+        AsyncSemaphore lanes;
+        AsyncWaitGroup running;
+        struct Result{
+            std::uint64_t input;
+            bool done = false;
+            // Id, "" if Spotify has no such track, std::nullopt if the search failed
+            std::optional<std::string> id;
+        };
+        // Results in input order
+        std::deque<Result> results;
+        // Failed searches and the first of them: the journal is not
+        // committed past it, so the next run searches again
+        std::size_t failed = 0;
+        std::uint64_t firstFailed = std::numeric_limits<std::uint64_t>::max();
+        // Search position of results.front()
+        std::size_t base = 0;
+        // Normalized (artist, title) already met in the input
+        std::unordered_set<std::uint64_t> seen;
+        // Ids already sent to the like stage
+        std::unordered_set<std::string> queued;
+        std::size_t duplicates = 0;
+    };
+    auto state = std::make_shared<SearchState>(searchConcurrency_);
+
+    // Tracks already liked are neither PUT again nor counted as new
+    std::shared_ptr<LibrarySnapshot> liked;
+    if(skipLiked_){
+        if(auto snapshot = co_await fetchLibrarySnapshot()){
+            liked = std::make_shared<LibrarySnapshot>(std::move(*snapshot));
+            qDebug() << "Library snapshot:" << liked->size() << "liked tracks";
+        }
+        else{
+            qWarning() << "Library snapshot failed, liking every found track";
+        }
+    }
+    auto skipped = std::make_shared<std::size_t>(0);
+
+    // Like stage runs beside the search stage
+    auto ids = std::make_shared<AsyncChannel<QueuedLike>>(kLikeQueueCapacity);
+    auto liking = std::make_shared<AsyncWaitGroup>();
+    auto allSaved = std::make_shared<bool>(false);
+    liking->add();
+    co_spawn(strand_,
+        [this, ids, liking, journal, allSaved]() -> awaitable<void>{
+            try{
+                *allSaved = co_await likeBatches(*ids, journal.get());
+            }
+            catch(std::exception& e){
+                qWarning() << "Error in like stage: " << e.what();
+            }
+            liking->done();
+        },
+        detached);
+
+    // Pass finished results to the like stage in input order.
+    // Suspends while the like stage is behind
+    auto drain = [state, ids, liked, skipped]() -> awaitable<void>{
+        while(!state->results.empty() && state->results.front().done){
+            auto input = state->results.front().input;
+            auto found = std::move(state->results.front().id);
+            state->results.pop_front();
+            ++state->base;
+            if(!found){
+                ++state->failed;
+                state->firstFailed = std::min(state->firstFailed, input);
                 continue;
             }
-            QJsonObject obj = val.toObject();
-            QString artist = obj.value("artist").toString();
-            QString title = obj.value("title").toString();
-
-            if(title.isEmpty()){
+            auto id = std::move(*found);
+            if (id.empty()){
+                continue;
+            }
+            if (liked && liked->contains(id)){
+                ++*skipped;
+                continue;
+            }
+            // Different spellings of one track: like it once
+            if (!state->queued.insert(id).second){
+                ++state->duplicates;
                 continue;
             }
+            // Named: GCC destroys temporaries of a co_await expression twice
+            QueuedLike like{std::min(input + 1, state->firstFailed), std::move(id)};
+            co_await ids->send(std::move(like));
+        }
+    };
 
-            auto id = co_await searchTrack(artist.toStdString(), title.toStdString());
+    // Parsing traсks from json and search them in parallel lanes.
+    // Malformed input ends the loop only: lanes in flight and
+    // the like stage still wind down below
+    bool inputFailed = false;
+    try{
+        TrackRecord rec;
+        std::uint64_t input = 0;
+        for(; co_await next(rec); ++input){
+            if(!co_await control_.proceed()){
+                break;
+            }
+            if(rec.title.empty()){
+                continue;
+            }
 
-            // Callback to get progress
-            ++count;
-            if (progressCb) progressCb(count, total);
+            // Same track earlier in the input (after normalization): nothing to do
+            auto key = rec.key ? *rec.key : trackKey(rec.artist, rec.title);
+            if(!state->seen.insert(key).second){
+                ++state->duplicates;
+                progress_.advance();
+                continue;
+            }
 
-            if (id.empty()){
+            // Liked or skipped by an earlier run
+            if(journal && input < journal->committed()){
+                progress_.advance();
                 continue;
             }
-            trackIds.push_back(id);
-            if(trackIds.size() == 50){
-                co_await addTracksToLibrary(trackIds);
-                trackIds.clear();
+
+            // Known answer: no request at all
+            auto known = journal ? journal->resolved(input) : std::nullopt;
+            if(!known && isSpotifyId(rec.id)){
+                known = rec.id;
+            }
+            if(!known && searchCache_){
+                known = searchCache_->find(key);
+            }
+            if(known){
+                state->results.push_back({input, true, std::move(known)});
+                progress_.advance();
+                co_await drain();
+                continue;
             }
+
+            co_await state->lanes.acquire();
+            std::size_t pos = state->base + state->results.size();
+            state->results.push_back({input, false, std::nullopt});
+            state->running.add();
+
+            searchShared(rec.artist, rec.title, key,
+                    [this, state, journal, pos, input, key](
+                        std::optional<std::string> id){
+                        // Failed searches are not cached: next run tries again
+                        if(id){
+                            if(journal){
+                                journal->recordResolved(input, *id);
+                            }
+                            if(searchCache_){
+                                searchCache_->store(key, *id);
+                            }
+                        }
+                        auto& result = state->results[pos - state->base];
+                        result.done = true;
+                        result.id = std::move(id);
+                        progress_.advance();
+
+                        state->lanes.release();
+                        state->running.done();
+                    });
+
+            co_await drain();
         }
+    }
+    catch(std::exception& e){
+        qWarning() << "Error in import: " << e.what();
+        inputFailed = true;
+    }
+
+    // Wait for the last lanes. After a stop they end at their
+    // next request and their results are not liked
+    co_await state->running.wait();
+    if(!control_.cancelled()){
+        co_await drain();
+    }
 
-        // Send to add-function remained ids
-        if(!trackIds.empty()){
-            co_await addTracksToLibrary(trackIds);
-            trackIds.clear();
+    // Like stage sends remained ids and stops
+    ids->close();
+    co_await liking->wait();
+
+    if(searchCache_){
+        searchCache_->flush();
+    }
+
+    // Journal is kept only when some batch or search failed,
+    // or input was cut short (also by a stop)
+    bool complete = *allSaved && !inputFailed && state->failed == 0
+        && !control_.cancelled();
+    if(complete){
+        if(journal){
+            journal->finish();
+        }
+    }
+    else{
+        if(journal){
+            journal->flush(true);
         }
+        if(control_.cancelled()){
+            qWarning() << "Import stopped, run it again to resume";
+            releaseConnections();
+            co_return false;
+        }
+        if(state->failed > 0){
+            qWarning() << state->failed << "searches failed";
+        }
+        qWarning() << "Import is incomplete, run it again to resume";
+    }
 
+    if(*skipped > 0){
+        qDebug() << "Skipped" << *skipped << "tracks that are already liked";
+    }
+    if(state->duplicates > 0){
+        qDebug() << "Skipped" << state->duplicates << "duplicate tracks";
+    }
+    if(complete){
         qDebug() << "✅ All tracks processed and liked";
     }
-    catch(std::exception& e){
-        qWarning() << "Error in likeTracksFromJson: " << e.what();
+    co_return complete;
+}
+
+void SpotifyClient::searchShared(std::string artist, std::string title, std::uint64_t key,
+                                 std::function<void(std::optional<std::string>)> done){
+    using namespace boost::asio;
+
+    // Same search already in flight: wait for its answer
+    auto [flight, fresh] = searchFlights_.try_emplace(key);
+    flight->second.push_back(std::move(done));
+    if(!fresh){
+        qDebug() << "Search coalesced:" << QString::fromStdString(artist)
+                 << "-" << QString::fromStdString(title);
+        return;
+    }
+
+    // Request, TLS and parsing on a strand of its own (any io thread),
+    // the result comes back to strand_
+    running_.add();
+    co_spawn(make_strand(GlobalIoService::instance()),
+        [this, artist = std::move(artist), title = std::move(title)]()
+            -> awaitable<std::optional<std::string>>{
+            TraceSpan span("search lane", 0, title);
+            co_return co_await searchTrack(artist, title);
+        },
+        bind_executor(strand_,
+            [this, key](std::exception_ptr, std::optional<std::string> id){
+                auto waiters = std::move(searchFlights_[key]);
+                searchFlights_.erase(key);
+                for(auto& waiter : waiters){
+                    waiter(id);
+                }
+                running_.done();
+            }));
+}
+
+boost::asio::awaitable<bool> SpotifyClient::likeBatches(AsyncChannel<QueuedLike>& ids,
+                                                        ImportJournal* journal){
+    using namespace boost::asio;
+
+    TraceSpan stage("like stage");
+
+    // Batches are PUT one after another: Spotify orders likes by time added
+    std::vector<std::string> batch;
+    batch.reserve(50);
+    // Journal watermark once the batch is saved
+    std::uint64_t commitTo = 0;
+    // After a failed batch nothing later is committed: resume retries from it
+    bool failed = false;
+    auto deadline = std::chrono::steady_clock::time_point::max();
+
+    auto send = [&]() -> awaitable<void>{
+        TraceSpan span("like batch", stage.lane());
+        // Stopped: the batch stays uncommitted in the journal
+        if(control_.cancelled()){
+            failed = true;
+            batch.clear();
+            co_return;
+        }
+        bool saved = co_await addTracksToLibrary(batch);
+        failed = failed || !saved;
+        if(!failed && journal){
+            journal->recordCommitted(commitTo);
+        }
+        batch.clear();
+    };
+
+    while(true){
+        // Search stage may wait on a full channel: let it go
+        if(control_.cancelled()){
+            ids.close();
+            failed = true;
+            break;
+        }
+        auto like = co_await ids.receiveUntil(deadline);
+        if(!like){
+            // Window expired or input finished: send what we have
+            if(!batch.empty()){
+                co_await send();
+            }
+            deadline = std::chrono::steady_clock::time_point::max();
+            if(ids.closed() && ids.size() == 0){
+                break;
+            }
+            continue;
+        }
+
+        // Window starts with the first id of a batch
+        if(batch.empty()){
+            deadline = std::chrono::steady_clock::now() + likeBatchWindow_;
+        }
+        batch.push_back(std::move(like->id));
+        commitTo = like->commitTo;
+        if(batch.size() == 50){
+            co_await send();
+            deadline = std::chrono::steady_clock::time_point::max();
+        }
     }
+    co_return !failed;
 }
 
-boost::asio::awaitable<void> SpotifyClient::addTracksToLibrary(
+boost::asio::awaitable<bool> SpotifyClient::addTracksToLibrary(
     const std::vector<std::string>& trackIds){
     using namespace boost::asio;
     using namespace boost::beast;
     try{
-        // Make tracks string for PUT-request
-        std::string tracksString;
+        // Make PUT target in one buffer, ids are 22 chars
+        std::string target;
+        target.reserve(32 + trackIds.size() * 25);
+        target += "/v1/me/tracks?ids=";
         for(size_t i = 0; i < trackIds.size(); i++){
-            tracksString += trackIds[i];
-            if(i < trackIds.size() - 1){
-                tracksString += ",";
+            if(i > 0){
+                target += "%2C";
             }
+            appendUrlEncoded(target, trackIds[i]);
         }
 
-        // Resolving
-        auto& io_ctx = GlobalIoService::instance();
-        auto endpoints = co_await resolver_
-            .async_resolve("api.spotify.com", "443", use_awaitable);
-
-        // SSL-stream
-        ssl_stream<tcp_stream> stream{io_ctx, ssl_ctx_};
-        configure_stream(stream, "accounts.spotify.com");
-
-        // TCP connection
-        co_await get_lowest_layer(stream)
-            .async_connect(endpoints, use_awaitable);
-
-        // Handshake
-        co_await stream
-            .async_handshake(ssl::stream_base::client, use_awaitable);
-
-        // Form PUT-request
-        std::string target = "/v1/me/tracks?ids=" + encodeURL(tracksString);
-        http::request<http::empty_body> req{http::verb::put, target, 11};
-        req.set(http::field::host, "api.spotify.com");
-        req.set(http::field::user_agent, "Export:ikes 1.0");
-        req.set(http::field::authorization, "Bearer " + accessToken_);
-        req.prepare_payload();
-
-        // Send POST-request
-        co_await http::async_write(stream, req, use_awaitable);
-
-        // Prepare buffer and response
-        flat_buffer buf;
-        http::response<http::string_body> res;
-
-        // Get response
-        co_await http::async_read(stream, buf, res, use_awaitable);
+        // Send PUT-request
+        auto res = co_await sendRequest(Service::Api, http::verb::put, target);
 
-        // Close session
-        error_code ec;
-        co_await stream.async_shutdown(redirect_error(use_awaitable, ec));
-        if(ec == boost::asio::error::eof ||
-            ec == boost::asio::ssl::error::stream_truncated){
-            ec.clear();
-        }
-        if(ec){
-            throw system_error{ec};
-        }
         //qWarning() << "addTracks response status:" << res.result_int();
         //qWarning() << "addTracks response body:" << QString::fromStdString(res.body());
 
@@ -433,190 +1040,332 @@ boost::asio::awaitable<void> SpotifyClient::addTracksToLibrary(
         if (code != 200 && code != 201) {
             qWarning() << "Failed to save" << trackIds.size()
             << "tracks, HTTP status:" << code;
-        } else {
-            qDebug() << "Saved" << trackIds.size() << "tracks successfully.";
+            co_return false;
         }
+        qDebug() << "Saved" << trackIds.size() << "tracks successfully.";
     }
     catch(std::exception& e){
         qWarning() << "Error in addTracksToLibrary: " << e.what();
-
+        co_return false;
     }
 
-    co_return;
+    co_return true;
 }
 
-boost::asio::awaitable<void> SpotifyClient::removeLastN(std::size_t n,
-    std::function<void(int, int)> progressCb){
+boost::asio::awaitable<std::optional<SpotifyClient::SavedPage>> SpotifyClient::fetchSavedPage(
+    std::size_t offset, std::size_t limit){
     using namespace boost::asio;
     using namespace boost::beast;
-
-    int total = n;
-    int count = 0;
-
     try{
+        // Send GET-request
+        std::string target = "/v1/me/tracks?limit=" + std::to_string(limit)
+                             + "&offset=" + std::to_string(offset);
+        auto res = co_await sendRequest(Service::Api, http::verb::get, target);
 
-        while(n > 0){
-            // Split into bacthes
-            auto batch = std::min<std::size_t>(n, 50);
-
-            // Resolving
-            auto& io_ctx = GlobalIoService::instance();
-            auto endpoints = co_await resolver_
-                                 .async_resolve("api.spotify.com", "443", use_awaitable);
-
-            // SSL-stream
-            ssl_stream<tcp_stream> stream{io_ctx, ssl_ctx_};
-            configure_stream(stream, "api.spotify.com");
-
-            // TCP connection
-            co_await get_lowest_layer(stream)
-                .async_connect(endpoints, use_awaitable);
+        if(res.result_int() != 200 && res.result_int() != 201){
+            qWarning() << "Get /me/tracks failed: " << res.result_int()
+                       << "\n" << res.body();
+            co_return std::nullopt;
+        }
 
-            // Handshake
-            co_await stream
-                .async_handshake(ssl::stream_base::client, use_awaitable);
+        // Pull total and items[].track.id straight from the body
+        StageTimer parse(metrics_, Metrics::Endpoint::SavedTracksGet, Metrics::Stage::Parse);
+        const char* end = res.body().data() + res.body().size();
+        const char* begin = jsonSkipWhitespace(res.body().data(), end);
 
-            // Form GET-request
-            std::string target = "/v1/me/tracks?limit=" + std::to_string(batch);
-            http::request<http::empty_body> req{http::verb::get, target, 11};
-            req.set(http::field::host, "api.spotify.com");
-            req.set(http::field::user_agent, "ExportLikes 1.0");
-            req.set(http::field::authorization, "Bearer " + accessToken_);
+        SavedPage page;
+        long long total = 0;
+        if(!jsonGetInteger(begin, end, "total", total)){
+            qDebug() << "No total in saved tracks page\n";
+            co_return std::nullopt;
+        }
+        page.total = std::size_t(std::max(total, 0LL));
+
+        auto* items = jsonFindMember(begin, end, "items");
+        page.ids.reserve(limit);
+        auto* after = items ? jsonForEachElement(items, end, [&](const char* item){
+            auto* track = jsonFindMember(item, end, "track");
+            std::string id;
+            if(track && jsonGetString(track, end, "id", id)){
+                page.ids.push_back(std::move(id));
+            }
+            return jsonSkipValue(item, end);
+        }) : nullptr;
+        if(!after){
+            qDebug() << "Malformed items in saved tracks page\n";
+            co_return std::nullopt;
+        }
+        co_return page;
+    }
+    catch(std::exception& e){
+        qWarning() << "Error in fetchSavedPage: " << e.what();
+        co_return std::nullopt;
+    }
+}
 
-            // Send request
-            co_await http::async_write(stream, req, use_awaitable);
+boost::asio::awaitable<std::optional<std::vector<std::vector<std::string>>>>
+SpotifyClient::listSavedPages(std::size_t n){
+    using namespace boost::asio;
 
-            // Prepare buffer and response
-            flat_buffer buf;
-            http::response<http::string_body> res;
+    // First page tells the library size
+    auto first = co_await fetchSavedPage(0, std::min<std::size_t>(n, 50));
+    if(!first){
+        co_return std::nullopt;
+    }
+    n = std::min(n, first->total);
+
+    // Touched only on strand_ (lane completions are bound to it)
+    struct ListState{
+        explicit ListState(std::size_t lanes) : lanes(lanes) {}
+        AsyncSemaphore lanes;
+        AsyncWaitGroup running;
+        // Pages by offset / 50
+        std::vector<std::optional<SavedPage>> pages;
+    };
+    auto state = std::make_shared<ListState>(searchConcurrency_);
+    state->pages.resize(std::max<std::size_t>((n + 49) / 50, 1));
+    state->pages[0] = std::move(first);
+
+    // List the rest of the pages in parallel
+    for(std::size_t page = 1; page < state->pages.size(); ++page){
+        if(!co_await control_.proceed()){
+            break;
+        }
+        co_await state->lanes.acquire();
+        state->running.add();
+        running_.add();
+        auto offset = page * 50;
+        auto limit = std::min<std::size_t>(n - offset, 50);
+        co_spawn(make_strand(GlobalIoService::instance()),
+            [this, offset, limit]() -> awaitable<std::optional<SavedPage>>{
+                TraceSpan span("list lane");
+                co_return co_await fetchSavedPage(offset, limit);
+            },
+            bind_executor(strand_,
+                [this, state, page](std::exception_ptr, std::optional<SavedPage> result){
+                    state->pages[page] = std::move(result);
+                    state->lanes.release();
+                    state->running.done();
+                    running_.done();
+                }));
+    }
+    co_await state->running.wait();
+    if(control_.cancelled()){
+        co_return std::nullopt;
+    }
 
-            // Get response
-            co_await http::async_read(stream, buf, res, use_awaitable);
+    std::vector<std::vector<std::string>> pages;
+    pages.reserve(state->pages.size());
+    for(auto& page : state->pages){
+        if(!page){
+            co_return std::nullopt;
+        }
+        pages.push_back(std::move(page->ids));
+    }
+    co_return pages;
+}
 
-            // Close session
-            boost::system::error_code ec;
-            co_await stream.async_shutdown(redirect_error(use_awaitable, ec));
-            if(ec == boost::asio::error::eof ||
-                ec == boost::asio::ssl::error::stream_truncated){
-                ec.clear();
-            }
-            if(ec){
-                throw system_error{ec};
-            }
+boost::asio::awaitable<bool> SpotifyClient::removeLastN(std::size_t n){
+    using namespace boost::asio;
 
-            if(res.result_int() != 200 && res.result_int() != 201){
-                qWarning() << "Get /me/tracks failed: " << res.result_int()
-                           << "\n" << res.body();
-                co_return;
+    RunningScope running{running_};
+    TraceSpan span("remove");
+    progress_.start(0);
+    ProgressRun progressRun{progress_};
+    // Nothing to do: Spotify rejects limit=0
+    if(n == 0){
+        co_return true;
+    }
+    try{
+        // Nothing is removed until listing is complete: deletes
+        // would shift the offsets of pages still in flight
+        auto batches = co_await listSavedPages(n);
+        if(!batches){
+            if(control_.cancelled()){
+                qWarning() << "Removal stopped while listing, nothing removed";
+                releaseConnections();
             }
-
-            // Parse the response
-            QJsonDocument doc = QJsonDocument::fromJson(
-                QByteArray::fromStdString(res.body()));
-
-            if(!doc.isObject()){
-                qDebug() << "doc from Json is not object\n";
-                co_return;
+            else{
+                qWarning() << "Listing of liked tracks is incomplete, nothing removed";
             }
-
-            QJsonObject obj = doc.object();
-            QJsonArray items = obj.value("items").toArray();
-
-            if(items.isEmpty()){
-                qDebug() << "No tracks to remove";
-                co_return;
+            co_return false;
+        }
+        std::size_t listed = 0;
+        for(auto& batch : *batches){
+            listed += batch.size();
+        }
+        if(listed == 0){
+            qDebug() << "No tracks to remove";
+            co_return true;
+        }
+        progress_.setTotal(std::min(n, listed));
+
+        // Touched only on strand_ (lane completions are bound to it)
+        struct RemoveState{
+            explicit RemoveState(std::size_t lanes) : lanes(lanes) {}
+            AsyncSemaphore lanes;
+            AsyncWaitGroup running;
+            // Batches Spotify did not remove
+            std::size_t failed = 0;
+        };
+        auto state = std::make_shared<RemoveState>(searchConcurrency_);
+
+        // Remove batches in parallel
+        for(auto& batch : *batches){
+            if(!co_await control_.proceed()){
+                break;
             }
-            std::vector<std::string> ids;
-            for (auto it = items.begin(); it != items.end(); it++){
-                auto trackObj = it->toObject()
-                .value("track")
-                    .toObject();
-                ids.push_back(trackObj.value("id").toString().toStdString());
+            if(batch.empty()){
+                continue;
             }
+            co_await state->lanes.acquire();
+            state->running.add();
+            running_.add();
+            // Only removed tracks are counted
+            auto size = batch.size();
+            co_spawn(make_strand(GlobalIoService::instance()),
+                [this, ids = std::move(batch)]() -> awaitable<bool>{
+                    TraceSpan span("delete lane");
+                    co_return co_await sendRemoveReq(ids);
+                },
+                bind_executor(strand_,
+                    [this, state, size](std::exception_ptr, bool removed){
+                        if(removed){
+                            progress_.advance(size);
+                        }
+                        else{
+                            ++state->failed;
+                        }
+
+                        state->lanes.release();
+                        state->running.done();
+                        running_.done();
+                    }));
+        }
+        co_await state->running.wait();
+        if(control_.cancelled()){
+            qWarning() << "Removal stopped after" << progress_.done() << "tracks";
+            releaseConnections();
+            co_return false;
+        }
+        if(state->failed > 0){
+            qWarning() << state->failed << "batches were not removed, removed"
+                       << progress_.done() << "tracks";
+            co_return false;
+        }
+        co_return true;
+    }
+    catch(std::exception& e){
+        qWarning() << "Error in removeLastN: " << e.what();
+    }
+    co_return false;
+}
 
-            co_await sendRemoveReq(ids);
-
-            count += batch;
-            if (progressCb) progressCb(count, total);
+boost::asio::awaitable<std::optional<LibrarySnapshot>> SpotifyClient::fetchLibrarySnapshot(){
+    TraceSpan span("library snapshot");
+    auto pages = co_await listSavedPages(std::numeric_limits<std::size_t>::max());
+    if(!pages){
+        co_return std::nullopt;
+    }
+    LibrarySnapshot snapshot;
+    snapshot.reserve(pages->size() * 50);
+    for(auto& page : *pages){
+        for(auto& id : page){
+            snapshot.insert(id);
+        }
+    }
+    snapshot.seal();
+    co_return snapshot;
+}
 
-            n -= batch;
+boost::asio::awaitable<std::optional<std::string>> SpotifyClient::fetchUserId(){
+    using namespace boost::beast;
+    RunningScope running{running_};
+    {
+        std::lock_guard lock(tokenMutex_);
+        if(!userId_.empty()){
+            co_return userId_;
+        }
+    }
+    try{
+        std::string target = "/v1/me";
+        auto res = co_await sendRequest(Service::Api, http::verb::get, target);
+        if(res.result_int() != 200){
+            qWarning() << "Get /me failed: " << res.result_int()
+                       << "\n" << res.body();
+            co_return std::nullopt;
         }
 
+        const char* end = res.body().data() + res.body().size();
+        const char* begin = jsonSkipWhitespace(res.body().data(), end);
+        std::string id;
+        if(!jsonGetString(begin, end, "id", id) || id.empty()){
+            qDebug() << "No id in user profile\n";
+            co_return std::nullopt;
+        }
+        std::lock_guard lock(tokenMutex_);
+        userId_ = id;
+        co_return id;
     }
     catch(std::exception& e){
-        qWarning() << "Error in removeLastN: " << e.what();
+        qWarning() << "Error in fetchUserId: " << e.what();
+        co_return std::nullopt;
     }
-    co_return;
 }
 
-boost::asio::awaitable<void> SpotifyClient::sendRemoveReq(const std::vector<std::string>& ids){
+boost::asio::awaitable<bool> SpotifyClient::sendRemoveReq(const std::vector<std::string>& ids){
     using namespace boost::asio;
     using namespace boost::beast;
 
     try{
-        // Resolving
-        auto& io_ctx = GlobalIoService::instance();
-        auto endpoints = co_await resolver_
-            .async_resolve("api.spotify.com", "443", use_awaitable);
-
-        // SSL-stream
-        ssl_stream<tcp_stream> stream{io_ctx, ssl_ctx_};
-        configure_stream(stream, "api.spotify.com");
-
-        // TCP connection
-        co_await get_lowest_layer(stream).async_connect(endpoints, use_awaitable);
-
-        // Handshake
-        co_await stream.async_handshake(ssl::stream_base::client, use_awaitable);
-
-        // Form DELETE-request
-        std::string idsString;
+        // Form DELETE-request in one buffer
+        std::string target;
+        target.reserve(32 + ids.size() * 23);
+        target += "/v1/me/tracks?ids=";
         for (std::size_t i = 0; i < ids.size(); i++){
-            idsString += ids[i];
-            if(i + 1 < ids.size()){
-                idsString += ",";
+            if(i > 0){
+                target += ',';
             }
+            target += ids[i];
         }
-        std::string target = "/v1/me/tracks?ids=" + idsString;
-        http::request<http::empty_body> req{http::verb::delete_, target, 11};
-        req.set(http::field::host, "api.spotify.com");
-        req.set(http::field::user_agent, "ExportLikes 1.0");
-        req.set(http::field::authorization, "Bearer " + accessToken_);
 
         // Send request
-        co_await http::async_write(stream, req, use_awaitable);
-
-        // Prepare buffer and response
-        flat_buffer buf;
-        http::response<http::string_body> res;
-
-        // Get response
-        co_await http::async_read(stream, buf, res, use_awaitable);
-
-        // Close session
-        error_code ec;
-        co_await stream.async_shutdown(redirect_error(use_awaitable, ec));
-        if(ec == boost::asio::error::eof ||
-            ec == boost::asio::ssl::error::stream_truncated){
-            ec.clear();
-        }
-        if(ec){
-            throw system_error{ec};
-        }
+        auto res = co_await sendRequest(Service::Api, http::verb::delete_, target);
 
         if(res.result_int() != 200 && res.result_int() != 201 &&
             res.result_int() != 204){
             qWarning() << "DELETE failed: " << res.result_int();
-            co_return;
+            co_return false;
         }
     }
     catch(std::exception& e){
         qWarning() << "Error in sendRemoveReq: " << e.what();
+        co_return false;
     }
-    co_return;
+    co_return true;
+}
+
+void SpotifyClient::setSearchCachePath(const std::string& path){
+    if(path.empty()){
+        searchCache_.reset();
+        return;
+    }
+    // Clients of the transport share one cache of the path
+    searchCache_ = transport_->searchCache(path);
 }
 
 bool SpotifyClient::hasValidAccessToken() const{
+    std::lock_guard lock(tokenMutex_);
     return !accessToken_.empty()
     && std::chrono::steady_clock::now() < tokenExpiry_;
 }
+
+bool SpotifyClient::hasRefreshToken() const{
+    std::lock_guard lock(tokenMutex_);
+    return !refreshToken_.empty();
+}
+
+std::string SpotifyClient::getAccessToken() const{
+    std::lock_guard lock(tokenMutex_);
+    return accessToken_;
+}
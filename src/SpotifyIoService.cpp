@@ -1,43 +1,53 @@
 #include "SpotifyIoService.hpp"
 #include <QDebug>
+#include <algorithm>
 #include <thread>
+#include <vector>
 
 struct GlobalIoService::Impl {
     boost::asio::io_context io_ctx;
     boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_guard;
-    std::thread io_thread;
+    std::vector<std::thread> io_threads;
 
-    Impl()
-        : work_guard(boost::asio::make_work_guard(io_ctx))
+    explicit Impl(std::size_t threads)
+        : io_ctx(int(threads))
+        , work_guard(boost::asio::make_work_guard(io_ctx))
     {
-        io_thread = std::thread([this] {
-            try {
-                io_ctx.run();
-            } catch (...) {
-                qWarning() << "IO thread exception";
-            }
-        });
+        for (std::size_t i = 0; i < threads; ++i) {
+            io_threads.emplace_back([this] {
+                try {
+                    io_ctx.run();
+                } catch (std::exception& e) {
+                    qWarning() << "IO thread exception:" << e.what();
+                } catch (...) {
+                    qWarning() << "IO thread exception";
+                }
+            });
+        }
     }
 
     ~Impl() {
         work_guard.reset();
         io_ctx.stop();
 
-        if (io_thread.joinable()) {
-            try {
-                io_thread.join();
-            } catch (...) {
-                // Ignore
+        for (auto& io_thread : io_threads) {
+            if (io_thread.joinable()) {
+                try {
+                    io_thread.join();
+                } catch (...) {
+                    // Ignore
+                }
             }
         }
     }
 };
 
 std::unique_ptr<GlobalIoService::Impl> GlobalIoService::impl_;
+std::size_t GlobalIoService::threadCount_ = 0;
 
 boost::asio::io_context& GlobalIoService::instance() {
     if (!impl_) {
-        impl_ = std::make_unique<Impl>();
+        impl_ = std::make_unique<Impl>(threadCount());
     }
     return impl_->io_ctx;
 }
@@ -50,3 +60,15 @@ void GlobalIoService::start() {
 void GlobalIoService::stop() {
     impl_.reset();
 }
+
+void GlobalIoService::setThreadCount(std::size_t n) {
+    threadCount_ = n;
+}
+
+std::size_t GlobalIoService::threadCount() {
+    if (threadCount_ > 0) {
+        return threadCount_;
+    }
+    // TLS and JSON of parallel searches scale up to a few cores
+    return std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1, 4);
+}
@@ -0,0 +1,40 @@
+#include "SpotifyTransport.hpp"
+#include <QDebug>
+#include <QString>
+
+
+SpotifyTransport::SpotifyTransport() :
+    ssl_ctx_(boost::asio::ssl::context::tls_client)
+    , pool_(ssl_ctx_)
+{
+    // Off old protocols and compression
+    ssl_ctx_.set_options(
+        boost::asio::ssl::context::default_workarounds
+        | boost::asio::ssl::context::no_sslv2
+        | boost::asio::ssl::context::no_sslv3
+        | boost::asio::ssl::context::single_dh_use
+        );
+    // Optionally on OpenSSL level off the compression
+    SSL_CTX_set_options(
+        ssl_ctx_.native_handle(),
+        SSL_OP_NO_COMPRESSION
+        );
+
+    ssl_ctx_.set_default_verify_paths();
+
+    // Load CA bundle (certificates)
+    boost::system::error_code ec;
+    ssl_ctx_.load_verify_file("cacert.pem", ec);
+    if (ec) {
+        qWarning() << "Unable to load CA bundle:" << QString::fromStdString(ec.message());
+    }
+}
+
+std::shared_ptr<SearchCache> SpotifyTransport::searchCache(const std::string& path){
+    std::lock_guard lock(cacheMutex_);
+    if(!searchCache_ || searchCache_->path() != path){
+        // Old cache is flushed when its last client lets it go
+        searchCache_ = std::make_shared<SearchCache>(path);
+    }
+    return searchCache_;
+}
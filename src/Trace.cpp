@@ -0,0 +1,136 @@
+#include "Trace.hpp"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <QDebug>
+#include <QString>
+
+namespace {
+struct Event{
+    // 'b' or 'e'
+    char phase;
+    const char* name;
+    std::uint64_t lane;
+    // Microseconds since start
+    std::int64_t ts;
+    // Small number of the io thread
+    std::uint32_t tid;
+    std::string detail;
+};
+
+struct TraceState{
+    std::mutex mutex;
+    std::string path;
+    std::chrono::steady_clock::time_point origin;
+    std::vector<Event> events;
+};
+
+TraceState& state(){
+    static TraceState s;
+    return s;
+}
+
+std::atomic<std::uint64_t> nextLane{1};
+std::atomic<std::uint32_t> nextTid{1};
+
+std::uint32_t threadNumber(){
+    thread_local std::uint32_t tid = nextTid.fetch_add(1, std::memory_order_relaxed);
+    return tid;
+}
+
+void writeEscaped(std::ostream& out, std::string_view s){
+    for(unsigned char c : s){
+        if(c == '"' || c == '\\'){
+            out << '\\' << char(c);
+        }
+        else if(c < 0x20){
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out << buf;
+        }
+        else{
+            out << char(c);
+        }
+    }
+}
+
+void record(char phase, const char* name, std::uint64_t lane, std::string_view detail){
+    auto now = std::chrono::steady_clock::now();
+    auto tid = threadNumber();
+    auto& s = state();
+    std::lock_guard lock(s.mutex);
+    // Span opened before stop() ends after it
+    if(!Tracer::enabled()){
+        return;
+    }
+    auto ts = std::chrono::duration_cast<std::chrono::microseconds>(now - s.origin).count();
+    s.events.push_back({phase, name, lane, ts, tid, std::string(detail)});
+}
+}
+
+void Tracer::start(std::string path){
+    auto& s = state();
+    std::lock_guard lock(s.mutex);
+    s.path = std::move(path);
+    s.origin = std::chrono::steady_clock::now();
+    s.events.clear();
+    s.events.reserve(1 << 16);
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+bool Tracer::stop(){
+    auto& s = state();
+    std::vector<Event> events;
+    std::string path;
+    {
+        std::lock_guard lock(s.mutex);
+        if(!enabled()){
+            return false;
+        }
+        enabled_.store(false, std::memory_order_relaxed);
+        events.swap(s.events);
+        path.swap(s.path);
+    }
+
+    std::ofstream out(path, std::ios::trunc);
+    if(!out){
+        qWarning() << "Cannot write trace to" << QString::fromStdString(path);
+        return false;
+    }
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+        << R"({"ph":"M","pid":1,"name":"process_name","args":{"name":"ExportLikes"}})";
+    for(const auto& e : events){
+        out << ",\n{\"ph\":\"" << e.phase << "\",\"cat\":\"exportlikes\",\"name\":\"";
+        writeEscaped(out, e.name);
+        out << "\",\"id\":\"0x" << std::hex << e.lane << std::dec
+            << "\",\"pid\":1,\"tid\":" << e.tid << ",\"ts\":" << e.ts;
+        if(e.phase == 'b'){
+            out << ",\"args\":{\"lane\":" << e.lane;
+            if(!e.detail.empty()){
+                out << ",\"detail\":\"";
+                writeEscaped(out, e.detail);
+                out << "\"";
+            }
+            out << "}";
+        }
+        out << "}";
+    }
+    out << "\n]}\n";
+    qDebug() << "Trace of" << events.size() << "events written to" << QString::fromStdString(path);
+    return bool(out);
+}
+
+std::uint64_t Tracer::newLane(){
+    return nextLane.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Tracer::begin(const char* name, std::uint64_t lane, std::string_view detail){
+    record('b', name, lane, detail);
+}
+
+void Tracer::end(const char* name, std::uint64_t lane){
+    record('e', name, lane, {});
+}
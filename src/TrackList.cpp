@@ -0,0 +1,270 @@
+#include "TrackList.hpp"
+#include "SearchCache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <QDebug>
+
+namespace {
+constexpr char kMagic[8] = {'E', 'L', 'T', 'R', 'A', 'C', 'K', '1'};
+
+// Spotify id width
+constexpr std::size_t kIdSize = 22;
+
+enum Flags : std::uint32_t{ HasKeys = 1 };
+
+struct Header{
+    char magic[8];
+    std::uint32_t flags;
+    // kTrackKeyVersion the keys were computed with
+    std::uint32_t keyVersion;
+    std::uint64_t records;
+    std::uint64_t artists;
+    std::uint64_t artistBytes;
+    std::uint64_t titleBytes;
+    std::uint64_t ids;
+};
+
+std::uint64_t align8(std::uint64_t n){
+    return (n + 7) & ~std::uint64_t(7);
+}
+
+// Section offsets, derived from the header counts
+struct Layout{
+    std::uint64_t artistOffsets;
+    std::uint64_t artistBytes;
+    std::uint64_t recordArtists;
+    std::uint64_t titleOffsets;
+    std::uint64_t titleBytes;
+    std::uint64_t keys;
+    std::uint64_t idRecords;
+    std::uint64_t idBytes;
+    std::uint64_t end;
+
+    explicit Layout(const Header& h){
+        std::uint64_t pos = align8(sizeof(Header));
+        auto next = [&pos](std::uint64_t bytes){
+            auto at = pos;
+            pos = align8(pos + bytes);
+            return at;
+        };
+        artistOffsets = next((h.artists + 1) * sizeof(std::uint32_t));
+        artistBytes = next(h.artistBytes);
+        recordArtists = next(h.records * sizeof(std::uint32_t));
+        titleOffsets = next((h.records + 1) * sizeof(std::uint32_t));
+        titleBytes = next(h.titleBytes);
+        keys = next((h.flags & HasKeys) ? h.records * sizeof(std::uint64_t) : 0);
+        idRecords = next(h.ids * sizeof(std::uint32_t));
+        idBytes = next(h.ids * kIdSize);
+        end = pos;
+    }
+};
+
+// Offsets never go back and the last one closes the byte block
+bool validOffsets(const std::uint32_t* offsets, std::size_t count, std::uint64_t bytes){
+    if(offsets[0] != 0 || offsets[count] != bytes){
+        return false;
+    }
+    for(std::size_t i = 0; i < count; ++i){
+        if(offsets[i] > offsets[i + 1]){
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+
+TrackList::TrackList(const std::string& path){
+    namespace bip = boost::interprocess;
+
+    auto size = std::filesystem::file_size(path);
+    if(size < sizeof(Header)){
+        throw std::runtime_error("Track list is truncated");
+    }
+    file_ = bip::file_mapping(path.c_str(), bip::read_only);
+    region_ = bip::mapped_region(file_, bip::read_only);
+    auto* base = static_cast<const char*>(region_.get_address());
+
+    Header header;
+    std::memcpy(&header, base, sizeof(header));
+    if(std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0){
+        throw std::runtime_error("Not a track list");
+    }
+    // Counts beyond u32 offsets cannot come from TrackListWriter
+    constexpr std::uint64_t kLimit = std::numeric_limits<std::uint32_t>::max();
+    if(header.records > kLimit || header.artists > kLimit
+        || header.artistBytes > kLimit || header.titleBytes > kLimit
+        || header.ids > header.records){
+        throw std::runtime_error("Track list header is malformed");
+    }
+    Layout layout(header);
+    if(layout.end > size){
+        throw std::runtime_error("Track list is truncated");
+    }
+
+    records_ = std::size_t(header.records);
+    artists_ = std::size_t(header.artists);
+    // Sections are 8-byte aligned in a page-aligned mapping
+    artistOffsets_ = reinterpret_cast<const std::uint32_t*>(base + layout.artistOffsets);
+    artistBytes_ = base + layout.artistBytes;
+    recordArtists_ = reinterpret_cast<const std::uint32_t*>(base + layout.recordArtists);
+    titleOffsets_ = reinterpret_cast<const std::uint32_t*>(base + layout.titleOffsets);
+    titleBytes_ = base + layout.titleBytes;
+
+    // Checked once here, accessors trust the file afterwards
+    if(!validOffsets(artistOffsets_, artists_, header.artistBytes)
+        || !validOffsets(titleOffsets_, records_, header.titleBytes)){
+        throw std::runtime_error("Track list offsets are malformed");
+    }
+    for(std::size_t i = 0; i < records_; ++i){
+        if(recordArtists_[i] >= artists_){
+            throw std::runtime_error("Track list artist index is out of range");
+        }
+    }
+    ids_ = std::size_t(header.ids);
+    idRecords_ = reinterpret_cast<const std::uint32_t*>(base + layout.idRecords);
+    idBytes_ = base + layout.idBytes;
+    for(std::size_t i = 0; i < ids_; ++i){
+        if(idRecords_[i] >= records_ || (i > 0 && idRecords_[i] <= idRecords_[i - 1])){
+            throw std::runtime_error("Track list id records are malformed");
+        }
+    }
+
+    if(header.flags & HasKeys){
+        if(header.keyVersion == kTrackKeyVersion){
+            keys_ = reinterpret_cast<const std::uint64_t*>(base + layout.keys);
+        }
+        else{
+            qDebug() << "Track list keys are stale, computing them again";
+        }
+    }
+}
+
+bool TrackList::detect(const std::string& path){
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(kMagic)] = {};
+    in.read(magic, sizeof(magic));
+    return in && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+std::string_view TrackList::artist(std::size_t i) const{
+    auto a = recordArtists_[i];
+    return {artistBytes_ + artistOffsets_[a], artistOffsets_[a + 1] - artistOffsets_[a]};
+}
+
+std::string_view TrackList::title(std::size_t i) const{
+    return {titleBytes_ + titleOffsets_[i], titleOffsets_[i + 1] - titleOffsets_[i]};
+}
+
+std::uint64_t TrackList::key(std::size_t i) const{
+    return keys_[i];
+}
+
+std::string_view TrackList::id(std::size_t i) const{
+    auto* end = idRecords_ + ids_;
+    auto* it = std::lower_bound(idRecords_, end, std::uint32_t(i));
+    if(it == end || *it != i){
+        return {};
+    }
+    return {idBytes_ + (it - idRecords_) * kIdSize, kIdSize};
+}
+
+void TrackList::read(std::size_t i, TrackRecord& rec) const{
+    rec.artist.assign(artist(i));
+    rec.title.assign(title(i));
+    rec.id.assign(id(i));
+    if(keys_){
+        rec.key = keys_[i];
+    }
+    else{
+        rec.key.reset();
+    }
+}
+
+
+void TrackListWriter::add(std::string_view artist, std::string_view title, std::string_view id){
+    auto [it, fresh] = artistIndex_.try_emplace(std::string(artist),
+                                                std::uint32_t(artistOffsets_.size() - 1));
+    if(fresh){
+        artistBytes_.append(artist);
+        artistOffsets_.push_back(std::uint32_t(artistBytes_.size()));
+    }
+    recordArtists_.push_back(it->second);
+
+    titleBytes_.append(title);
+    titleOffsets_.push_back(std::uint32_t(titleBytes_.size()));
+
+    if(isSpotifyId(id)){
+        idRecords_.push_back(std::uint32_t(recordArtists_.size() - 1));
+        idBytes_.append(id);
+    }
+}
+
+void TrackListWriter::write(const std::string& path, bool withKeys) const{
+    constexpr std::size_t kLimit = std::numeric_limits<std::uint32_t>::max();
+    if(artistBytes_.size() > kLimit || titleBytes_.size() > kLimit
+        || recordArtists_.size() > kLimit){
+        throw std::runtime_error("Track list columns are over 4 GiB");
+    }
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.flags = withKeys ? HasKeys : 0;
+    header.keyVersion = kTrackKeyVersion;
+    header.records = recordArtists_.size();
+    header.artists = artistOffsets_.size() - 1;
+    header.artistBytes = artistBytes_.size();
+    header.titleBytes = titleBytes_.size();
+    header.ids = idRecords_.size();
+    Layout layout(header);
+
+    // Artist part of the key is normalized once per artist
+    std::vector<std::uint64_t> keys;
+    if(withKeys){
+        std::vector<std::uint64_t> prefixes(artistOffsets_.size() - 1);
+        for(std::size_t a = 0; a < prefixes.size(); ++a){
+            prefixes[a] = artistKeyPrefix(artistBytes_.substr(
+                artistOffsets_[a], artistOffsets_[a + 1] - artistOffsets_[a]));
+        }
+        keys.reserve(recordArtists_.size());
+        for(std::size_t i = 0; i < recordArtists_.size(); ++i){
+            keys.push_back(trackKeyOfTitle(prefixes[recordArtists_[i]], titleBytes_.substr(
+                titleOffsets_[i], titleOffsets_[i + 1] - titleOffsets_[i])));
+        }
+    }
+
+    // Write aside and swap, so a failed write keeps the old file
+    auto tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if(!out){
+            throw std::runtime_error("Unable to create " + tmpPath);
+        }
+        std::uint64_t pos = 0;
+        auto section = [&](std::uint64_t at, const void* data, std::size_t bytes){
+            static const char zeros[8] = {};
+            out.write(zeros, std::streamsize(at - pos));
+            out.write(static_cast<const char*>(data), std::streamsize(bytes));
+            pos = at + bytes;
+        };
+        section(0, &header, sizeof(header));
+        section(layout.artistOffsets, artistOffsets_.data(), artistOffsets_.size() * sizeof(std::uint32_t));
+        section(layout.artistBytes, artistBytes_.data(), artistBytes_.size());
+        section(layout.recordArtists, recordArtists_.data(), recordArtists_.size() * sizeof(std::uint32_t));
+        section(layout.titleOffsets, titleOffsets_.data(), titleOffsets_.size() * sizeof(std::uint32_t));
+        section(layout.titleBytes, titleBytes_.data(), titleBytes_.size());
+        section(layout.keys, keys.data(), keys.size() * sizeof(std::uint64_t));
+        section(layout.idRecords, idRecords_.data(), idRecords_.size() * sizeof(std::uint32_t));
+        section(layout.idBytes, idBytes_.data(), idBytes_.size());
+        section(layout.end, nullptr, 0);
+        if(!out.flush()){
+            throw std::runtime_error("Unable to write " + tmpPath);
+        }
+    }
+    std::filesystem::rename(tmpPath, path);
+}
@@ -0,0 +1,179 @@
+#include "TrackReader.hpp"
+#include "JsonScan.hpp"
+#include <filesystem>
+#include <stdexcept>
+#include <string_view>
+
+
+TrackReader::TrackReader(const std::string& path){
+    namespace bip = boost::interprocess;
+
+    // Empty file cannot be mapped
+    if(std::filesystem::file_size(path) == 0){
+        finished_ = true;
+        return;
+    }
+
+    file_ = bip::file_mapping(path.c_str(), bip::read_only);
+    region_ = bip::mapped_region(file_, bip::read_only);
+    // Pages are read once front to back: let the OS read ahead and drop them
+    region_.advise(bip::mapped_region::advice_sequential);
+
+    begin_ = static_cast<const char*>(region_.get_address());
+    end_ = begin_ + region_.get_size();
+    start();
+}
+
+TrackReader::TrackReader(const char* data, std::size_t size){
+    begin_ = data;
+    end_ = begin_ + size;
+    start();
+}
+
+void TrackReader::start(){
+    pos_ = begin_;
+    if(!begin_){
+        finished_ = true;
+        return;
+    }
+
+    // UTF-8 BOM
+    if(end_ - pos_ >= 3 && std::string_view(pos_, 3) == "\xEF\xBB\xBF"){
+        pos_ += 3;
+    }
+
+    pos_ = jsonSkipWhitespace(pos_, end_);
+    if(pos_ == end_){
+        finished_ = true;
+        return;
+    }
+    if(*pos_ == '['){
+        ++pos_;
+    }
+    else if(*pos_ == '{'){
+        ndjson_ = true;
+    }
+    else{
+        fail("expected '[' or '{'");
+    }
+}
+
+bool TrackReader::next(TrackRecord& rec){
+    while(!finished_){
+        pos_ = jsonSkipWhitespace(pos_, end_);
+
+        if(ndjson_){
+            if(pos_ == end_){
+                finished_ = true;
+                break;
+            }
+            if(*pos_ != '{'){
+                fail("expected '{'");
+            }
+            parseObject(rec);
+            return true;
+        }
+
+        // Array: separators between elements
+        if(pos_ == end_){
+            fail("unterminated array");
+        }
+        if(*pos_ == ']'){
+            finished_ = true;
+            break;
+        }
+        if(*pos_ == ','){
+            ++pos_;
+            continue;
+        }
+        if(*pos_ == '{'){
+            parseObject(rec);
+            return true;
+        }
+
+        // Not an object: skip as before
+        auto* after = jsonSkipValue(pos_, end_);
+        if(!after){
+            fail("malformed value");
+        }
+        pos_ = after;
+    }
+    return false;
+}
+
+bool isSpotifyId(std::string_view id){
+    if(id.size() != 22){
+        return false;
+    }
+    for(char c : id){
+        bool alnum = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        if(!alnum){
+            return false;
+        }
+    }
+    return true;
+}
+
+void TrackReader::parseObject(TrackRecord& rec){
+    rec.artist.clear();
+    rec.title.clear();
+    rec.id.clear();
+    rec.key.reset();
+
+    // pos_ at '{'
+    ++pos_;
+    std::string key;
+    while(true){
+        pos_ = jsonSkipWhitespace(pos_, end_);
+        if(pos_ == end_){
+            fail("unterminated object");
+        }
+        if(*pos_ == '}'){
+            ++pos_;
+            return;
+        }
+        if(*pos_ == ','){
+            ++pos_;
+            continue;
+        }
+
+        // "key" : value
+        const char* afterKey = jsonParseString(pos_, end_, key);
+        if(!afterKey){
+            fail("malformed key");
+        }
+        pos_ = jsonSkipWhitespace(afterKey, end_);
+        if(pos_ == end_ || *pos_ != ':'){
+            fail("expected ':'");
+        }
+        pos_ = jsonSkipWhitespace(pos_ + 1, end_);
+
+        std::string* target = nullptr;
+        if(key == "artist"){
+            target = &rec.artist;
+        }
+        else if(key == "title"){
+            target = &rec.title;
+        }
+        else if(key == "id"){
+            target = &rec.id;
+        }
+
+        const char* after = nullptr;
+        if(target && pos_ < end_ && *pos_ == '"'){
+            after = jsonParseString(pos_, end_, *target);
+        }
+        else{
+            after = jsonSkipValue(pos_, end_);
+        }
+        if(!after){
+            fail("malformed value");
+        }
+        pos_ = after;
+    }
+}
+
+void TrackReader::fail(const char* what) const{
+    throw std::runtime_error(std::string("Invalid track file at byte ")
+                             + std::to_string(pos_ - begin_) + ": " + what);
+}
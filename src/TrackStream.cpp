@@ -0,0 +1,130 @@
+#include "TrackStream.hpp"
+#include "JsonScan.hpp"
+
+#include <QDebug>
+#include <QString>
+#include <boost/asio/post.hpp>
+
+namespace {
+// Consumed prefix of the buffer is dropped once it is this large
+constexpr std::size_t kCompactAfter = 64 * 1024;
+}
+
+
+TrackStream::TrackStream(boost::asio::any_io_executor executor) :
+    executor_(std::move(executor))
+{}
+
+void TrackStream::append(std::string_view bytes){
+    if(bytes.empty()){
+        return;
+    }
+    bool wake = false;
+    {
+        std::lock_guard lock(mutex_);
+        if(closed_){
+            return;
+        }
+        // Reader waits only for a line end
+        wake = bytes.find('\n') != std::string_view::npos;
+        buffer_.append(bytes);
+    }
+    if(wake){
+        notify();
+    }
+}
+
+void TrackStream::close(bool complete){
+    {
+        std::lock_guard lock(mutex_);
+        if(closed_){
+            return;
+        }
+        closed_ = true;
+        complete_ = complete;
+    }
+    notify();
+}
+
+bool TrackStream::complete() const{
+    std::lock_guard lock(mutex_);
+    return closed_ && complete_;
+}
+
+void TrackStream::notify(){
+    // Waiter is resumed on the executor: no wakeup is lost between
+    // its check of the buffer and its wait
+    boost::asio::post(executor_, [self = shared_from_this()]{
+        self->arrived_.notifyAll();
+    });
+}
+
+boost::asio::awaitable<bool> TrackStream::next(TrackRecord& rec){
+    while(true){
+        bool closed = false;
+        bool found = false;
+        {
+            std::lock_guard lock(mutex_);
+            auto end = buffer_.find('\n', head_);
+            if(end != std::string::npos){
+                line_.assign(buffer_, head_, end - head_);
+                head_ = end + 1;
+                found = true;
+            }
+            else if(closed_ && head_ < buffer_.size()){
+                // Last line without its line end
+                line_.assign(buffer_, head_);
+                head_ = buffer_.size();
+                found = true;
+            }
+            closed = closed_;
+            if(head_ >= kCompactAfter || head_ == buffer_.size()){
+                buffer_.erase(0, head_);
+                head_ = 0;
+            }
+        }
+
+        if(found){
+            if(parseLine(line_, rec)){
+                ++received_;
+                co_return true;
+            }
+            continue;
+        }
+        if(closed){
+            co_return false;
+        }
+        co_await arrived_.wait();
+    }
+}
+
+bool TrackStream::parseLine(std::string_view line, TrackRecord& rec){
+    const char* begin = line.data();
+    const char* end = begin + line.size();
+    const char* p = jsonSkipWhitespace(begin, end);
+    if(p == end){
+        return false;
+    }
+    if(*p != '{'){
+        qWarning() << "Track stream: not a JSON object:"
+                   << QString::fromUtf8(begin, int(line.size()));
+        return false;
+    }
+
+    long long total = 0;
+    if(jsonGetInteger(p, end, "total", total)){
+        if(total > 0){
+            total_.store(std::size_t(total), std::memory_order_relaxed);
+        }
+        return false;
+    }
+
+    try{
+        TrackReader reader(line.data(), line.size());
+        return reader.next(rec);
+    }
+    catch(std::exception& e){
+        qWarning() << "Track stream: malformed line skipped:" << e.what();
+        return false;
+    }
+}
@@ -0,0 +1,49 @@
+#include "UrlEncode.hpp"
+#include <array>
+
+namespace {
+// true for A-Z a-z 0-9 - . _ ~
+constexpr std::array<bool, 256> makeUnreserved(){
+    std::array<bool, 256> table{};
+    for(int c = 'A'; c <= 'Z'; ++c) table[c] = true;
+    for(int c = 'a'; c <= 'z'; ++c) table[c] = true;
+    for(int c = '0'; c <= '9'; ++c) table[c] = true;
+    table['-'] = table['.'] = table['_'] = table['~'] = true;
+    return table;
+}
+
+constexpr auto kUnreserved = makeUnreserved();
+constexpr char kHex[] = "0123456789ABCDEF";
+}
+
+void appendUrlEncoded(std::string& out, std::string_view text){
+    out.reserve(out.size() + urlEncodedSize(text));
+
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while(p < end){
+        // Copy a run of safe bytes in one go
+        const char* run = p;
+        while(p < end && kUnreserved[static_cast<unsigned char>(*p)]){
+            ++p;
+        }
+        out.append(run, p);
+        if(p == end){
+            break;
+        }
+
+        auto c = static_cast<unsigned char>(*p++);
+        char escaped[3] = {'%', kHex[c >> 4], kHex[c & 0xf]};
+        out.append(escaped, 3);
+    }
+}
+
+std::size_t urlEncodedSize(std::string_view text){
+    std::size_t size = text.size();
+    for(unsigned char c : text){
+        if(!kUnreserved[c]){
+            size += 2;
+        }
+    }
+    return size;
+}
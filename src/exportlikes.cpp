@@ -1,5 +1,6 @@
 #include "exportlikes.hpp"
 #include "./ui_exportlikes.h"
+#include "TrackStream.hpp"
 
 #include <QFileDialog>
 #include <QInputDialog>
@@ -8,23 +9,64 @@
 #include <QDir>
 #include <QFile>
 #include <QProcess>
+#include <QScrollBar>
+#include <string_view>
+#include <utility>
+
+namespace {
+// Progress label refresh, 10 frames per second
+constexpr int kProgressIntervalMs = 100;
+
+// Lines kept in the log view, older ones are only in the log file
+constexpr std::size_t kLogCapacity = 10000;
+
+QString formatDuration(std::chrono::seconds s){
+    auto total = s.count();
+    if(total >= 3600){
+        return QString("%1:%2:%3").arg(total / 3600)
+            .arg(total / 60 % 60, 2, 10, QChar('0')).arg(total % 60, 2, 10, QChar('0'));
+    }
+    return QString("%1:%2").arg(total / 60).arg(total % 60, 2, 10, QChar('0'));
+}
+}
 
 ExportLikes::ExportLikes(QWidget* parent)
     : QMainWindow(parent),
     ui(new Ui::ExportLikes),
-    spotifyClient_(new QtSpotifyClient(this))
+    spotifyClient_(new QtSpotifyClient(this)),
+    logModel_(new LogModel(kLogCapacity, this))
 {
     ui->setupUi(this);
 
+    // Log: bounded model, the view only paints visible rows
+    ui->logView->setModel(logModel_);
+    QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+    QDir().mkpath(dataDir);
+    logModel_->setSpillFile(dataDir + "/exportlikes.log");
+    connect(logModel_, &LogModel::rowsAboutToBeInserted, this, [this]{
+        auto* bar = ui->logView->verticalScrollBar();
+        followLog_ = bar->value() == bar->maximum();
+    });
+    connect(logModel_, &LogModel::rowsInserted, this, [this]{
+        if(followLog_){
+            ui->logView->scrollToBottom();
+        }
+    });
+
     // Connect signals
     connect(ui->addButton, &QPushButton::clicked, this, &ExportLikes::onAddTracksClicked);
     connect(spotifyClient_, &QtSpotifyClient::logMessage, this, &ExportLikes::onLogMessage);
-    connect(spotifyClient_, &QtSpotifyClient::progress, this, &ExportLikes::onProgress);
+    progressSampler_ = std::make_unique<ProgressSampler>(spotifyClient_->progress());
+    progressTimer_.setInterval(kProgressIntervalMs);
+    connect(&progressTimer_, &QTimer::timeout, this, &ExportLikes::onProgressTick);
     connect(spotifyClient_, &QtSpotifyClient::finishedAdding, this, &ExportLikes::onFinishedAdding);
 
     connect(ui->removeButton, &QPushButton::clicked, this, &ExportLikes::onRemoveTracksClicked);
     connect(spotifyClient_, &QtSpotifyClient::finishedRemoving, this, &ExportLikes::onFinishedRemoving);
 
+    connect(ui->stopButton, &QPushButton::clicked, this, &ExportLikes::onStopClicked);
+    connect(ui->pauseButton, &QPushButton::clicked, this, &ExportLikes::onPauseClicked);
+
     connect(ui->authButton, &QPushButton::clicked, this, &ExportLikes::onAuthButtonClicked);
     connect(spotifyClient_, &QtSpotifyClient::reauthorization, this, &ExportLikes::onReauthorization);
     connect(spotifyClient_, &QtSpotifyClient::finishedAuthorization, this, &ExportLikes::onFinishedAuthorization);
@@ -70,7 +112,7 @@ bool ExportLikes::saveEnvFile(const QString& token){
         return false;
     }
 
-    ui->logView->append(".env path: " + envPath);
+    appendLog(".env path: " + envPath);
 
     QTextStream out(&f);
     out << "YANDEX_TOKEN=" << token << "\n";
@@ -96,33 +138,77 @@ void ExportLikes::onGetTracksClicked(){
         return;
     }
 
+    // Stream mode: stdout carries NDJSON tracks straight into the import,
+    // searches overlap with the export and no file is saved
+    std::shared_ptr<TrackStream> stream;
+    if(ui->chbStreamImport->isChecked() && ui->addButton->isEnabled()){
+        stream = spotifyClient_->createTrackStream();
+    }
+
     // Launch script
     // Connect output
     auto* proc = new QProcess(this);
-    connect(proc, &QProcess::readyReadStandardOutput, [this, proc](){
-        ui->logView->append(QString::fromLocal8Bit(proc->readAllStandardOutput()));
+    connect(proc, &QProcess::readyReadStandardOutput, [this, proc, stream](){
+        QByteArray bytes = proc->readAllStandardOutput();
+        if(stream){
+            stream->append(std::string_view(bytes.constData(), std::size_t(bytes.size())));
+            return;
+        }
+        appendLog(QString::fromLocal8Bit(bytes));
     });
 
-    // Connect errors
-    connect(proc, &QProcess::readyReadStandardError, [this,proc]() {
-        ui->logView->append("<font color=\"red\">" +
-                      QString::fromLocal8Bit(proc->readAllStandardError()) +
-                      "</font>");
+    // Connect errors. In stream mode the script logs there too
+    connect(proc, &QProcess::readyReadStandardError, [this, proc, stream]() {
+        appendLog(QString::fromLocal8Bit(proc->readAllStandardError()),
+                  stream ? LogModel::Level::Info : LogModel::Level::Error);
     });
 
     // Connect executing status
     connect(proc, QOverload<int,QProcess::ExitStatus>::of(&QProcess::finished),
-            [this,proc](int code, QProcess::ExitStatus status){
-                ui->logView->append(
-                    code == 0 ? "Script finished successfully"
-                              : QString("<font color=\"red\">Script crashed, exit code %1</font>")
-                                    .arg(code)
-                    );
+            [this, proc, stream](int code, QProcess::ExitStatus status){
+                bool ok = code == 0 && status == QProcess::NormalExit;
+                if(ok){
+                    appendLog("Script finished successfully");
+                }
+                else{
+                    appendLog(QString("Script crashed, exit code %1").arg(code), LogModel::Level::Error);
+                }
+                // Import ends once it has read what arrived
+                if(stream){
+                    QByteArray rest = proc->readAllStandardOutput();
+                    stream->append(std::string_view(rest.constData(), std::size_t(rest.size())));
+                    stream->close(ok);
+                }
+                ui->getTracksButton->setEnabled(true);
                 proc->deleteLater();
             });
 
+    // finished is not emitted for a script that did not start
+    connect(proc, &QProcess::errorOccurred, [this, proc, stream](QProcess::ProcessError error){
+        if(error != QProcess::FailedToStart){
+            return;
+        }
+        appendLog("Script failed to start: " + proc->errorString(), LogModel::Level::Error);
+        if(stream){
+            stream->close(false);
+        }
+        ui->getTracksButton->setEnabled(true);
+        proc->deleteLater();
+    });
+
     // Start script
-    ui->logView->append("Starting script...");
+    appendLog("Starting script...");
+    ui->getTracksButton->setEnabled(false);
+    if(stream){
+        streamExporter_ = proc;
+        streamImport_ = true;
+        proc->start(scriptPath, {"--stream"});
+        spotifyClient_->addTracksFromStream(stream);
+        ui->addButton->setEnabled(false);
+        setPipelineRunning(true);
+        startProgress();
+        return;
+    }
     proc->start(scriptPath);
 }
 
@@ -132,7 +218,7 @@ void ExportLikes::onAddTracksClicked(){
         this,
         "Chose JSON file with tracks",
         "",
-        "JSON Files (*.json)"
+        "Track lists (*.json *.ndjson *.tracks);;JSON Files (*.json *.ndjson);;Binary track lists (*.tracks)"
     );
     if(path.isEmpty()){
         return;
@@ -144,19 +230,58 @@ void ExportLikes::onAddTracksClicked(){
     // Launch pipeline
     spotifyClient_->addTracks();
     ui->addButton->setEnabled(false);
+    setPipelineRunning(true);
+    startProgress();
+}
+
+void ExportLikes::appendLog(const QString& text, LogModel::Level level){
+    logModel_->append(text, level);
 }
 
 void ExportLikes::onLogMessage(const QString& msg){
-    ui->logView->append("🛈 " + msg);
+    appendLog("🛈 " + msg);
+}
+
+void ExportLikes::startProgress(){
+    if(!progressTimer_.isActive()){
+        progressTimer_.start();
+    }
 }
 
-void ExportLikes::onProgress(int current, int total){
-    ui->progressLabel->setText(QString("Progress: %1/%2").arg(current).arg(total));
+void ExportLikes::stopProgress(){
+    progressTimer_.stop();
+    // Final numbers
+    onProgressTick();
+}
+
+void ExportLikes::onProgressTick(){
+    auto snapshot = progressSampler_->sample();
+    QString text = QString("Progress: %1/%2").arg(snapshot.done).arg(snapshot.total);
+    if(snapshot.running){
+        if(snapshot.rate > 0.0){
+            text += QString(" · %1/s").arg(snapshot.rate, 0, 'f', 1);
+        }
+        if(snapshot.eta){
+            text += " · ETA " + formatDuration(*snapshot.eta);
+        }
+    }
+    else if(snapshot.elapsed.count() > 0){
+        text += " · done in " + formatDuration(
+            std::chrono::duration_cast<std::chrono::seconds>(snapshot.elapsed));
+    }
+    ui->progressLabel->setText(text);
 }
 
 void ExportLikes::onFinishedAdding(bool success){
+    stopProgress();
+    setPipelineRunning(false);
     ui->addButton->setEnabled(true);
-    if(success){
+    bool streamed = std::exchange(streamImport_, false);
+    if(std::exchange(stopRequested_, false)){
+        appendLog(streamed ? "Import stopped"
+                           : "Import stopped, add the same file again to resume");
+    }
+    else if(success){
         QMessageBox::information(this, "Done",
             "Tracks has been successfuly added to Spotify \"Liked library\"");
     }
@@ -184,11 +309,18 @@ void ExportLikes::onRemoveTracksClicked(){
 
     spotifyClient_->removeLastNTracks(n);
     ui->removeButton->setEnabled(false);
+    setPipelineRunning(true);
+    startProgress();
 }
 
 void ExportLikes::onFinishedRemoving(bool success){
+    stopProgress();
+    setPipelineRunning(false);
     ui->removeButton->setEnabled(true);
-    if(success){
+    if(std::exchange(stopRequested_, false)){
+        appendLog("Removal stopped");
+    }
+    else if(success){
         QMessageBox::information(this, "Done",
                                  "Tracks has been successfuly removed from Spotify \"Liked library\"");
     }
@@ -198,6 +330,37 @@ void ExportLikes::onFinishedRemoving(bool success){
     }
 }
 
+void ExportLikes::onStopClicked(){
+    stopRequested_ = true;
+    // Nothing reads the export any more
+    if(streamExporter_){
+        streamExporter_->kill();
+    }
+    spotifyClient_->stop();
+    ui->stopButton->setEnabled(false);
+    ui->pauseButton->setEnabled(false);
+    appendLog("Stopping: waiting for requests in flight...");
+}
+
+void ExportLikes::onPauseClicked(){
+    if(ui->pauseButton->text() == "Pause"){
+        spotifyClient_->pause();
+        ui->pauseButton->setText("Resume");
+        appendLog("Paused");
+    }
+    else{
+        spotifyClient_->resume();
+        ui->pauseButton->setText("Pause");
+        appendLog("Resumed");
+    }
+}
+
+void ExportLikes::setPipelineRunning(bool running){
+    ui->stopButton->setEnabled(running);
+    ui->pauseButton->setEnabled(running);
+    ui->pauseButton->setText("Pause");
+}
+
 void ExportLikes::onFinishedAuthorization(bool success){
     ui->authButton->setEnabled(true);
     if(success){
@@ -205,6 +368,7 @@ void ExportLikes::onFinishedAuthorization(bool success){
                                  "Authorization is successful");
         ui->addButton->setEnabled(true);
         ui->removeButton->setEnabled(true);
+        ui->chbStreamImport->setEnabled(true);
     }
     else{
         QMessageBox::information(this, "Error",
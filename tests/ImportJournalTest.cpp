@@ -0,0 +1,155 @@
+#include "ImportJournal.hpp"
+#include "TestFiles.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+// On-disk layout: magic and input fingerprint, then records of
+// position, kind, a reserved word and a zero padded id
+constexpr std::size_t kHeaderSize = 16;
+constexpr std::size_t kRecordSize = 40;
+
+const std::string kAccount = "alice";
+const std::string kId = "4uLU6hMCjMI75M1A2tKUQC";
+const std::string kOtherId = "7ouMYWpwJ422jRcDASZB7P";
+
+// Input whose journal is tested
+std::string makeInput(const TempDir& dir){
+    auto path = dir.file("likes.json");
+    writeFile(path, R"([{"artist":"A","title":"T"}])");
+    return path;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(ImportJournalTest)
+
+BOOST_AUTO_TEST_CASE(progress_is_resumed){
+    TempDir dir;
+    auto input = makeInput(dir);
+    {
+        ImportJournal journal(input, kAccount, true);
+        BOOST_TEST(journal.committed() == 0u);
+        journal.recordResolved(3, kId);
+        journal.recordResolved(7, "");
+        journal.recordResolved(12, kOtherId);
+        journal.recordCommitted(5);
+    }
+    ImportJournal journal(input, kAccount, true);
+    BOOST_TEST(journal.committed() == 5u);
+    // Results before the watermark are not kept
+    BOOST_TEST(!journal.resolved(3));
+    BOOST_TEST(journal.resolved(7).value() == "");
+    BOOST_TEST(journal.resolved(12).value() == kOtherId);
+    BOOST_TEST(!journal.resolved(8));
+    BOOST_TEST(journal.resumedResults() == 2u);
+}
+
+BOOST_AUTO_TEST_CASE(watermark_never_goes_back){
+    TempDir dir;
+    auto input = makeInput(dir);
+    {
+        ImportJournal journal(input, kAccount, true);
+        journal.recordCommitted(10);
+        journal.recordCommitted(4);
+        BOOST_TEST(journal.committed() == 10u);
+    }
+    ImportJournal journal(input, kAccount, true);
+    BOOST_TEST(journal.committed() == 10u);
+}
+
+BOOST_AUTO_TEST_CASE(no_resume_starts_over){
+    TempDir dir;
+    auto input = makeInput(dir);
+    {
+        ImportJournal journal(input, kAccount, true);
+        journal.recordCommitted(5);
+    }
+    {
+        ImportJournal journal(input, kAccount, false);
+        BOOST_TEST(journal.committed() == 0u);
+    }
+    ImportJournal journal(input, kAccount, true);
+    BOOST_TEST(journal.committed() == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(journal_of_changed_input_is_ignored){
+    TempDir dir;
+    auto input = makeInput(dir);
+    {
+        ImportJournal journal(input, kAccount, true);
+        journal.recordResolved(0, kId);
+        journal.recordCommitted(1);
+    }
+    appendFile(input, "\n");
+    ImportJournal journal(input, kAccount, true);
+    BOOST_TEST(journal.committed() == 0u);
+    BOOST_TEST(!journal.resolved(0));
+}
+
+BOOST_AUTO_TEST_CASE(accounts_have_their_own_journals){
+    TempDir dir;
+    auto input = makeInput(dir);
+    BOOST_TEST(ImportJournal::pathFor(input, kAccount) != ImportJournal::pathFor(input, "bob"));
+    {
+        ImportJournal journal(input, kAccount, true);
+        journal.recordResolved(3, kId);
+        journal.recordCommitted(2);
+    }
+    {
+        ImportJournal other(input, "bob", true);
+        BOOST_TEST(other.committed() == 0u);
+        BOOST_TEST(!other.resolved(3));
+        other.recordCommitted(1);
+        other.finish();
+    }
+    ImportJournal journal(input, kAccount, true);
+    BOOST_TEST(journal.committed() == 2u);
+    BOOST_TEST(journal.resolved(3).value() == kId);
+}
+
+BOOST_AUTO_TEST_CASE(foreign_file_is_replaced){
+    TempDir dir;
+    auto input = makeInput(dir);
+    writeFile(ImportJournal::pathFor(input, kAccount), "something else entirely");
+    {
+        ImportJournal journal(input, kAccount, true);
+        BOOST_TEST(journal.committed() == 0u);
+        journal.recordCommitted(2);
+    }
+    ImportJournal journal(input, kAccount, true);
+    BOOST_TEST(journal.committed() == 2u);
+}
+
+BOOST_AUTO_TEST_CASE(torn_tail_is_cut){
+    TempDir dir;
+    auto input = makeInput(dir);
+    auto path = ImportJournal::pathFor(input, kAccount);
+    {
+        ImportJournal journal(input, kAccount, true);
+        journal.recordCommitted(3);
+    }
+    BOOST_TEST(std::filesystem::file_size(path) == kHeaderSize + kRecordSize);
+    appendFile(path, std::string(kRecordSize / 2, '\x7f'));
+    {
+        ImportJournal journal(input, kAccount, true);
+        BOOST_TEST(journal.committed() == 3u);
+        BOOST_TEST(std::filesystem::file_size(path) == kHeaderSize + kRecordSize);
+        // Appends stay aligned after the cut
+        journal.recordCommitted(6);
+    }
+    ImportJournal journal(input, kAccount, true);
+    BOOST_TEST(journal.committed() == 6u);
+}
+
+BOOST_AUTO_TEST_CASE(finish_removes_the_journal){
+    TempDir dir;
+    auto input = makeInput(dir);
+    {
+        ImportJournal journal(input, kAccount, true);
+        journal.recordCommitted(1);
+        journal.finish();
+    }
+    BOOST_TEST(!std::filesystem::exists(ImportJournal::pathFor(input, kAccount)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,176 @@
+#include "JsonScan.hpp"
+#include "TrackReader.hpp"
+#include "TestFiles.hpp"
+
+#include <stdexcept>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+
+namespace {
+// Scanners take [p, end)
+struct Text{
+    explicit Text(std::string_view s) : begin(s.data()), end(s.data() + s.size()) {}
+    const char* begin;
+    const char* end;
+};
+
+std::vector<TrackRecord> readAll(TrackReader& reader){
+    std::vector<TrackRecord> records;
+    TrackRecord rec;
+    while(reader.next(rec)){
+        records.push_back(rec);
+    }
+    return records;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(JsonScanTest)
+
+BOOST_AUTO_TEST_CASE(string_escapes_are_decoded){
+    Text text(R"("a\"b\\c\/d\né🎵" tail)");
+    std::string out;
+    auto* after = jsonParseString(text.begin, text.end, out);
+    BOOST_REQUIRE(after);
+    BOOST_TEST(out == "a\"b\\c/d\n\xC3\xA9\xF0\x9F\x8E\xB5");
+    BOOST_TEST(std::string_view(after) == " tail");
+}
+
+BOOST_AUTO_TEST_CASE(malformed_strings_are_rejected){
+    std::string out;
+    for(std::string_view bad : {R"("unterminated)", R"("escaped end\")", "no quote"}){
+        Text text(bad);
+        BOOST_TEST(!jsonParseString(text.begin, text.end, out), bad);
+        BOOST_TEST(!jsonSkipString(text.begin, text.end), bad);
+    }
+    // Skipping does not look into escapes
+    Text hex(R"("bad \u12G4")");
+    BOOST_TEST(!jsonParseString(hex.begin, hex.end, out));
+    BOOST_TEST(jsonSkipString(hex.begin, hex.end) == hex.end);
+}
+
+BOOST_AUTO_TEST_CASE(skip_string_counts_backslashes){
+    Text text(R"("a\\" , "b\\\"c")");
+    auto* after = jsonSkipString(text.begin, text.end);
+    BOOST_REQUIRE(after);
+    BOOST_TEST(std::string_view(after) == R"( , "b\\\"c")");
+}
+
+BOOST_AUTO_TEST_CASE(values_are_skipped_whole){
+    Text text(R"({"a":[1,{"b":"}]"}],"c":null} rest)");
+    auto* after = jsonSkipValue(text.begin, text.end);
+    BOOST_REQUIRE(after);
+    BOOST_TEST(std::string_view(after) == " rest");
+    Text cut(R"({"a":[1,2})");
+    BOOST_TEST(!jsonSkipValue(cut.begin, cut.end));
+}
+
+BOOST_AUTO_TEST_CASE(members_are_found_by_path){
+    Text text(R"({"tracks":{"total":42,"items":[{"id":"x"}]},"name":"n"})");
+    std::string name;
+    BOOST_TEST(jsonGetString(text.begin, text.end, "name", name));
+    BOOST_TEST(name == "n");
+
+    auto* total = jsonFindPath(text.begin, text.end, {"tracks", "total"});
+    BOOST_REQUIRE(total);
+    long long value = 0;
+    BOOST_TEST(jsonParseInteger(total, text.end, value));
+    BOOST_TEST(value == 42);
+
+    BOOST_TEST(!jsonFindPath(text.begin, text.end, {"tracks", "missing"}));
+    long long ignored = 0;
+    BOOST_TEST(!jsonGetInteger(text.begin, text.end, "name", ignored));
+}
+
+BOOST_AUTO_TEST_CASE(array_elements_are_visited_in_order){
+    Text text(R"([ "a" , "b","c" ])");
+    std::vector<std::string> seen;
+    auto* after = jsonForEachElement(text.begin, text.end, [&](const char* p){
+        std::string value;
+        auto* next = jsonParseString(p, text.end, value);
+        seen.push_back(value);
+        return next;
+    });
+    BOOST_TEST(after == text.end);
+    BOOST_TEST(seen == (std::vector<std::string>{"a", "b", "c"}), boost::test_tools::per_element());
+
+    Text empty("[]");
+    BOOST_TEST(jsonForEachElement(empty.begin, empty.end, [](const char*) -> const char*{
+        return nullptr;
+    }) == empty.end);
+}
+
+BOOST_AUTO_TEST_CASE(integers_only){
+    long long value = 0;
+    Text negative("-17,");
+    BOOST_TEST(std::string_view(jsonParseInteger(negative.begin, negative.end, value)) == ",");
+    BOOST_TEST(value == -17);
+    Text fraction("1.5");
+    BOOST_TEST(!jsonParseInteger(fraction.begin, fraction.end, value));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+BOOST_AUTO_TEST_SUITE(TrackReaderTest)
+
+BOOST_AUTO_TEST_CASE(array_with_bom){
+    std::string data = "\xEF\xBB\xBF[ {\"artist\":\"A\",\"title\":\"T\",\"album\":{\"x\":[1]}},\n"
+                       " 5, {\"title\":\"U\",\"artist\":\"B\",\"id\":\"4uLU6hMCjMI75M1A2tKUQC\"} ]";
+    TrackReader reader(data.data(), data.size());
+    auto records = readAll(reader);
+    BOOST_TEST(!reader.isNdjson());
+    BOOST_REQUIRE(records.size() == 2u);
+    BOOST_TEST(records[0].artist == "A");
+    BOOST_TEST(records[0].title == "T");
+    BOOST_TEST(records[0].id.empty());
+    BOOST_TEST(records[1].artist == "B");
+    BOOST_TEST(records[1].id == "4uLU6hMCjMI75M1A2tKUQC");
+}
+
+BOOST_AUTO_TEST_CASE(ndjson_from_file){
+    TempDir dir;
+    auto path = dir.file("likes.ndjson");
+    writeFile(path, "{\"artist\":\"A\",\"title\":\"T\"}\n{\"artist\":\"B\",\"title\":\"U\"}\n");
+    TrackReader reader(path);
+    auto records = readAll(reader);
+    BOOST_TEST(reader.isNdjson());
+    BOOST_REQUIRE(records.size() == 2u);
+    BOOST_TEST(records[1].title == "U");
+}
+
+BOOST_AUTO_TEST_CASE(empty_inputs_have_no_records){
+    TempDir dir;
+    auto path = dir.file("empty.json");
+    writeFile(path, "");
+    TrackReader file(path);
+    BOOST_TEST(readAll(file).empty());
+
+    std::string blank = " \n";
+    TrackReader spaces(blank.data(), blank.size());
+    BOOST_TEST(readAll(spaces).empty());
+
+    std::string array = "[]";
+    TrackReader empty(array.data(), array.size());
+    BOOST_TEST(readAll(empty).empty());
+}
+
+BOOST_AUTO_TEST_CASE(malformed_input_throws){
+    for(std::string data : {std::string(R"([{"artist" "A"}])"),
+                            std::string(R"([{"artist":"A")"),
+                            std::string(R"([{"artist":"A"})"),
+                            std::string("\"text\"")}){
+        BOOST_CHECK_THROW({
+            TrackReader reader(data.data(), data.size());
+            readAll(reader);
+        }, std::runtime_error);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(spotify_ids){
+    BOOST_TEST(isSpotifyId("4uLU6hMCjMI75M1A2tKUQC"));
+    BOOST_TEST(!isSpotifyId("4uLU6hMCjMI75M1A2tKUQ"));
+    BOOST_TEST(!isSpotifyId("4uLU6hMCjMI75M1A2tKU-C"));
+    BOOST_TEST(!isSpotifyId(""));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
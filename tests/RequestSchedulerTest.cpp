@@ -0,0 +1,132 @@
+#include "RequestScheduler.hpp"
+#include "PipelineControl.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace {
+using Priority = RequestScheduler::Priority;
+
+// One slot: grants are handed out strictly one after another
+RequestScheduler::Options oneSlot(){
+    RequestScheduler::Options options;
+    options.minConcurrency = 1;
+    options.maxConcurrency = 1;
+    options.initialConcurrency = 1;
+    return options;
+}
+
+// Queue n requests of a flow, each records its flow when granted
+// and returns the slot at once
+void queueRequests(boost::asio::io_context& io, RequestScheduler& scheduler,
+                   RequestScheduler::FlowId flow, int n,
+                   std::vector<RequestScheduler::FlowId>& grants){
+    using namespace boost::asio;
+    for(int i = 0; i < n; ++i){
+        co_spawn(io,
+            [&scheduler, &grants, flow]() -> awaitable<void>{
+                auto ticket = co_await scheduler.acquire(flow);
+                grants.push_back(flow);
+            },
+            detached);
+    }
+}
+
+std::size_t countOf(const std::vector<RequestScheduler::FlowId>& grants, std::size_t first,
+                    RequestScheduler::FlowId flow){
+    return std::size_t(std::count(grants.begin(), grants.begin() + first, flow));
+}
+}
+
+BOOST_AUTO_TEST_SUITE(RequestSchedulerTest)
+
+BOOST_AUTO_TEST_CASE(slots_are_shared_by_weight){
+    boost::asio::io_context io;
+    RequestScheduler scheduler(io, oneSlot());
+    auto heavy = scheduler.addFlow(3.0);
+    auto light = scheduler.addFlow(1.0);
+    std::vector<RequestScheduler::FlowId> grants;
+    queueRequests(io, scheduler, heavy, 60, grants);
+    queueRequests(io, scheduler, light, 60, grants);
+    io.run();
+
+    BOOST_REQUIRE(grants.size() == 120u);
+    // While both flows wait, three of every four slots go to the heavy one
+    auto heavyShare = countOf(grants, 40, heavy);
+    BOOST_TEST(heavyShare >= 28u);
+    BOOST_TEST(heavyShare <= 32u);
+}
+
+BOOST_AUTO_TEST_CASE(interactive_flow_goes_first){
+    boost::asio::io_context io;
+    RequestScheduler scheduler(io, oneSlot());
+    auto bulk = scheduler.addFlow(10.0, Priority::Bulk);
+    auto interactive = scheduler.addFlow(1.0, Priority::Interactive);
+    std::vector<RequestScheduler::FlowId> grants;
+    queueRequests(io, scheduler, bulk, 20, grants);
+    queueRequests(io, scheduler, interactive, 5, grants);
+    io.run();
+
+    BOOST_REQUIRE(grants.size() == 25u);
+    // The first bulk request took the free slot before the others queued
+    BOOST_TEST(grants[0] == bulk);
+    BOOST_TEST(countOf(grants, 6, interactive) == 5u);
+}
+
+BOOST_AUTO_TEST_CASE(idle_flow_banks_no_credit){
+    boost::asio::io_context io;
+    RequestScheduler scheduler(io, oneSlot());
+    auto busy = scheduler.addFlow(1.0);
+    auto late = scheduler.addFlow(1.0);
+    std::vector<RequestScheduler::FlowId> grants;
+    queueRequests(io, scheduler, busy, 30, grants);
+    io.run();
+    io.restart();
+
+    // Equal weights alternate from now on, the late flow does not
+    // get the slots the busy one used while it was idle
+    queueRequests(io, scheduler, busy, 20, grants);
+    queueRequests(io, scheduler, late, 20, grants);
+    io.run();
+    BOOST_REQUIRE(grants.size() == 70u);
+    std::vector<RequestScheduler::FlowId> second(grants.begin() + 30, grants.end());
+    auto lateShare = countOf(second, 20, late);
+    BOOST_TEST(lateShare >= 9u);
+    BOOST_TEST(lateShare <= 11u);
+}
+
+BOOST_AUTO_TEST_CASE(stop_cuts_a_retry_after_pause_short){
+    using namespace boost::asio;
+    io_context io;
+    RequestScheduler scheduler(io, oneSlot());
+    PipelineControl control;
+    auto flow = scheduler.addFlow(1.0, Priority::Bulk, &control);
+    scheduler.onRateLimited(std::chrono::seconds(60));
+
+    bool done = false;
+    bool granted = false;
+    co_spawn(io,
+        [&]() -> awaitable<void>{
+            auto ticket = co_await scheduler.acquire(flow);
+            granted = bool(ticket);
+            done = true;
+        },
+        detached);
+    io.run_for(std::chrono::milliseconds(50));
+    BOOST_TEST(!done);
+
+    control.cancel();
+    scheduler.interrupt(flow);
+    auto start = std::chrono::steady_clock::now();
+    io.run_for(std::chrono::seconds(10));
+    BOOST_TEST(done);
+    BOOST_TEST(!granted);
+    auto waited = std::chrono::steady_clock::now() - start;
+    BOOST_TEST((waited < std::chrono::seconds(5)));
+    // The slot was not taken
+    BOOST_TEST(scheduler.inFlight() == 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
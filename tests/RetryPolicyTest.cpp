@@ -0,0 +1,100 @@
+#include "RetryPolicy.hpp"
+
+#include <algorithm>
+#include <boost/asio/error.hpp>
+#include <boost/test/unit_test.hpp>
+
+namespace {
+// Budget of exactly n retries before any request, capped at max
+RetryPolicy::Options budget(double n, double max){
+    RetryPolicy::Options options;
+    options.maxAttempts = 100;
+    options.budgetMin = n;
+    options.budgetMax = max;
+    options.budgetRatio = 0.1;
+    return options;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(RetryPolicyTest)
+
+BOOST_AUTO_TEST_CASE(only_idempotent_methods_are_retried){
+    using boost::beast::http::verb;
+    BOOST_TEST((RetryPolicy::classify(verb::get) == RetryPolicy::Idempotency::Idempotent));
+    BOOST_TEST((RetryPolicy::classify(verb::put) == RetryPolicy::Idempotency::Idempotent));
+    BOOST_TEST((RetryPolicy::classify(verb::delete_) == RetryPolicy::Idempotency::Idempotent));
+    BOOST_TEST((RetryPolicy::classify(verb::post) == RetryPolicy::Idempotency::NotIdempotent));
+}
+
+BOOST_AUTO_TEST_CASE(transient_faults){
+    BOOST_TEST(RetryPolicy::transient(boost::system::error_code(boost::asio::error::connection_reset)));
+    BOOST_TEST(RetryPolicy::transient(boost::system::error_code(boost::asio::error::timed_out)));
+    // A stop is not a fault
+    BOOST_TEST(!RetryPolicy::transient(boost::system::error_code(boost::asio::error::operation_aborted)));
+    for(unsigned status : {500u, 502u, 503u, 504u}){
+        BOOST_TEST(RetryPolicy::transient(status), status);
+    }
+    for(unsigned status : {200u, 400u, 401u, 404u, 429u, 501u}){
+        BOOST_TEST(!RetryPolicy::transient(status), status);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(attempts_are_capped){
+    RetryPolicy::Options options;
+    options.maxAttempts = 3;
+    RetryPolicy policy(options);
+    BOOST_TEST(policy.allowRetry(1));
+    BOOST_TEST(policy.allowRetry(2));
+    BOOST_TEST(!policy.allowRetry(3));
+}
+
+BOOST_AUTO_TEST_CASE(budget_runs_out_and_refills){
+    RetryPolicy policy(budget(3, 100));
+    for(int i = 0; i < 3; ++i){
+        BOOST_TEST(policy.allowRetry(1));
+    }
+    BOOST_TEST(!policy.allowRetry(1));
+
+    // A tenth of a retry per request sent
+    for(int i = 0; i < 9; ++i){
+        policy.onRequest();
+    }
+    BOOST_TEST(!policy.allowRetry(1));
+    policy.onRequest();
+    BOOST_TEST(policy.allowRetry(1));
+    BOOST_TEST(!policy.allowRetry(1));
+}
+
+BOOST_AUTO_TEST_CASE(budget_is_capped){
+    RetryPolicy policy(budget(0, 2));
+    for(int i = 0; i < 1000; ++i){
+        policy.onRequest();
+    }
+    BOOST_TEST(policy.allowRetry(1));
+    BOOST_TEST(policy.allowRetry(1));
+    BOOST_TEST(!policy.allowRetry(1));
+}
+
+BOOST_AUTO_TEST_CASE(backoff_is_jittered_under_a_growing_cap){
+    RetryPolicy::Options options;
+    options.baseDelay = std::chrono::milliseconds(100);
+    options.maxDelay = std::chrono::milliseconds(1000);
+    RetryPolicy policy(options);
+    for(int attempt = 1; attempt <= 30; ++attempt){
+        auto cap = std::min<long long>(1000, 100LL << std::min(attempt - 1, 20));
+        for(int i = 0; i < 50; ++i){
+            auto delay = policy.backoff(attempt).count();
+            BOOST_TEST(delay >= 0);
+            BOOST_TEST(delay <= cap);
+        }
+    }
+    // Full jitter: lanes that failed together do not come back together
+    bool spread = false;
+    auto first = policy.backoff(4);
+    for(int i = 0; i < 50 && !spread; ++i){
+        spread = policy.backoff(4) != first;
+    }
+    BOOST_TEST(spread);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,206 @@
+#include "SearchCache.hpp"
+#include "TestFiles.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+
+namespace {
+// On-disk layout: header of magic, key version and a reserved word,
+// then records of key, time stored and a zero padded id
+constexpr std::size_t kHeaderSize = 16;
+constexpr std::size_t kRecordSize = 40;
+
+const std::string kId = "4uLU6hMCjMI75M1A2tKUQC";
+const std::string kOtherId = "7ouMYWpwJ422jRcDASZB7P";
+
+std::string cacheHeader(std::string_view magic, std::uint32_t keyVersion){
+    return std::string(magic) + bytesOf(keyVersion) + bytesOf(std::uint32_t(0));
+}
+
+std::string cacheRecord(std::uint64_t key, std::int64_t storedAt, std::string_view id){
+    char padded[24] = {};
+    std::memcpy(padded, id.data(), id.size());
+    return bytesOf(key) + bytesOf(storedAt) + std::string(padded, sizeof(padded));
+}
+
+std::int64_t nowSeconds(){
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+}
+
+BOOST_AUTO_TEST_SUITE(SearchCacheTest)
+
+BOOST_AUTO_TEST_CASE(track_key_ignores_case_and_punctuation){
+    BOOST_TEST(trackKey("The Beatles", "Let It Be") == trackKey("the beatles", "let it be!"));
+    BOOST_TEST(trackKey("The Beatles", "Let It Be")
+               == trackKeyOfTitle(artistKeyPrefix("The Beatles"), "Let It Be"));
+    // Artist and title do not run into each other
+    BOOST_TEST(trackKey("ab", "c") != trackKey("a", "bc"));
+}
+
+BOOST_AUTO_TEST_CASE(results_survive_reopen){
+    TempDir dir;
+    auto path = dir.file("search.cache");
+    {
+        SearchCache cache(path);
+        cache.store(1, kId);
+        cache.store(2, "");
+    }
+    SearchCache cache(path);
+    BOOST_TEST(cache.size() == 2u);
+    BOOST_TEST(cache.find(1).value() == kId);
+    BOOST_TEST(cache.find(2).value() == "");
+    BOOST_TEST(!cache.find(3));
+    BOOST_TEST(std::filesystem::file_size(path) == kHeaderSize + 2 * kRecordSize);
+}
+
+BOOST_AUTO_TEST_CASE(later_record_overrides_earlier){
+    TempDir dir;
+    auto path = dir.file("search.cache");
+    writeFile(path, cacheHeader("ELSCACH2", kTrackKeyVersion)
+                    + cacheRecord(1, nowSeconds(), kId)
+                    + cacheRecord(1, nowSeconds(), kOtherId));
+    SearchCache cache(path);
+    BOOST_TEST(cache.size() == 1u);
+    BOOST_TEST(cache.find(1).value() == kOtherId);
+}
+
+BOOST_AUTO_TEST_CASE(not_found_expires){
+    TempDir dir;
+    auto path = dir.file("search.cache");
+    writeFile(path, cacheHeader("ELSCACH2", kTrackKeyVersion)
+                    + cacheRecord(1, 1000, "")
+                    + cacheRecord(2, 1000, kId));
+    SearchCache cache(path, std::chrono::hours(1));
+    // Spotify may have the track by now, a found id does not expire
+    BOOST_TEST(!cache.find(1));
+    BOOST_TEST(cache.find(2).value() == kId);
+}
+
+BOOST_AUTO_TEST_CASE(foreign_file_is_never_written){
+    TempDir dir;
+    auto path = dir.file("notes.txt");
+    const std::string text = "not a search cache, keep me as I am\n";
+    writeFile(path, text);
+    {
+        SearchCache cache(path);
+        BOOST_TEST(cache.size() == 0u);
+        for(std::uint64_t key = 0; key < 300; ++key){
+            cache.store(key, kId);
+        }
+        cache.flush();
+    }
+    BOOST_TEST(readFile(path) == text);
+}
+
+BOOST_AUTO_TEST_CASE(torn_tail_is_cut){
+    TempDir dir;
+    auto path = dir.file("search.cache");
+    writeFile(path, cacheHeader("ELSCACH2", kTrackKeyVersion)
+                    + cacheRecord(1, nowSeconds(), kId)
+                    + cacheRecord(2, nowSeconds(), kOtherId).substr(0, 17));
+    {
+        SearchCache cache(path);
+        BOOST_TEST(cache.size() == 1u);
+        BOOST_TEST(std::filesystem::file_size(path) == kHeaderSize + kRecordSize);
+        cache.store(3, kOtherId);
+    }
+    // Appends stay aligned after the cut
+    SearchCache cache(path);
+    BOOST_TEST(cache.size() == 2u);
+    BOOST_TEST(cache.find(1).value() == kId);
+    BOOST_TEST(cache.find(3).value() == kOtherId);
+}
+
+BOOST_AUTO_TEST_CASE(torn_header_is_replaced){
+    TempDir dir;
+    auto path = dir.file("search.cache");
+    writeFile(path, "ELSC");
+    {
+        SearchCache cache(path);
+        BOOST_TEST(cache.size() == 0u);
+        cache.store(1, kId);
+    }
+    SearchCache cache(path);
+    BOOST_TEST(cache.find(1).value() == kId);
+    BOOST_TEST(readFile(path).substr(0, 8) == "ELSCACH2");
+}
+
+BOOST_AUTO_TEST_CASE(legacy_file_is_upgraded){
+    TempDir dir;
+    auto path = dir.file("search.cache");
+    writeFile(path, "ELSCACH1" + cacheRecord(1, nowSeconds(), kId));
+    {
+        SearchCache cache(path);
+        BOOST_TEST(cache.find(1).value() == kId);
+        cache.store(2, kOtherId);
+    }
+    BOOST_TEST(readFile(path).substr(0, 8) == "ELSCACH2");
+    SearchCache cache(path);
+    BOOST_TEST(cache.find(1).value() == kId);
+    BOOST_TEST(cache.find(2).value() == kOtherId);
+}
+
+BOOST_AUTO_TEST_CASE(stale_key_version_starts_empty){
+    TempDir dir;
+    auto path = dir.file("search.cache");
+    writeFile(path, cacheHeader("ELSCACH2", kTrackKeyVersion + 1)
+                    + cacheRecord(1, nowSeconds(), kId));
+    {
+        SearchCache cache(path);
+        // Key 1 of other keys is another track
+        BOOST_TEST(!cache.find(1));
+        cache.store(2, kOtherId);
+    }
+    SearchCache cache(path);
+    BOOST_TEST(!cache.find(1));
+    BOOST_TEST(cache.find(2).value() == kOtherId);
+    BOOST_TEST(std::filesystem::file_size(path) == kHeaderSize + kRecordSize);
+}
+
+BOOST_AUTO_TEST_CASE(dead_records_are_compacted){
+    TempDir dir;
+    auto path = dir.file("search.cache");
+    {
+        SearchCache cache(path);
+        for(int i = 0; i < 600; ++i){
+            cache.store(1, i % 2 ? kId : kOtherId);
+        }
+    }
+    BOOST_TEST(std::filesystem::file_size(path) == kHeaderSize + kRecordSize);
+    BOOST_TEST(!std::filesystem::exists(path + ".tmp"));
+    SearchCache cache(path);
+    BOOST_TEST(cache.find(1).value() == kId);
+}
+
+BOOST_AUTO_TEST_CASE(clients_on_threads_share_one_cache){
+    TempDir dir;
+    auto path = dir.file("search.cache");
+    {
+        SearchCache cache(path);
+        std::vector<std::thread> clients;
+        for(std::uint64_t client = 0; client < 4; ++client){
+            clients.emplace_back([&cache, client]{
+                for(std::uint64_t i = 0; i < 1000; ++i){
+                    cache.store(client * 1000 + i, kId);
+                    cache.find(i);
+                }
+                cache.flush();
+            });
+        }
+        for(auto& client : clients){
+            client.join();
+        }
+    }
+    // Every record is whole and none is lost
+    BOOST_TEST(std::filesystem::file_size(path) == kHeaderSize + 4000 * kRecordSize);
+    SearchCache cache(path);
+    BOOST_TEST(cache.size() == 4000u);
+    BOOST_TEST(cache.find(3999).value() == kId);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
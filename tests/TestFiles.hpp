@@ -0,0 +1,52 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+
+// Fresh directory under the system temp dir, removed with its files
+class TempDir{
+public:
+    TempDir(){
+        std::random_device random;
+        path_ = std::filesystem::temp_directory_path()
+            / ("exportlikes_test_" + std::to_string(random()) + "_" + std::to_string(random()));
+        std::filesystem::create_directories(path_);
+    }
+
+    ~TempDir(){
+        std::error_code ec;
+        std::filesystem::remove_all(path_, ec);
+    }
+
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    std::string file(const std::string& name) const { return (path_ / name).string(); }
+private:
+    std::filesystem::path path_;
+};
+
+inline void writeFile(const std::string& path, std::string_view bytes){
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), std::streamsize(bytes.size()));
+}
+
+inline void appendFile(const std::string& path, std::string_view bytes){
+    std::ofstream out(path, std::ios::binary | std::ios::app);
+    out.write(bytes.data(), std::streamsize(bytes.size()));
+}
+
+inline std::string readFile(const std::string& path){
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// Plain bytes of a trivially copyable value, native byte order
+template <typename T>
+std::string bytesOf(const T& value){
+    return std::string(reinterpret_cast<const char*>(&value), sizeof(value));
+}
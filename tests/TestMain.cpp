@@ -0,0 +1,4 @@
+// Unit tests of the core library, one suite per component.
+// Header-only Boost.Test: nothing to link
+#define BOOST_TEST_MODULE ExportLikesTests
+#include <boost/test/included/unit_test.hpp>
@@ -0,0 +1,141 @@
+#include "TrackList.hpp"
+#include "SearchCache.hpp"
+#include "TestFiles.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <boost/test/unit_test.hpp>
+
+namespace {
+// Header fields patched by the tests
+constexpr std::size_t kKeyVersionAt = 12;
+constexpr std::size_t kRecordsAt = 16;
+// First artist offset, right after the 56-byte header
+constexpr std::size_t kArtistOffsetsAt = 56;
+
+const std::string kId = "4uLU6hMCjMI75M1A2tKUQC";
+const std::string kOtherId = "7ouMYWpwJ422jRcDASZB7P";
+
+// Three records of two artists, two of them with ids
+std::string writeSample(const TempDir& dir, bool withKeys){
+    auto path = dir.file("likes.tracks");
+    TrackListWriter writer;
+    writer.add("Artist A", "First", kId);
+    writer.add("Artist B", "Second", "not an id");
+    writer.add("Artist A", "Third", kOtherId);
+    BOOST_TEST(writer.artistCount() == 2u);
+    BOOST_TEST(writer.idCount() == 2u);
+    writer.write(path, withKeys);
+    return path;
+}
+
+template <typename T>
+void patch(const std::string& path, std::size_t at, T value){
+    auto bytes = readFile(path);
+    std::memcpy(bytes.data() + at, &value, sizeof(value));
+    writeFile(path, bytes);
+}
+}
+
+BOOST_AUTO_TEST_SUITE(TrackListTest)
+
+BOOST_AUTO_TEST_CASE(records_survive_round_trip){
+    TempDir dir;
+    auto path = writeSample(dir, true);
+    BOOST_TEST(TrackList::detect(path));
+    BOOST_TEST(!std::filesystem::exists(path + ".tmp"));
+
+    TrackList list(path);
+    BOOST_REQUIRE(list.size() == 3u);
+    BOOST_TEST(list.artistCount() == 2u);
+    BOOST_TEST(list.artist(0) == "Artist A");
+    BOOST_TEST(list.artist(1) == "Artist B");
+    BOOST_TEST(list.artist(2) == "Artist A");
+    BOOST_TEST(list.title(1) == "Second");
+
+    // Ids are sparse, invalid ones were dropped
+    BOOST_TEST(list.idCount() == 2u);
+    BOOST_TEST(list.id(0) == kId);
+    BOOST_TEST(list.id(1).empty());
+    BOOST_TEST(list.id(2) == kOtherId);
+
+    BOOST_REQUIRE(list.hasKeys());
+    BOOST_TEST(list.key(2) == trackKey("Artist A", "Third"));
+    TrackRecord rec;
+    list.read(2, rec);
+    BOOST_TEST(rec.artist == "Artist A");
+    BOOST_TEST(rec.title == "Third");
+    BOOST_TEST(rec.id == kOtherId);
+    BOOST_TEST(rec.key.value() == trackKey("Artist A", "Third"));
+}
+
+BOOST_AUTO_TEST_CASE(keys_are_optional){
+    TempDir dir;
+    TrackList list(writeSample(dir, false));
+    BOOST_TEST(!list.hasKeys());
+    TrackRecord rec;
+    rec.key = 1;
+    list.read(0, rec);
+    BOOST_TEST(!rec.key);
+}
+
+BOOST_AUTO_TEST_CASE(stale_keys_are_not_used){
+    TempDir dir;
+    auto path = writeSample(dir, true);
+    patch(path, kKeyVersionAt, std::uint32_t(kTrackKeyVersion + 1));
+    TrackList list(path);
+    BOOST_TEST(list.size() == 3u);
+    BOOST_TEST(!list.hasKeys());
+}
+
+BOOST_AUTO_TEST_CASE(empty_list){
+    TempDir dir;
+    auto path = dir.file("empty.tracks");
+    TrackListWriter().write(path, true);
+    TrackList list(path);
+    BOOST_TEST(list.size() == 0u);
+    BOOST_TEST(list.idCount() == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(other_files_are_not_detected){
+    TempDir dir;
+    auto json = dir.file("likes.json");
+    writeFile(json, R"([{"artist":"A","title":"T"}])");
+    BOOST_TEST(!TrackList::detect(json));
+    auto shortFile = dir.file("short.tracks");
+    writeFile(shortFile, "ELTR");
+    BOOST_TEST(!TrackList::detect(shortFile));
+    BOOST_TEST(!TrackList::detect(dir.file("missing.tracks")));
+    BOOST_CHECK_THROW(TrackList{json}, std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(truncated_file_throws){
+    TempDir dir;
+    auto path = writeSample(dir, true);
+    auto bytes = readFile(path);
+    for(std::size_t size : {bytes.size() - 1, std::size_t(60), std::size_t(10)}){
+        writeFile(path, std::string_view(bytes).substr(0, size));
+        BOOST_CHECK_THROW(TrackList{path}, std::exception);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(malformed_header_throws){
+    TempDir dir;
+    auto path = writeSample(dir, true);
+    patch(path, kRecordsAt, std::uint64_t(1) << 40);
+    BOOST_CHECK_THROW(TrackList{path}, std::runtime_error);
+
+    // Counts that fit the file, but more records than the layout holds
+    path = writeSample(dir, true);
+    patch(path, kRecordsAt, std::uint64_t(1000));
+    BOOST_CHECK_THROW(TrackList{path}, std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(malformed_offsets_throw){
+    TempDir dir;
+    auto path = writeSample(dir, true);
+    patch(path, kArtistOffsetsAt, std::uint32_t(5));
+    BOOST_CHECK_THROW(TrackList{path}, std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
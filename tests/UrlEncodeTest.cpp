@@ -0,0 +1,36 @@
+#include "UrlEncode.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(UrlEncodeTest)
+
+BOOST_AUTO_TEST_CASE(unreserved_characters_stay){
+    std::string out;
+    appendUrlEncoded(out, "AZaz09-._~");
+    BOOST_TEST(out == "AZaz09-._~");
+}
+
+BOOST_AUTO_TEST_CASE(everything_else_is_escaped){
+    std::string out = "q=";
+    appendUrlEncoded(out, "artist:AC/DC track:T.N.T & more+");
+    BOOST_TEST(out == "q=artist%3AAC%2FDC%20track%3AT.N.T%20%26%20more%2B");
+}
+
+BOOST_AUTO_TEST_CASE(utf8_bytes_are_escaped_one_by_one){
+    std::string out;
+    appendUrlEncoded(out, "\xD0\x9A\xD0\xB8\xD0\xBD\xD0\xBE");
+    BOOST_TEST(out == "%D0%9A%D0%B8%D0%BD%D0%BE");
+    std::string zero;
+    appendUrlEncoded(zero, std::string_view("a\0b", 3));
+    BOOST_TEST(zero == "a%00b");
+}
+
+BOOST_AUTO_TEST_CASE(size_matches_output){
+    for(std::string_view text : {"", "plain", "a b/c?d=e&f", "\xF0\x9F\x8E\xB5 x"}){
+        std::string out;
+        appendUrlEncoded(out, text);
+        BOOST_TEST(urlEncodedSize(text) == out.size(), text);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,395 @@
+// Local stand-in for the Spotify endpoints used by SpotifyClient.
+// Plain HTTP, keep-alive, configurable latency and error rates.
+//
+//   MockSpotifyServer [--port 8080] [--threads 4] [--latency-ms 20]
+//                     [--jitter-ms 10] [--rate-429 0.0] [--rate-5xx 0.0]
+//                     [--retry-after 1] [--miss-rate 0.05] [--library 0]
+//                     [--token-ttl 3600] [--rate-reset 0.0]
+//
+// --rate-reset drops the connection of that share of Web API requests after
+// they are handled, before the response: the change is made but not reported
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace asio = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+
+namespace {
+
+struct Options{
+    unsigned short port = 8080;
+    unsigned threads = 4;
+    int latencyMs = 20;
+    int jitterMs = 10;
+    double rate429 = 0.0;
+    double rate5xx = 0.0;
+    int retryAfter = 1;
+    double missRate = 0.05;
+    std::size_t library = 0;
+    // Lifetime of issued access tokens, expired ones get 401
+    int tokenTtl = 3600;
+    // Web API requests whose connection is dropped instead of answered
+    double rateReset = 0.0;
+};
+
+Options options;
+
+// Saved tracks, newest last
+struct Library{
+    std::mutex mutex;
+    std::vector<std::string> order;
+    std::unordered_set<std::string> ids;
+
+    void add(const std::string& id){
+        std::lock_guard lock(mutex);
+        if(ids.insert(id).second){
+            order.push_back(id);
+        }
+    }
+
+    void remove(const std::string& id){
+        std::lock_guard lock(mutex);
+        if(ids.erase(id)){
+            std::erase(order, id);
+        }
+    }
+};
+
+// Access tokens issued by /api/token and when they expire
+struct Tokens{
+    std::mutex mutex;
+    std::map<std::string, std::chrono::steady_clock::time_point> expiry;
+    std::uint64_t issued = 0;
+
+    std::string issue(){
+        std::lock_guard lock(mutex);
+        auto token = "mock-access-" + std::to_string(++issued);
+        expiry[token] = std::chrono::steady_clock::now() + std::chrono::seconds(options.tokenTtl);
+        return token;
+    }
+
+    bool valid(std::string_view authorization){
+        constexpr std::string_view prefix = "Bearer ";
+        if(authorization.substr(0, prefix.size()) != prefix){
+            return false;
+        }
+        std::lock_guard lock(mutex);
+        auto it = expiry.find(std::string(authorization.substr(prefix.size())));
+        return it != expiry.end() && std::chrono::steady_clock::now() < it->second;
+    }
+};
+
+struct Stats{
+    std::atomic<std::uint64_t> requests{0};
+    std::atomic<std::uint64_t> rateLimited{0};
+    std::atomic<std::uint64_t> failed{0};
+    std::atomic<std::uint64_t> unauthorized{0};
+    std::atomic<std::uint64_t> reset{0};
+};
+
+Library library;
+Tokens tokens;
+Stats stats;
+
+std::uint64_t fnv1a(std::string_view data){
+    std::uint64_t hash = 14695981039346656037ull;
+    for(unsigned char c : data){
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Spotify-like 22 char base62 id
+std::string makeId(std::uint64_t seed){
+    static const char alphabet[] =
+        "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    std::mt19937_64 gen(seed);
+    std::string id(22, '0');
+    for(auto& c : id){
+        c = alphabet[gen() % 62];
+    }
+    return id;
+}
+
+std::string percentDecode(std::string_view in){
+    std::string out;
+    out.reserve(in.size());
+    for(std::size_t i = 0; i < in.size(); ++i){
+        if(in[i] == '%' && i + 2 < in.size()){
+            out += char(std::stoi(std::string(in.substr(i + 1, 2)), nullptr, 16));
+            i += 2;
+        }
+        else if(in[i] == '+'){
+            out += ' ';
+        }
+        else{
+            out += in[i];
+        }
+    }
+    return out;
+}
+
+// "/path?a=1&b=2" -> path and decoded params
+std::string splitTarget(std::string_view target, std::map<std::string, std::string>& params){
+    auto q = target.find('?');
+    if(q == std::string_view::npos){
+        return std::string(target);
+    }
+    auto query = target.substr(q + 1);
+    while(!query.empty()){
+        auto amp = query.find('&');
+        auto pair = query.substr(0, amp);
+        auto eq = pair.find('=');
+        if(eq != std::string_view::npos){
+            params[std::string(pair.substr(0, eq))] = percentDecode(pair.substr(eq + 1));
+        }
+        if(amp == std::string_view::npos){
+            break;
+        }
+        query = query.substr(amp + 1);
+    }
+    return std::string(target.substr(0, q));
+}
+
+std::vector<std::string> splitIds(const std::string& ids){
+    std::vector<std::string> out;
+    std::size_t start = 0;
+    while(start <= ids.size()){
+        auto comma = ids.find(',', start);
+        auto id = ids.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        if(!id.empty()){
+            out.push_back(id);
+        }
+        if(comma == std::string::npos){
+            break;
+        }
+        start = comma + 1;
+    }
+    return out;
+}
+
+double uniform(){
+    thread_local std::mt19937 gen{std::random_device{}()};
+    return std::uniform_real_distribution<double>(0.0, 1.0)(gen);
+}
+
+http::response<http::string_body> handle(const http::request<http::string_body>& req){
+    http::response<http::string_body> res{http::status::ok, req.version()};
+    res.set(http::field::content_type, "application/json");
+    res.keep_alive(req.keep_alive());
+
+    std::map<std::string, std::string> params;
+    auto path = splitTarget(std::string_view(req.target().data(), req.target().size()), params);
+
+    // Injected failures
+    double roll = uniform();
+    if(roll < options.rate429){
+        ++stats.rateLimited;
+        res.result(http::status::too_many_requests);
+        res.set(http::field::retry_after, std::to_string(options.retryAfter));
+        res.body() = R"({"error":{"status":429,"message":"API rate limit exceeded"}})";
+        return res;
+    }
+    if(roll < options.rate429 + options.rate5xx){
+        ++stats.failed;
+        res.result(http::status::service_unavailable);
+        res.body() = R"({"error":{"status":503,"message":"Service unavailable"}})";
+        return res;
+    }
+
+    if(path == "/api/token" && req.method() == http::verb::post){
+        res.body() = R"({"access_token":")" + tokens.issue() + R"(","token_type":"Bearer",)"
+                     R"("scope":"user-library-modify user-library-read","expires_in":)"
+                     + std::to_string(options.tokenTtl) + R"(,"refresh_token":"mock-refresh"})";
+        return res;
+    }
+
+    auto authorization = req[http::field::authorization];
+    if(!tokens.valid(std::string_view(authorization.data(), authorization.size()))){
+        ++stats.unauthorized;
+        res.result(http::status::unauthorized);
+        res.body() = R"({"error":{"status":401,"message":"The access token expired"}})";
+        return res;
+    }
+
+    if(path == "/v1/search" && req.method() == http::verb::get){
+        auto hash = fnv1a(params["q"]);
+        if(double(hash % 10000) / 10000.0 < options.missRate){
+            res.body() = R"({"tracks":{"href":"","items":[],"limit":1,"offset":0,"total":0}})";
+        }
+        else{
+            res.body() = R"({"tracks":{"href":"","items":[{"album":{"name":"Mock"},)"
+                         R"("artists":[{"name":"Mock"}],"id":")" + makeId(hash)
+                         + R"(","name":"Mock","type":"track"}],"limit":1,"offset":0,"total":1}})";
+        }
+    }
+    else if(path == "/v1/me" && req.method() == http::verb::get){
+        res.body() = R"({"display_name":"Mock","id":"mock-user","type":"user"})";
+    }
+    else if(path == "/v1/me/tracks" && req.method() == http::verb::get){
+        std::size_t limit = params.count("limit") ? std::stoul(params["limit"]) : 20;
+        std::size_t offset = params.count("offset") ? std::stoul(params["offset"]) : 0;
+        std::string items;
+        std::size_t total;
+        {
+            std::lock_guard lock(library.mutex);
+            total = library.order.size();
+            // Newest first
+            for(std::size_t i = offset; i < offset + limit && i < total; ++i){
+                if(!items.empty()){
+                    items += ',';
+                }
+                items += R"({"added_at":"2024-01-01T00:00:00Z","track":{"id":")"
+                         + library.order[total - 1 - i] + R"(","name":"Mock"}})";
+            }
+        }
+        res.body() = R"({"href":"","items":[)" + items + R"(],"limit":)" + std::to_string(limit)
+                     + R"(,"offset":)" + std::to_string(offset)
+                     + R"(,"total":)" + std::to_string(total) + "}";
+    }
+    else if(path == "/v1/me/tracks" && req.method() == http::verb::put){
+        for(auto& id : splitIds(params["ids"])){
+            library.add(id);
+        }
+        res.body() = "";
+    }
+    else if(path == "/v1/me/tracks" && req.method() == http::verb::delete_){
+        for(auto& id : splitIds(params["ids"])){
+            library.remove(id);
+        }
+        res.body() = "";
+    }
+    else{
+        res.result(http::status::not_found);
+        res.body() = R"({"error":{"status":404,"message":"Not found"}})";
+    }
+    return res;
+}
+
+asio::awaitable<void> session(asio::ip::tcp::socket socket){
+    beast::tcp_stream stream(std::move(socket));
+    beast::flat_buffer buffer;
+    try{
+        while(true){
+            http::request<http::string_body> req;
+            stream.expires_after(std::chrono::seconds(60));
+            co_await http::async_read(stream, buffer, req, asio::use_awaitable);
+            ++stats.requests;
+
+            // Simulated network + server time
+            int delay = options.latencyMs;
+            if(options.jitterMs > 0){
+                delay += int(uniform() * options.jitterMs);
+            }
+            if(delay > 0){
+                auto ex = co_await asio::this_coro::executor;
+                asio::steady_timer timer(ex, std::chrono::milliseconds(delay));
+                co_await timer.async_wait(asio::use_awaitable);
+            }
+
+            auto res = handle(req);
+            if(options.rateReset > 0 && req.target().starts_with("/v1/")
+                && uniform() < options.rateReset){
+                ++stats.reset;
+                // RST instead of FIN
+                stream.socket().set_option(asio::socket_base::linger(true, 0));
+                stream.socket().close();
+                co_return;
+            }
+            res.prepare_payload();
+            co_await http::async_write(stream, res, asio::use_awaitable);
+            if(!res.keep_alive()){
+                break;
+            }
+        }
+    }
+    catch(std::exception&){
+        // Client went away
+    }
+    beast::error_code ec;
+    stream.socket().shutdown(asio::ip::tcp::socket::shutdown_send, ec);
+}
+
+asio::awaitable<void> listen(asio::ip::tcp::acceptor& acceptor){
+    while(true){
+        auto socket = co_await acceptor.async_accept(asio::use_awaitable);
+        auto ex = socket.get_executor();
+        asio::co_spawn(ex, session(std::move(socket)), asio::detached);
+    }
+}
+
+void parseArgs(int argc, char* argv[]){
+    for(int i = 1; i + 1 < argc; i += 2){
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if(key == "--port") options.port = static_cast<unsigned short>(std::stoi(value));
+        else if(key == "--threads") options.threads = std::max(1, std::stoi(value));
+        else if(key == "--latency-ms") options.latencyMs = std::stoi(value);
+        else if(key == "--jitter-ms") options.jitterMs = std::stoi(value);
+        else if(key == "--rate-429") options.rate429 = std::stod(value);
+        else if(key == "--rate-5xx") options.rate5xx = std::stod(value);
+        else if(key == "--retry-after") options.retryAfter = std::stoi(value);
+        else if(key == "--miss-rate") options.missRate = std::stod(value);
+        else if(key == "--library") options.library = std::stoul(value);
+        else if(key == "--token-ttl") options.tokenTtl = std::max(1, std::stoi(value));
+        else if(key == "--rate-reset") options.rateReset = std::stod(value);
+        else{
+            std::cerr << "Unknown option " << key << "\n";
+            std::exit(2);
+        }
+    }
+}
+}
+
+int main(int argc, char* argv[]){
+    parseArgs(argc, argv);
+
+    // Pre-filled library for removal benchmarks
+    for(std::size_t i = 0; i < options.library; ++i){
+        library.add(makeId(fnv1a("library-" + std::to_string(i))));
+    }
+
+    asio::io_context io_ctx;
+    asio::ip::tcp::acceptor acceptor(io_ctx, {asio::ip::tcp::v4(), options.port});
+    asio::co_spawn(io_ctx, listen(acceptor), asio::detached);
+
+    asio::signal_set signals(io_ctx, SIGINT, SIGTERM);
+    signals.async_wait([&](auto, auto){ io_ctx.stop(); });
+
+    std::cout << "Mock Spotify listening on 127.0.0.1:" << options.port
+              << " (latency " << options.latencyMs << "+" << options.jitterMs << "ms"
+              << ", 429 " << options.rate429 << ", 5xx " << options.rate5xx << ", reset " << options.rateReset << ")" << std::endl;
+
+    std::vector<std::thread> threads;
+    for(unsigned i = 1; i < options.threads; ++i){
+        threads.emplace_back([&]{ io_ctx.run(); });
+    }
+    io_ctx.run();
+    for(auto& t : threads){
+        t.join();
+    }
+
+    std::cout << "requests " << stats.requests
+              << ", 429 " << stats.rateLimited
+              << ", 5xx " << stats.failed
+              << ", 401 " << stats.unauthorized
+              << ", reset " << stats.reset
+              << ", library " << library.order.size() << std::endl;
+    return 0;
+}
@@ -0,0 +1,323 @@
+// End-to-end throughput benchmark of SpotifyClient against MockSpotifyServer.
+//
+//   PipelineBenchmark [--host 127.0.0.1] [--port 8080] [--tracks 2000]
+//                     [--remove 0] [--concurrency 16] [--threads 0]
+//                     [--trace <file>] [--jobs 1] [--stream-chunk-ms 0]
+//                     [--format json|tracks]
+//
+// Imports a generated NDJSON file with likeTracksFromJson, then optionally
+// removes the newest tracks with removeLastN. Reports tracks/sec,
+// p50/p99 latency of Web API requests and p50/p99 of every request stage.
+// With --jobs N, N more imports then run at once through JobQueue on one
+// transport, job i with weight i; each one's tracks/sec is reported.
+// With --stream-chunk-ms, the import reads a TrackStream fed 50 records
+// per interval instead, like the Yandex exporter in --stream mode.
+// --format tracks converts the input to a binary track list first.
+
+#include "SpotifyClient.hpp"
+#include "JobQueue.hpp"
+#include "SpotifyIoService.hpp"
+#include "Trace.hpp"
+#include "TrackStream.hpp"
+#include "TrackList.hpp"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options{
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    std::size_t tracks = 2000;
+    std::size_t remove = 0;
+    std::size_t concurrency = 16;
+    // io threads, 0 = default
+    std::size_t threads = 0;
+    // Chrome trace of the run, empty = none
+    std::string tracePath;
+    // Concurrent weighted imports after the main run, 1 = none
+    std::size_t jobs = 1;
+    // Import from a stream fed a chunk per interval, 0 = from the file
+    std::size_t streamChunkMs = 0;
+    // Input file: "json" (NDJSON) or "tracks" (TrackList)
+    std::string format = "json";
+};
+
+// Request durations reported by SpotifyClient
+class LatencySamples{
+public:
+    void add(std::chrono::steady_clock::duration d){
+        std::lock_guard lock(mutex_);
+        samples_.push_back(d);
+    }
+
+    void clear(){
+        std::lock_guard lock(mutex_);
+        samples_.clear();
+    }
+
+    // q in [0, 1], milliseconds
+    double percentile(double q){
+        std::lock_guard lock(mutex_);
+        if(samples_.empty()){
+            return 0.0;
+        }
+        std::sort(samples_.begin(), samples_.end());
+        auto idx = std::min(samples_.size() - 1, std::size_t(q * double(samples_.size())));
+        return std::chrono::duration<double, std::milli>(samples_[idx]).count();
+    }
+
+    std::size_t count(){
+        std::lock_guard lock(mutex_);
+        return samples_.size();
+    }
+private:
+    std::mutex mutex_;
+    std::vector<std::chrono::steady_clock::duration> samples_;
+};
+
+// Run coroutine on the client strand and wait for it
+template <typename Make>
+void runSync(const SpotifyClient& client, Make make){
+    std::promise<void> done;
+    boost::asio::co_spawn(
+        client.executor(),
+        [&]() -> boost::asio::awaitable<void>{
+            co_await make();
+            done.set_value();
+        },
+        boost::asio::detached);
+    done.get_future().wait();
+}
+
+void report(const char* phase, std::size_t tracks, std::chrono::duration<double> elapsed,
+            LatencySamples& samples){
+    std::cout << phase << ": " << tracks << " tracks in " << elapsed.count() << " s, "
+              << double(tracks) / elapsed.count() << " tracks/s, "
+              << samples.count() << " requests, "
+              << "p50 " << samples.percentile(0.50) << " ms, "
+              << "p99 " << samples.percentile(0.99) << " ms" << std::endl;
+}
+
+// p50/p99 of every stage seen for the endpoint
+void reportStages(const SpotifyClient& client, Metrics::Endpoint endpoint){
+    std::cout << "  " << Metrics::name(endpoint) << ":";
+    for(std::size_t s = 0; s < std::size_t(Metrics::Stage::Count); ++s){
+        auto& h = client.metrics().histogram(endpoint, Metrics::Stage(s));
+        if(h.count() == 0){
+            continue;
+        }
+        std::cout << " " << Metrics::name(Metrics::Stage(s)) << " "
+                  << double(h.percentile(0.50).count()) / 1e3 << "/"
+                  << double(h.percentile(0.99).count()) / 1e3 << " ms";
+    }
+    std::cout << std::endl;
+}
+
+void writeInput(const std::filesystem::path& path, std::size_t tracks, const std::string& prefix){
+    std::ofstream out(path);
+    for(std::size_t i = 0; i < tracks; ++i){
+        out << R"({"artist":"Artist )" << i % 997 << R"(","title":")" << prefix << "Title " << i << "\"}\n";
+    }
+}
+
+// Job i (weight i) imports its own file; all share one transport
+void runJobs(const Options& options){
+    auto transport = std::make_shared<SpotifyTransport>();
+    std::vector<std::shared_ptr<SpotifyClient>> clients;
+    std::vector<std::filesystem::path> inputs;
+    for(std::size_t i = 0; i < options.jobs; ++i){
+        auto client = std::make_shared<SpotifyClient>(transport);
+        client->setEndpoints({options.host, options.port, options.host, options.port, false});
+        client->setSearchConcurrency(options.concurrency);
+        runSync(*client, [&]{ return client->fetchTokens("benchmark"); });
+        clients.push_back(client);
+
+        inputs.push_back(std::filesystem::temp_directory_path()
+                         / ("exportlikes_benchmark_job" + std::to_string(i + 1) + ".ndjson"));
+        writeInput(inputs.back(), options.tracks, "Job " + std::to_string(i + 1) + " ");
+    }
+
+    std::mutex mutex;
+    std::map<JobQueue::JobId, std::size_t> index;
+    std::vector<std::chrono::steady_clock::duration> elapsed(options.jobs);
+    auto start = std::chrono::steady_clock::now();
+    {
+        JobQueue queue(options.jobs);
+        queue.setDoneHandler([&](JobQueue::JobId id, JobQueue::State){
+            std::lock_guard lock(mutex);
+            elapsed[index.at(id)] = std::chrono::steady_clock::now() - start;
+        });
+        {
+            std::lock_guard lock(mutex);
+            for(std::size_t i = 0; i < options.jobs; ++i){
+                JobQueue::Job job;
+                job.client = clients[i];
+                job.input = inputs[i].string();
+                job.weight = double(i + 1);
+                index.emplace(queue.submit(std::move(job)), i);
+            }
+        }
+        std::promise<void> idle;
+        boost::asio::co_spawn(GlobalIoService::instance(),
+            [&]() -> boost::asio::awaitable<void>{
+                co_await queue.waitIdle();
+                idle.set_value();
+            },
+            boost::asio::detached);
+        idle.get_future().wait();
+    }
+
+    std::cout << "jobs (" << options.jobs << " at once):" << std::endl;
+    for(std::size_t i = 0; i < options.jobs; ++i){
+        double seconds = std::chrono::duration<double>(elapsed[i]).count();
+        std::cout << "  job " << i + 1 << " weight " << i + 1 << ": " << options.tracks
+                  << " tracks in " << seconds << " s, "
+                  << (seconds > 0 ? double(options.tracks) / seconds : 0.0) << " tracks/sec" << std::endl;
+        std::filesystem::remove(inputs[i]);
+    }
+}
+
+// Records per exporter chunk
+constexpr std::size_t kStreamChunk = 50;
+
+// Exporter stand-in: lines of the input, kStreamChunk per interval
+void feedStream(std::shared_ptr<TrackStream> stream, std::string path,
+                std::chrono::milliseconds interval){
+    std::ifstream in(path);
+    std::string chunk;
+    std::string line;
+    std::size_t lines = 0;
+    while(std::getline(in, line)){
+        chunk += line;
+        chunk += '\n';
+        if(++lines % kStreamChunk == 0){
+            std::this_thread::sleep_for(interval);
+            stream->append(chunk);
+            chunk.clear();
+        }
+    }
+    if(!chunk.empty()){
+        std::this_thread::sleep_for(interval);
+        stream->append(chunk);
+    }
+    stream->close();
+}
+
+Options parseArgs(int argc, char* argv[]){
+    Options options;
+    for(int i = 1; i + 1 < argc; i += 2){
+        std::string key = argv[i];
+        std::string value = argv[i + 1];
+        if(key == "--host") options.host = value;
+        else if(key == "--port") options.port = value;
+        else if(key == "--tracks") options.tracks = std::stoul(value);
+        else if(key == "--remove") options.remove = std::stoul(value);
+        else if(key == "--concurrency") options.concurrency = std::stoul(value);
+        else if(key == "--threads") options.threads = std::stoul(value);
+        else if(key == "--trace") options.tracePath = value;
+        else if(key == "--jobs") options.jobs = std::stoul(value);
+        else if(key == "--stream-chunk-ms") options.streamChunkMs = std::stoul(value);
+        else if(key == "--format") options.format = value;
+        else{
+            std::cerr << "Unknown option " << key << "\n";
+            std::exit(2);
+        }
+    }
+    return options;
+}
+}
+
+int main(int argc, char* argv[]){
+    auto options = parseArgs(argc, argv);
+    GlobalIoService::setThreadCount(options.threads);
+    if(!options.tracePath.empty()){
+        Tracer::start(options.tracePath);
+    }
+
+    // Input in the exporter format, one object per line
+    auto input = std::filesystem::temp_directory_path() / "exportlikes_benchmark.ndjson";
+    writeInput(input, options.tracks, "");
+    if(options.format == "tracks"){
+        auto ndjson = input;
+        input.replace_extension(".tracks");
+        TrackReader reader(ndjson.string());
+        TrackListWriter writer;
+        TrackRecord rec;
+        while(reader.next(rec)){
+            writer.add(rec.artist, rec.title);
+        }
+        writer.write(input.string(), true);
+        std::filesystem::remove(ndjson);
+    }
+
+    LatencySamples samples;
+    {
+        SpotifyClient client;
+        client.setEndpoints({options.host, options.port, options.host, options.port, false});
+        client.setSearchConcurrency(options.concurrency);
+        client.setRequestObserver([&samples](auto, auto elapsed, unsigned){
+            samples.add(elapsed);
+        });
+
+        runSync(client, [&]{ return client.fetchTokens("benchmark"); });
+        if(!client.hasValidAccessToken()){
+            std::cerr << "No token from " << options.host << ":" << options.port << std::endl;
+            return 1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        // Coroutine keeps a reference to its argument: no temporaries
+        auto inputPath = input.string();
+        if(options.streamChunkMs > 0){
+            auto stream = std::make_shared<TrackStream>(client.executor());
+            std::thread producer(feedStream, stream, inputPath,
+                                 std::chrono::milliseconds(options.streamChunkMs));
+            runSync(client, [&]{ return client.likeTracksFromStream(stream); });
+            producer.join();
+            std::size_t chunks = (options.tracks + kStreamChunk - 1) / kStreamChunk;
+            std::cout << "export alone: " << double(chunks * options.streamChunkMs) / 1000.0
+                      << " s" << std::endl;
+        }
+        else{
+            runSync(client, [&]{ return client.likeTracksFromJson(inputPath); });
+        }
+        report("import", options.tracks, std::chrono::steady_clock::now() - start, samples);
+
+        if(options.remove > 0){
+            samples.clear();
+            start = std::chrono::steady_clock::now();
+            runSync(client, [&]{ return client.removeLastN(options.remove); });
+            report("remove", options.remove, std::chrono::steady_clock::now() - start, samples);
+        }
+
+        std::cout << "stages p50/p99:" << std::endl;
+        reportStages(client, Metrics::Endpoint::Search);
+        reportStages(client, Metrics::Endpoint::SavedTracksPut);
+        if(options.remove > 0){
+            reportStages(client, Metrics::Endpoint::SavedTracksGet);
+            reportStages(client, Metrics::Endpoint::SavedTracksDelete);
+        }
+    }
+
+    if(options.jobs > 1){
+        runJobs(options);
+    }
+
+    Tracer::stop();
+    GlobalIoService::stop();
+    std::filesystem::remove(input);
+    return 0;
+}
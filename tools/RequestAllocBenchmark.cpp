@@ -0,0 +1,213 @@
+// Heap allocations per Web API request: legacy request building vs
+// the table-driven encoder, one-buffer targets and precomputed header.
+//
+//   RequestAllocBenchmark [--iterations 100000]
+//
+// Counts operator new calls per search request (target + headers),
+// per PUT of 50 ids and per response read, and reports time per request.
+
+#include "UrlEncode.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+namespace {
+std::atomic<std::size_t> allocations{0};
+}
+
+void* operator new(std::size_t size){
+    ++allocations;
+    if(void* p = std::malloc(size ? size : 1)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept{
+    std::free(p);
+}
+
+namespace {
+namespace http = boost::beast::http;
+using Request = http::request<http::string_body>;
+using Response = http::response<http::string_body>;
+
+const std::string kToken(180, 'T');
+const std::string kArtist = "Кино";
+const std::string kTitle = "Группа крови (Remastered 2019)";
+
+// Request building as it was before
+namespace legacy{
+std::string encodeURL(const std::string& val){
+    std::ostringstream encoded;
+    for (unsigned char c : val){
+        if (std::isalnum(c) || c == '_' ||
+            c == '-' || c == '.' || c == '~'){
+            encoded << c;
+        }
+        else{
+            encoded << '%' << std::uppercase << std::hex << int(c);
+        }
+    }
+    return encoded.str();
+}
+
+Request search(){
+    std::string s = "artist:" + kArtist + " track:" + kTitle;
+    std::string path = "/v1/search?q=" + encodeURL(s) + "&type=track&limit=1";
+    Request req{http::verb::get, path, 11};
+    req.set(http::field::host, "api.spotify.com");
+    req.set(http::field::user_agent, "ExportLikes/1.0");
+    req.set(http::field::authorization, "Bearer " + kToken);
+    req.keep_alive(true);
+    req.prepare_payload();
+    return req;
+}
+
+Request put(const std::vector<std::string>& ids){
+    std::string tracksString;
+    for(size_t i = 0; i < ids.size(); i++){
+        tracksString += ids[i];
+        if(i < ids.size() - 1){
+            tracksString += ",";
+        }
+    }
+    std::string target = "/v1/me/tracks?ids=" + encodeURL(tracksString);
+    Request req{http::verb::put, target, 11};
+    req.set(http::field::host, "api.spotify.com");
+    req.set(http::field::user_agent, "ExportLikes/1.0");
+    req.set(http::field::authorization, "Bearer " + kToken);
+    req.keep_alive(true);
+    req.prepare_payload();
+    return req;
+}
+
+void read(const std::string& raw){
+    boost::beast::flat_buffer buffer;
+    Response res;
+    http::response_parser<http::string_body> parser;
+    auto bytes = boost::asio::buffer_copy(buffer.prepare(raw.size()),
+                                          boost::asio::buffer(raw));
+    buffer.commit(bytes);
+    boost::beast::error_code ec;
+    parser.put(buffer.data(), ec);
+    res = parser.release();
+}
+}
+
+// Current request building
+namespace current{
+const std::string authorizationHeader = "Bearer " + kToken;
+
+Request search(){
+    std::string path;
+    path.reserve(64 + 3 * (kArtist.size() + kTitle.size()));
+    path += "/v1/search?q=";
+    appendUrlEncoded(path, "artist:");
+    appendUrlEncoded(path, kArtist);
+    appendUrlEncoded(path, " ");
+    appendUrlEncoded(path, "track:");
+    appendUrlEncoded(path, kTitle);
+    path += "&type=track&limit=1";
+    Request req{http::verb::get, path, 11};
+    req.set(http::field::host, "api.spotify.com");
+    req.set(http::field::user_agent, "ExportLikes/1.0");
+    req.set(http::field::authorization, authorizationHeader);
+    req.keep_alive(true);
+    req.prepare_payload();
+    return req;
+}
+
+Request put(const std::vector<std::string>& ids){
+    std::string target;
+    target.reserve(32 + ids.size() * 25);
+    target += "/v1/me/tracks?ids=";
+    for(size_t i = 0; i < ids.size(); i++){
+        if(i > 0){
+            target += "%2C";
+        }
+        appendUrlEncoded(target, ids[i]);
+    }
+    Request req{http::verb::put, target, 11};
+    req.set(http::field::host, "api.spotify.com");
+    req.set(http::field::user_agent, "ExportLikes/1.0");
+    req.set(http::field::authorization, authorizationHeader);
+    req.keep_alive(true);
+    req.prepare_payload();
+    return req;
+}
+
+// Read buffer lives with the pooled connection
+boost::beast::flat_buffer connectionBuffer;
+
+void read(const std::string& raw){
+    Response res;
+    http::response_parser<http::string_body> parser;
+    auto bytes = boost::asio::buffer_copy(connectionBuffer.prepare(raw.size()),
+                                          boost::asio::buffer(raw));
+    connectionBuffer.commit(bytes);
+    boost::beast::error_code ec;
+    parser.put(connectionBuffer.data(), ec);
+    connectionBuffer.consume(connectionBuffer.size());
+    res = parser.release();
+}
+}
+
+template <typename Fn>
+void measure(const char* name, std::size_t iterations, Fn fn){
+    // Warm up static buffers
+    fn();
+    auto before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for(std::size_t i = 0; i < iterations; ++i){
+        fn();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    auto count = allocations.load() - before;
+    std::cout << name << ": " << double(count) / double(iterations) << " allocations, "
+              << elapsed.count() / double(iterations) << " ns" << std::endl;
+}
+}
+
+int main(int argc, char* argv[]){
+    std::size_t iterations = 100000;
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(std::string(argv[i]) == "--iterations"){
+            iterations = std::stoul(argv[i + 1]);
+        }
+        else{
+            std::cerr << "Unknown option " << argv[i] << "\n";
+            return 2;
+        }
+    }
+
+    std::vector<std::string> ids;
+    for(int i = 0; i < 50; ++i){
+        ids.push_back("4uLU6hMCjMI75M1A2tKUQ" + std::to_string(i % 10));
+    }
+    const std::string raw =
+        "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: 96\r\n"
+        "Connection: keep-alive\r\n\r\n"
+        R"({"tracks":{"items":[{"id":"4uLU6hMCjMI75M1A2tKUQX","name":"Track","uri":"spotify:track:x"}]}})";
+
+    measure("search request, legacy ", iterations, []{ legacy::search(); });
+    measure("search request, current", iterations, []{ current::search(); });
+    measure("PUT 50 ids, legacy     ", iterations / 10, [&]{ legacy::put(ids); });
+    measure("PUT 50 ids, current    ", iterations / 10, [&]{ current::put(ids); });
+    measure("response read, legacy  ", iterations, [&]{ legacy::read(raw); });
+    measure("response read, current ", iterations, [&]{ current::read(raw); });
+    return 0;
+}